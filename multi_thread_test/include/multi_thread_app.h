@@ -5,6 +5,16 @@
 #include <GLFW/glfw3.h>
 #include <memory>
 #include "terrain_generator.h"
+#include "terrain_streamer.h"
+#include "terrain_batch.h"
+#include "instanced_terrain.h"
+#include "heightmap_terrain.h"
+#include "tessellated_terrain.h"
+#include "compute_terrain_generator.h"
+#include "command_recorder.h"
+#include "frame_uniforms.h"
+#include "offscreen_target.h"
+#include "gl_state.h"
 #include "performance_monitor.h"
 #include "render_thread.h"
 
@@ -16,6 +26,10 @@ public:
     bool initialize();
     int run();
     
+    // Direct vs command-list submission time for growing patch counts;
+    // replaces run()
+    int runCommandListBenchmark();
+    
 private:
     // Initialization
     bool initializeGL();
@@ -25,24 +39,45 @@ private:
     
 public:
     // Configuration
-    void configureTerrain(int gridSize, int patchCount, float heightScale);
+    void configureTerrain(const TerrainConfig& config);
+    void configureStreaming(const StreamingConfig& config);
+    void setLodTolerance(float pixels) { lodTolerance_ = pixels; } // 0 = always full detail
+    void setTessellationEdgePixels(float pixels) { tessellationEdgePixels_ = pixels; }
+    void setComputeGeneration(bool enabled) { useComputeGeneration_ = enabled; }  // Batched modes only
+    void setRenderMode(RenderMode mode);
+    void setHeadless(const HeadlessConfig& config) { headless_ = config; }  // Before initialize(); also limits run()
+    void setUploadRingSize(size_t bytes) { uploadRingBytes_ = bytes; } // Before initialize(); 0 = no ring
+    void setRecordThreads(int threads);     // Per-patch draws through command lists; 0 = direct
     
 private:
     
     // Main loop
     void update();
     void render();
+    void prepareFrame(Shader& shader);  // State, program and uniforms shared by every draw
     void handleInput();
     
     // Rendering functions
     void uploadPatchToGPU(TerrainPatch& patch);
-    void renderPatch(const TerrainPatch& patch);
+    void createPatchVAO(TerrainPatch& patch, GLuint buffer, size_t offset);  // Vertices at offset in buffer
+    void renderPatch(const TerrainPatch& patch, int lodLevel = 0, int stitchMask = 0);
+    bool uploadTerrainBatch();  // Falls back to per-patch rendering on failure
+    void renderBatch(const std::vector<const TerrainPatch*>& grid);
+    bool uploadInstancedTerrain();  // Turns instancing off on failure
+    void renderInstanced(const std::vector<const TerrainPatch*>& grid);
+    bool uploadHeightmapTerrain();  // Falls back to per-patch rendering on failure
+    void renderHeightmap(const std::vector<const TerrainPatch*>& grid);
+    bool uploadTessellatedTerrain();  // Turns tessellation off on failure
+    void renderTessellated(float pixelScale);
+    void renderCommandLists(const std::vector<const TerrainPatch*>& grid, int columns, float pixelScale, bool cull = true);
+    void recordPatchStats(const TerrainPatch& patch, const PatchLod& range);
     void setupMatrices();
     void distributeRenderWork();
     
     // Multi-threading utilities
     void submitPatchUploadWork();
     void waitForRenderThread();
+    void collectPatchUploads();
     
     // Cleanup
     void cleanup();
@@ -54,13 +89,29 @@ private:
     
     // Terrain
     std::unique_ptr<TerrainGenerator> terrainGenerator_;
+    std::unique_ptr<TerrainStreamer> terrainStreamer_;  // Set in streaming mode
+    TerrainBatch terrainBatch_;                         // Uploaded in the batched render modes
+    InstancedTerrain instancedTerrain_;                 // Uploaded while instancing is on
+    HeightmapTerrain heightmapTerrain_;                 // Uploaded in the heightmap render mode
+    TessellatedTerrain tessellatedTerrain_;             // Uploaded while tessellation is on
+    ComputeTerrainGenerator computeGenerator_;          // Fills the batch's vertex buffer when enabled
+    bool useComputeGeneration_ = false;
+    RenderMode renderMode_ = RenderMode::PerPatch;      // Static terrain only; streamed tiles draw per patch
+    std::unique_ptr<CommandRecorder> commandRecorder_;  // Set when per-patch draws are recorded on workers
     
     // Shaders
+    ShaderCompiler shaderCompiler_;
     Shader terrainShader_;
     Shader instancedShader_;
+    Shader heightmapShader_;
+    Shader tessellatedShader_;          // Invalid without tessellation support
+    FrameUniformBuffer frameUniforms_;
     
     // Render thread
     std::unique_ptr<RenderThread> renderThread_;
+    size_t uploadRingBytes_ = 16u * 1024 * 1024;
+    std::vector<CompletedUpload> completedUploads_;    // Reused across frames
+    bool patchUploadsSubmitted_ = false;               // Not in the batched modes unless they fall back
     
     // Camera
     glm::vec3 cameraPos_;
@@ -82,6 +133,8 @@ private:
     std::unique_ptr<PerformanceMonitor> perfMonitor_;
     std::unique_ptr<PerformanceMonitor> renderThreadPerfMonitor_;
     bool showPerformanceInfo_;
+    HeadlessConfig headless_;
+    OffscreenTarget offscreenTarget_;   // Drawn into instead of the window when headless
     
     // Timing
     float deltaTime_;
@@ -91,7 +144,12 @@ private:
     bool wireframeMode_;
     bool useLighting_;
     bool useInstancing_;
+    bool useTessellation_ = false;
+    float tessellationEdgePixels_ = 8.0f;   // Target projected length of a tessellated edge segment
     float globalScale_;
+    float lodTolerance_;    // Max screen-space error in pixels
+    std::vector<int> lodLevels_;    // Per-frame selection, reused across frames
+    std::vector<int> stitchMasks_;
     
     // Multi-threading state
     bool useMultiThreading_;
@@ -9,6 +9,8 @@
 #include <atomic>
 #include <queue>
 #include <memory>
+#include <vector>
+#include "upload_ring.h"
 
 struct RenderTask {
     enum Type {
@@ -20,11 +22,27 @@ struct RenderTask {
     
     Type type;
     int patchId;
-    std::vector<float> vertexData;
-    std::vector<unsigned int> indexData;
+    
+    // Upload source: a region of the upload ring the data was copied to, or
+    // (without a ring) the caller's memory, which must stay alive until the
+    // task has run
+    const void* vertexData;
+    size_t vertexSize;
+    bool staged;
+    UploadRing::Region region;
+    size_t targetOffset;    // Destination within the upload target
     
     RenderTask(Type t = RENDER_PATCH, int id = -1)
-        : type(t), patchId(id) {}
+        : type(t), patchId(id), vertexData(nullptr), vertexSize(0), staged(false), targetOffset(0) {}
+};
+
+// A patch's vertices the render thread filled in. The buffer is the render
+// thread's upload target, shared by every patch and owned by the thread.
+struct CompletedUpload {
+    int patchId;
+    GLuint buffer;
+    size_t offset;
+    size_t bytes;
 };
 
 class RenderThread {
@@ -32,23 +50,40 @@ public:
     RenderThread();
     ~RenderThread();
     
-    // Thread management
-    bool initialize(GLFWwindow* sharedContext);
+    // Thread management. Uploads are staged through a persistently mapped
+    // ring of ringBytes where supported (0 = direct glBufferData uploads).
+    bool initialize(GLFWwindow* sharedContext, size_t ringBytes = 16u * 1024 * 1024);
     void start();
     void stop();
     bool isRunning() const { return isRunning_.load(); }
     
     // Task submission
     void submitTask(const RenderTask& task);
-    void submitPatchUpload(int patchId, void* vertexData, size_t vertexSize, void* indexData, size_t indexSize);
     
-    // Synchronization
+    // Patch uploads land in one buffer of targetBytes, created by the worker
+    // with the first upload. Set before submitting patch uploads. The buffer
+    // is allocated once: a later call asking for more is rejected.
+    bool setUploadTarget(size_t targetBytes);
+    
+    // Copies the data into the upload ring right away, which may wait for
+    // the GPU to free space; without a ring the data is read by the task.
+    // The task writes it to targetOffset in the upload target.
+    void submitPatchUpload(int patchId, const void* vertexData, size_t vertexSize, size_t targetOffset);
+    
+    // Buffers uploaded since the last call. Call with the sharing context
+    // current: it makes that context wait for the uploads on the GPU.
+    void collectUploads(std::vector<CompletedUpload>& uploads);
+    
+    // Synchronization. Returns once every submitted task has run and its
+    // uploads are fenced, i.e. collectUploads() returns them.
     void waitForCompletion();
     bool hasPendingTasks() const;
     
     // Statistics
     size_t getProcessedTasks() const { return processedTasks_.load(); }
     size_t getQueueSize() const;
+    bool hasUploadRing() const { return uploadRing_.isCreated(); }
+    void printUploadReport() const { uploadRing_.printReport(); }
     
 private:
     // Thread function
@@ -56,7 +91,8 @@ private:
     
     // Task processing
     void processTask(const RenderTask& task);
-    void uploadPatchData(int patchId, const void* vertexData, size_t vertexSize, const void* indexData, size_t indexSize);
+    void uploadPatchData(const RenderTask& task);
+    void finishUploads();   // Fences what this batch of tasks read
     
     // OpenGL context
     GLFWwindow* workerContext_;
@@ -69,13 +105,25 @@ private:
     
     // Task queue
     std::queue<RenderTask> taskQueue_;
+    size_t inFlightTasks_;              // Queued or not yet finished; guarded by queueMutex_
     mutable std::mutex queueMutex_;
     std::condition_variable queueCondition_;
     
+    // Uploads
+    UploadRing uploadRing_;
+    std::mutex submitMutex_;            // Keeps ring regions in queue order
+    uint64_t consumedEnd_;              // Ring position up to which copies were issued
+    size_t targetBytes_;
+    GLuint targetBuffer_;               // Every patch's vertices, immutable where the ring is
+    std::vector<CompletedUpload> pendingUploads_;   // Issued, not yet fenced
+    
+    std::mutex completedMutex_;
+    std::vector<CompletedUpload> completedUploads_;
+    std::vector<GLsync> completedFences_;
+    
     // Statistics
     std::atomic<size_t> processedTasks_;
     
-    // Synchronization
+    // Synchronization, with queueMutex_
     std::condition_variable completionCondition_;
-    mutable std::mutex completionMutex_;
 };
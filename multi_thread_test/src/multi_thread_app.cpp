@@ -1,9 +1,11 @@
 #include "multi_thread_app.h"
+#include <iomanip>
 #include <iostream>
 #include <GLFW/glfw3.h>
 #include <GL/glew.h>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include "terrain_lod.h"
 
 // Static member initialization
 MultiThreadApp* MultiThreadApp::s_instance_ = nullptr;
@@ -14,7 +16,7 @@ MultiThreadApp::MultiThreadApp(int windowWidth, int windowHeight)
       cameraUp_(0.0f, 1.0f, 0.0f), cameraYaw_(-90.0f), cameraPitch_(0.0f),
       cameraSpeed_(5.0f), mouseSensitivity_(0.1f), firstMouse_(true),
       lastMouseX_(windowWidth_ / 2.0), lastMouseY_(windowHeight_ / 2.0),
-      globalScale_(1.0f), deltaTime_(0.0f), lastFrame_(0.0f),
+      globalScale_(1.0f), lodTolerance_(0.0f), deltaTime_(0.0f), lastFrame_(0.0f),
       wireframeMode_(false), useLighting_(true), useInstancing_(false),
       showPerformanceInfo_(true), useMultiThreading_(true),
       patchesUploaded_(0), totalPatches_(0) {
@@ -33,13 +35,16 @@ bool MultiThreadApp::initialize() {
         return false;
     }
     
-    if (!initializeTerrain()) {
-        std::cerr << "Failed to initialize terrain!" << std::endl;
+    // Shaders build in the background where the context allows, while the
+    // terrain generates; their first use waits for them
+    shaderCompiler_.initialize(window_);
+    if (!initializeShaders()) {
+        std::cerr << "Failed to initialize shaders!" << std::endl;
         return false;
     }
     
-    if (!initializeShaders()) {
-        std::cerr << "Failed to initialize shaders!" << std::endl;
+    if (!initializeTerrain()) {
+        std::cerr << "Failed to initialize terrain!" << std::endl;
         return false;
     }
     
@@ -56,16 +61,48 @@ bool MultiThreadApp::initialize() {
 }
 
 bool MultiThreadApp::initializeGL() {
+    // Headless runs need GLFW's null platform (3.4): a surfaceless EGL or
+    // OSMesa context, e.g. Mesa's llvmpipe, with no display server. An
+    // invisible native window would still need X11 or Wayland.
+    if (headless_.enabled) {
+#ifdef GLFW_PLATFORM_NULL
+        if (!glfwPlatformSupported(GLFW_PLATFORM_NULL)) {
+            std::cerr << "--headless: GLFW was built without its null platform" << std::endl;
+            return false;
+        }
+        glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+#else
+        std::cerr << "--headless needs GLFW 3.4 or newer (null platform)" << std::endl;
+        return false;
+#endif
+    }
+    
     if (!glfwInit()) {
         std::cerr << "Failed to initialize GLFW!" << std::endl;
         return false;
     }
     
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    // Newest core context the paths use: 4.3 for indirect draws, else 3.3
+    static const int contextVersions[][2] = {{4, 3}, {3, 3}};
+    // The null platform has no native context API
+    const std::vector<int> contextApis = headless_.enabled ? std::vector<int>{ GLFW_EGL_CONTEXT_API, GLFW_OSMESA_CONTEXT_API }
+                                                           : std::vector<int>{ GLFW_NATIVE_CONTEXT_API };
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-    
-    window_ = glfwCreateWindow(windowWidth_, windowHeight_, "Multi-Thread OpenGL Test", NULL, NULL);
+    glfwWindowHint(GLFW_VISIBLE, headless_.enabled ? GLFW_FALSE : GLFW_TRUE);
+    for (const auto& version : contextVersions) {
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, version[0]);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, version[1]);
+        for (int api : contextApis) {
+            glfwWindowHint(GLFW_CONTEXT_CREATION_API, api);
+            window_ = glfwCreateWindow(windowWidth_, windowHeight_, "Multi-Thread OpenGL Test", NULL, NULL);
+            if (window_) {
+                break;
+            }
+        }
+        if (window_) {
+            break;
+        }
+    }
     if (!window_) {
         std::cerr << "Failed to create GLFW window!" << std::endl;
         glfwTerminate();
@@ -77,6 +114,13 @@ bool MultiThreadApp::initializeGL() {
     // Initialize GLEW immediately after OpenGL context is created
     glewExperimental = GL_TRUE;
     GLenum glewError = glewInit();
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+    // GLEW built for GLX loads the GL entry points, then finds no GLX
+    // display behind an EGL or OSMesa context
+    if (headless_.enabled && glewError == GLEW_ERROR_NO_GLX_DISPLAY) {
+        glewError = GLEW_OK;
+    }
+#endif
     if (glewError != GLEW_OK) {
         std::cerr << "Failed to initialize GLEW! Error: " << glewGetErrorString(glewError) << std::endl;
         return false;
@@ -91,11 +135,23 @@ bool MultiThreadApp::initializeGL() {
     std::cout << "GLEW initialized successfully!" << std::endl;
     std::cout << "OpenGL Version: " << glGetString(GL_VERSION) << std::endl;
     
-    glfwSetFramebufferSizeCallback(window_, framebufferSizeCallback);
-    glfwSetCursorPosCallback(window_, mouseCallback);
-    glfwSetScrollCallback(window_, scrollCallback);
+    if (headless_.enabled) {
+        if (!offscreenTarget_.create(windowWidth_, windowHeight_)) {
+            return false;
+        }
+        offscreenTarget_.bind();
+        std::cout << "Headless: rendering " << windowWidth_ << "x" << windowHeight_ << " offscreen ("
+                  << glGetString(GL_RENDERER) << ")" << std::endl;
+    }
     
-    glfwSetInputMode(window_, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+    // Nothing to resize or steer headless; frames go to the offscreen target
+    if (!headless_.enabled) {
+        glfwSetFramebufferSizeCallback(window_, framebufferSizeCallback);
+        glfwSetCursorPosCallback(window_, mouseCallback);
+        glfwSetScrollCallback(window_, scrollCallback);
+        
+        glfwSetInputMode(window_, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+    }
     
     return true;
 }
@@ -107,36 +163,112 @@ bool MultiThreadApp::initializeTerrain() {
     return true;
 }
 
-void MultiThreadApp::configureTerrain(int gridSize, int patchCount, float heightScale) {
+void MultiThreadApp::configureTerrain(const TerrainConfig& config) {
     if (terrainGenerator_) {
-        terrainGenerator_->setGridSize(gridSize);
-        terrainGenerator_->setPatchCount(patchCount);
-        terrainGenerator_->setHeightScale(heightScale);
-        terrainGenerator_->generateTerrain();
+        // The vertex shader has to match the vertex format
+        const bool formatChanged = config.vertexFormat != terrainGenerator_->getVertexFormat();
+        terrainBatch_.release();
+        instancedTerrain_.release();
+        heightmapTerrain_.release();
+        tessellatedTerrain_.release();
+        terrainGenerator_->configure(config);
+        if (formatChanged) {
+            initializeShaders();
+        }
+        terrainGenerator_->generateOrLoad(config.cachePath);
         totalPatches_ = terrainGenerator_->getPatches().size();
     }
 }
 
-bool MultiThreadApp::initializeShaders() {
-    terrainShader_.load("shaders/basic.vert", "shaders/terrain.frag");
-    if (!terrainShader_.isValid()) {
-        std::cerr << "Failed to load terrain shader!" << std::endl;
-        return false;
+void MultiThreadApp::configureStreaming(const StreamingConfig& config) {
+    terrainStreamer_.reset();
+    if (terrainGenerator_ && config.enabled) {
+        // Tiles come from the streamer; the up-front terrain is not needed
+        terrainBatch_.release();
+        instancedTerrain_.release();
+        heightmapTerrain_.release();
+        tessellatedTerrain_.release();
+        terrainGenerator_->clear();
+        terrainStreamer_ = std::make_unique<TerrainStreamer>(*terrainGenerator_, config);
     }
-    
-    instancedShader_.load("shaders/instanced.vert", "shaders/terrain.frag");
-    if (!instancedShader_.isValid()) {
-        std::cout << "Warning: Instanced shader failed to load, instancing disabled" << std::endl;
-        useInstancing_ = false;
+}
+
+void MultiThreadApp::setRenderMode(RenderMode mode) {
+    // Instancing (I) and tessellation (T) are toggles over the other modes;
+    // their modes start with them on, over per-patch rendering
+    useInstancing_ = mode == RenderMode::Instanced;
+    useTessellation_ = mode == RenderMode::Tessellated;
+    renderMode_ = useInstancing_ || useTessellation_ ? RenderMode::PerPatch : mode;
+}
+
+void MultiThreadApp::setRecordThreads(int threads) {
+    commandRecorder_.reset();
+    if (threads > 0) {
+        commandRecorder_ = std::make_unique<CommandRecorder>(threads);
+        std::cout << "Per-patch draws recorded into command lists on " << commandRecorder_->getThreadCount()
+                  << " threads" << std::endl;
+    }
+}
+
+bool MultiThreadApp::initializeShaders() {
+    // Before the terrain exists the default (float) format applies
+    const VertexFormat format = terrainGenerator_ ? terrainGenerator_->getVertexFormat() : VertexFormat::Float;
+    if (!frameUniforms_.isCreated()) {
+        frameUniforms_.create();
+    }
+    
+    // Failures are reported when a program is first used; the terrain
+    // shader is the only one without a fallback
+    terrainShader_.loadAsync(shaderCompiler_, VertexFormats::vertexShaderPath(format), "shaders/terrain.frag",
+                             [](const Shader& shader) {
+        if (!shader.isValid()) {
+            std::cerr << "Failed to load terrain shader!" << std::endl;
+            return;
+        }
+        shader.bindUniformBlock(FrameUniformBuffer::BLOCK_NAME, FrameUniformBuffer::BINDING);
+    });
+    
+    instancedShader_.loadAsync(shaderCompiler_, InstancedTerrain::VERTEX_SHADER, "shaders/terrain.frag",
+                               [this](const Shader& shader) {
+        if (!shader.isValid()) {
+            std::cout << "Warning: Instanced shader failed to load, instancing disabled" << std::endl;
+            useInstancing_ = false;
+            return;
+        }
+        shader.bindUniformBlock(FrameUniformBuffer::BLOCK_NAME, FrameUniformBuffer::BINDING);
+        shader.use();
+        shader.setInt("heightmaps", InstancedTerrain::HEIGHTMAP_UNIT);
+    });
+    
+    // Failure only matters if these modes are used, which then fall back
+    heightmapShader_.loadAsync(shaderCompiler_, HeightmapTerrain::VERTEX_SHADER, "shaders/terrain.frag",
+                               [](const Shader& shader) {
+        if (shader.isValid()) {
+            shader.bindUniformBlock(FrameUniformBuffer::BLOCK_NAME, FrameUniformBuffer::BINDING);
+            shader.use();
+            shader.setInt("heightmap", HeightmapTerrain::HEIGHTMAP_UNIT);
+            shader.setInt("normalmap", HeightmapTerrain::NORMALMAP_UNIT);
+        }
+    });
+    if (TessellatedTerrain::isSupported()) {
+        tessellatedShader_.loadAsync(shaderCompiler_, TessellatedTerrain::VERTEX_SHADER,
+                                     TessellatedTerrain::TESS_CONTROL_SHADER, TessellatedTerrain::TESS_EVALUATION_SHADER,
+                                     "shaders/terrain.frag", [](const Shader& shader) {
+            if (shader.isValid()) {
+                shader.bindUniformBlock(FrameUniformBuffer::BLOCK_NAME, FrameUniformBuffer::BINDING);
+                shader.use();
+                shader.setInt("heightmap", TessellatedTerrain::HEIGHTMAP_UNIT);
+                shader.setInt("normalmap", TessellatedTerrain::NORMALMAP_UNIT);
+            }
+        });
     }
-    
     return true;
 }
 
 bool MultiThreadApp::initializeRenderThread() {
     renderThread_ = std::make_unique<RenderThread>();
     
-    if (!renderThread_->initialize(window_)) {
+    if (!renderThread_->initialize(window_, uploadRingBytes_)) {
         std::cerr << "Failed to initialize render thread!" << std::endl;
         return false;
     }
@@ -148,11 +280,10 @@ bool MultiThreadApp::initializeRenderThread() {
 int MultiThreadApp::run() {
     setupMatrices();
     
-    // Upload terrain patches in background
-    if (useMultiThreading_) {
-        submitPatchUploadWork();
-    }
-    
+    // A fixed number of frames or seconds, if set (always when headless)
+    const double startTime = glfwGetTime();
+    int frameCount = 0;
+    bool firstFrame = true;
     while (!glfwWindowShouldClose(window_)) {
         float currentFrame = glfwGetTime();
         deltaTime_ = currentFrame - lastFrame_;
@@ -164,82 +295,225 @@ int MultiThreadApp::run() {
         render();
         handleInput();
         
+        // Headless frames are not presented; finishing them keeps the GPU's
+        // work (the CPU's, with llvmpipe) in the frame times
+        if (headless_.enabled) {
+            glFinish();
+        }
+        
         perfMonitor_->endFrame();
         
-        glfwSwapBuffers(window_);
+        if (!headless_.enabled) {
+            glfwSwapBuffers(window_);
+        }
+        if (firstFrame) {
+            // Startup as a user sees it, from GLFW initialization until the
+            // first frame is done; compare a cold and a warm shader cache
+            glFinish();
+            const ProgramCache::Stats programs = ProgramCache::getStats();
+            std::cout << "Time to first frame: " << PerformanceMonitor::formatTime(glfwGetTime() * 1000.0)
+                      << " (shader programs: " << programs.hits << " from binaries, " << programs.misses
+                      << " compiled)" << std::endl;
+            firstFrame = false;
+        }
         glfwPollEvents();
+        
+        frameCount++;
+        if ((headless_.frames > 0 && frameCount >= headless_.frames) ||
+            (headless_.seconds > 0.0 && glfwGetTime() - startTime >= headless_.seconds)) {
+            break;
+        }
+    }
+    
+    if (headless_.enabled) {
+        const double elapsed = glfwGetTime() - startTime;
+        std::cout << "Headless run: " << frameCount << " frames in " << std::fixed << std::setprecision(2) << elapsed
+                  << " s (" << std::setprecision(1) << (elapsed > 0.0 ? frameCount / elapsed : 0.0) << " FPS)"
+                  << std::endl;
     }
     
     if (showPerformanceInfo_) {
         perfMonitor_->printReport();
+        ProgramCache::printReport();
+        if (terrainStreamer_) {
+            terrainStreamer_->printReport();
+        }
         
         if (useMultiThreading_) {
             std::cout << "\n=== Render Thread Performance ===" << std::endl;
             renderThreadPerfMonitor_->printReport();
             std::cout << "Processed Tasks: " << renderThread_->getProcessedTasks() << std::endl;
+            if (renderThread_->hasUploadRing()) {
+                renderThread_->printUploadReport();
+            }
         }
     }
     
     return 0;
 }
 
+int MultiThreadApp::runCommandListBenchmark() {
+    if (terrainStreamer_) {
+        std::cerr << "The command list benchmark needs a fixed terrain (no --streaming)" << std::endl;
+        return 1;
+    }
+    
+    setupMatrices();
+    prepareFrame(terrainShader_);
+    for (const auto& patch : terrainGenerator_->getPatches()) {
+        uploadPatchToGPU(const_cast<TerrainPatch&>(patch));
+    }
+    
+    // Thread counts to record with: one, and the configured (or all) cores
+    std::vector<int> threadCounts = { 1 };
+    const int threads = commandRecorder_ ? commandRecorder_->getThreadCount()
+                                         : std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    if (threads > 1) {
+        threadCounts.push_back(threads);
+    }
+    
+    const int frames = 30;
+    const float pixelScale = TerrainLod::pixelScale(windowHeight_, glm::radians(45.0f));
+    const int columns = terrainGenerator_->getPatchesPerRow();
+    std::unique_ptr<CommandRecorder> configuredRecorder = std::move(commandRecorder_);
+    
+    std::cout << "\n=== Command List Benchmark ===" << std::endl;
+    std::cout << "CPU ms per frame over " << frames << " frames; culling off so every path issues the same draws"
+              << std::endl;
+    std::cout << std::setw(9) << "Patches" << std::setw(10) << "Direct" << std::setw(9) << "Threads"
+              << std::setw(10) << "Record" << std::setw(10) << "Replay" << std::setw(10) << "Total"
+              << std::setw(10) << "Speedup" << std::endl;
+    
+    // More patches: the terrain's grid repeated below itself
+    for (int copies : { 1, 4, 16, 64 }) {
+        std::vector<const TerrainPatch*> grid;
+        for (int copy = 0; copy < copies; copy++) {
+            for (const auto& patch : terrainGenerator_->getPatches()) {
+                grid.push_back(&patch);
+            }
+        }
+        
+        double directMs = 0.0;
+        for (int frame = 0; frame < frames; frame++) {
+            const double start = glfwGetTime();
+            TerrainLod::selectGridLevels(grid, columns, cameraPos_ / globalScale_, pixelScale, lodTolerance_, lodLevels_, stitchMasks_);
+            for (size_t i = 0; i < grid.size(); i++) {
+                renderPatch(*grid[i], lodLevels_[i], stitchMasks_[i]);
+            }
+            directMs += (glfwGetTime() - start) * 1000.0;
+            glFinish();     // Keep the driver queue from growing between frames
+        }
+        directMs /= frames;
+        
+        for (int threadCount : threadCounts) {
+            commandRecorder_ = std::make_unique<CommandRecorder>(threadCount);
+            perfMonitor_->reset();
+            for (int frame = 0; frame < frames; frame++) {
+                renderCommandLists(grid, columns, pixelScale, false);
+                glFinish();
+            }
+            const double recordMs = perfMonitor_->getMetrics().recordTime / frames;
+            const double replayMs = perfMonitor_->getMetrics().submitTime / frames;
+            
+            std::cout << std::fixed << std::setprecision(3)
+                      << std::setw(9) << grid.size() << std::setw(10) << directMs << std::setw(9) << threadCount
+                      << std::setw(10) << recordMs << std::setw(10) << replayMs << std::setw(10) << recordMs + replayMs
+                      << std::setw(9) << std::setprecision(2) << directMs / std::max(recordMs + replayMs, 1e-9) << "x"
+                      << std::endl;
+        }
+    }
+    std::cout << "==============================\n" << std::endl;
+    
+    commandRecorder_ = std::move(configuredRecorder);
+    perfMonitor_->reset();
+    return 0;
+}
+
 void MultiThreadApp::update() {
     // Update camera position based on input
     // (handled in handleInput)
 }
 
 void MultiThreadApp::render() {
-    if (wireframeMode_) {
-        glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-    } else {
-        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-    }
-    
-    glClearColor(0.1f, 0.1f, 0.2f, 1.0f);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    glEnable(GL_DEPTH_TEST);
-    
-    // Use appropriate shader
-    if (useInstancing_ && instancedShader_.isValid()) {
-        instancedShader_.use();
-        instancedShader_.setMat4("view", view_);
-        instancedShader_.setMat4("projection", projection_);
-        instancedShader_.setFloat("globalScale", globalScale_);
-    } else {
-        terrainShader_.use();
-        terrainShader_.setMat4("view", view_);
-        terrainShader_.setMat4("projection", projection_);
-        terrainShader_.setMat4("model", glm::scale(glm::mat4(1.0f), glm::vec3(globalScale_)));
+    // The tessellated, instanced and heightmap terrains have their own
+    // programs, so they are uploaded before the frame state is set
+    const bool tessellated = useTessellation_ && !terrainStreamer_ && uploadTessellatedTerrain();
+    const bool instanced = !tessellated && useInstancing_ && !terrainStreamer_ && uploadInstancedTerrain();
+    const bool heightmap = !tessellated && !instanced && renderMode_ == RenderMode::Heightmap && !terrainStreamer_ &&
+                           uploadHeightmapTerrain();
+    prepareFrame(tessellated ? tessellatedShader_ : instanced ? instancedShader_ : heightmap ? heightmapShader_
+                                                                                           : terrainShader_);
+    
+    // The batch replaces the per-patch buffers and is uploaded here, on the
+    // GL thread, in a single call. Per-patch buffers are only uploaded, in
+    // the background, once a frame actually draws per patch.
+    const bool batched = !terrainStreamer_ &&
+                         (tessellated || instanced || heightmap || (renderMode_ != RenderMode::PerPatch && uploadTerrainBatch()));
+    if (useMultiThreading_ && !batched && !terrainStreamer_ && !patchUploadsSubmitted_) {
+        submitPatchUploadWork();
     }
     
-    // Set common uniforms
-    Shader& currentShader = useInstancing_ ? instancedShader_ : terrainShader_;
-    currentShader.setVec3("lightPos", glm::vec3(50.0f, 50.0f, 50.0f));
-    currentShader.setVec3("lightColor", glm::vec3(1.0f, 1.0f, 1.0f));
-    currentShader.setVec3("viewPos", cameraPos_);
-    currentShader.setInt("useLighting", useLighting_ ? 1 : 0);
-    currentShader.setInt("useTexture", 0);
-    currentShader.setFloat("time", glfwGetTime());
-    
     // Wait for render thread to complete uploads before rendering
     if (useMultiThreading_) {
         waitForRenderThread();
     }
+    collectPatchUploads();
     
-    // Render terrain patches
-    const auto& patches = terrainGenerator_->getPatches();
-    for (const auto& patch : patches) {
-        if (!useMultiThreading_) {
-            // Single-threaded fallback
-            uploadPatchToGPU(const_cast<TerrainPatch&>(patch));
+    // Gather the patch grid. In streaming mode tiles are generated on the
+    // streamer's own workers and uploaded on this thread, a few per frame.
+    std::vector<const TerrainPatch*> grid;
+    int columns;
+    if (terrainStreamer_) {
+        terrainStreamer_->update(cameraPos_, cameraFront_);
+        grid = terrainStreamer_->getVisibleGrid();
+        columns = terrainStreamer_->getGridColumns();
+    } else {
+        for (const auto& patch : terrainGenerator_->getPatches()) {
+            if (!useMultiThreading_ && !batched) {
+                // Single-threaded fallback
+                uploadPatchToGPU(const_cast<TerrainPatch&>(patch));
+            }
+            grid.push_back(&patch);
         }
-        
-        renderPatch(patch);
-        perfMonitor_->incrementDrawCalls();
-        perfMonitor_->addTriangles(patch.indices.size() / 3);
-        perfMonitor_->addVertices(patch.vertices.size());
+        columns = terrainGenerator_->getPatchesPerRow();
+    }
+    
+    // Render terrain patches, stitching edges where a neighbour is coarser
+    const float pixelScale = TerrainLod::pixelScale(windowHeight_, glm::radians(45.0f));
+    const bool ownPath = tessellated || instanced || heightmap;
+    const bool useBatch = !ownPath && !terrainStreamer_ && terrainBatch_.isUploaded();
+    if (tessellated) {
+        // LOD is picked per cell edge on the GPU
+        const double submitStart = glfwGetTime();
+        renderTessellated(pixelScale);
+        perfMonitor_->addSubmitTime((glfwGetTime() - submitStart) * 1000.0);
+    } else if (!ownPath && !useBatch && commandRecorder_) {
+        renderCommandLists(grid, columns, pixelScale);
+    } else {
+        // In the patches' unscaled space: under the model's uniform scale the
+        // screen-space error only depends on the distance ratio
+        TerrainLod::selectGridLevels(grid, columns, cameraPos_ / globalScale_, pixelScale, lodTolerance_,
+                                     lodLevels_, stitchMasks_);
+        const double submitStart = glfwGetTime();
+        if (instanced) {
+            renderInstanced(grid);
+        } else if (heightmap) {
+            renderHeightmap(grid);
+        } else if (useBatch) {
+            renderBatch(grid);
+        } else {
+            for (size_t i = 0; i < grid.size(); i++) {
+                if (grid[i]) {
+                    renderPatch(*grid[i], lodLevels_[i], stitchMasks_[i]);
+                }
+            }
+        }
+        perfMonitor_->addSubmitTime((glfwGetTime() - submitStart) * 1000.0);
     }
     
+    const GLStateStats stateStats = GLState::takeStats();
+    perfMonitor_->addStateCalls(stateStats.issued, stateStats.filtered);
+    
     // Display performance info
     if (showPerformanceInfo_) {
         // Simple text overlay could be implemented here
@@ -247,6 +521,39 @@ void MultiThreadApp::render() {
     }
 }
 
+void MultiThreadApp::prepareFrame(Shader& shader) {
+    // Through GLState: after the first frame these only cost a comparison
+    GLState::polygonMode(wireframeMode_ ? GL_LINE : GL_FILL);
+    GLState::clearColor(glm::vec4(0.1f, 0.1f, 0.2f, 1.0f));
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    GLState::enable(GL_DEPTH_TEST);
+    GLState::enable(GL_PRIMITIVE_RESTART); // Every indexed draw sets its topology's restart index
+    
+    shader.use();
+    
+    // Matrices, lighting and camera for every program: one buffer update
+    FrameUniforms frame;
+    frame.view = view_;
+    frame.projection = projection_;
+    frame.model = glm::scale(glm::mat4(1.0f), glm::vec3(globalScale_));
+    frame.normalMatrix = FrameUniformBuffer::normalMatrixOf(frame.model);
+    frame.lightPos = glm::vec3(50.0f, 50.0f, 50.0f);
+    frame.time = static_cast<float>(glfwGetTime());
+    frame.lightColor = glm::vec3(1.0f, 1.0f, 1.0f);
+    frame.useLighting = useLighting_ ? 1 : 0;
+    frame.viewPos = cameraPos_;
+    frame.globalScale = globalScale_;
+    frameUniforms_.update(frame);
+    
+    // Per terrain, still set individually (cached locations). The programs
+    // of the other paths get theirs where those draw.
+    if (&shader == &terrainShader_ && terrainGenerator_->getVertexFormat() == VertexFormat::Packed) {
+        shader.setFloat("gridSpacing", terrainGenerator_->getPatchSize());
+        shader.setFloat("gridSize", static_cast<float>(terrainGenerator_->getGridSize()));
+        shader.setFloat("heightScale", terrainGenerator_->getHeightScale());
+    }
+}
+
 void MultiThreadApp::handleInput() {
     if (glfwGetKey(window_, GLFW_KEY_ESCAPE) == GLFW_PRESS) {
         glfwSetWindowShouldClose(window_, true);
@@ -279,6 +586,9 @@ void MultiThreadApp::handleInput() {
     if (glfwGetKey(window_, GLFW_KEY_I) == GLFW_PRESS) {
         useInstancing_ = !useInstancing_;
     }
+    if (glfwGetKey(window_, GLFW_KEY_T) == GLFW_PRESS) {
+        useTessellation_ = !useTessellation_;
+    }
     if (glfwGetKey(window_, GLFW_KEY_M) == GLFW_PRESS) {
         useMultiThreading_ = !useMultiThreading_;
         std::cout << "Multi-threading " << (useMultiThreading_ ? "enabled" : "disabled") << std::endl;
@@ -295,70 +605,242 @@ void MultiThreadApp::handleInput() {
 
 void MultiThreadApp::uploadPatchToGPU(TerrainPatch& patch) {
     if (!patch.isUploaded) {
-        glGenVertexArrays(1, &patch.VAO);
         glGenBuffers(1, &patch.VBO);
-        glGenBuffers(1, &patch.EBO);
+        GLState::bindBuffer(GL_ARRAY_BUFFER, patch.VBO);
+        const double uploadStart = glfwGetTime();
+        glBufferData(GL_ARRAY_BUFFER, patch.gpuVertexBytes(), patch.gpuVertexData(), GL_STATIC_DRAW);
+        perfMonitor_->addUpload(patch.gpuVertexBytes(), (glfwGetTime() - uploadStart) * 1000.0);
         
-        glBindVertexArray(patch.VAO);
-        
-        glBindBuffer(GL_ARRAY_BUFFER, patch.VBO);
-        glBufferData(GL_ARRAY_BUFFER, patch.vertices.size() * sizeof(TerrainVertex), 
-                    patch.vertices.data(), GL_STATIC_DRAW);
-        
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, patch.EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, patch.indices.size() * sizeof(unsigned int),
-                    patch.indices.data(), GL_STATIC_DRAW);
-        
-        // Position attribute
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(TerrainVertex), 
-                            (void*)offsetof(TerrainVertex, position));
-        glEnableVertexAttribArray(0);
-        
-        // Normal attribute
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(TerrainVertex),
-                            (void*)offsetof(TerrainVertex, normal));
-        glEnableVertexAttribArray(1);
-        
-        // Texture coordinate attribute
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(TerrainVertex),
-                            (void*)offsetof(TerrainVertex, texCoord));
-        glEnableVertexAttribArray(2);
-        
-        // Color attribute
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(TerrainVertex),
-                            (void*)offsetof(TerrainVertex, color));
-        glEnableVertexAttribArray(3);
-        
-        if (useInstancing_) {
-            // Setup instanced attributes
-            glVertexAttribDivisor(0, 0); // Per-vertex
-            glVertexAttribDivisor(1, 0); // Per-vertex
-            glVertexAttribDivisor(2, 0); // Per-vertex
-            glVertexAttribDivisor(3, 0); // Per-vertex
-        }
-        
-        glBindVertexArray(0);
-        patch.isUploaded = true;
-        patchesUploaded_++;
-        
-        perfMonitor_->addVBOMemory(patch.vertices.size() * sizeof(TerrainVertex) + 
-                                  patch.indices.size() * sizeof(unsigned int));
+        createPatchVAO(patch, patch.VBO, 0);
     }
 }
 
-void MultiThreadApp::renderPatch(const TerrainPatch& patch) {
+void MultiThreadApp::createPatchVAO(TerrainPatch& patch, GLuint buffer, size_t offset) {
+    glGenVertexArrays(1, &patch.VAO);
+    GLState::bindVertexArray(patch.VAO);
+    GLState::bindBuffer(GL_ARRAY_BUFFER, buffer);
+    
+    // Index buffer shared by every patch of this resolution
+    bool newTopology = false;
+    GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, patch.topology->getElementBuffer(&newTopology));
+    
+    VertexFormats::setupAttributes(patch.vertexFormat(), offset);
+    
+    GLState::bindVertexArray(0);
+    patch.isUploaded = true;
+    patchesUploaded_++;
+    
+    perfMonitor_->addVBOMemory(patch.gpuVertexBytes() + 
+                              (newTopology ? patch.topology->getIndexBytes() : 0));
+}
+
+void MultiThreadApp::renderPatch(const TerrainPatch& patch, int lodLevel, int stitchMask) {
+    const PatchTopology& topology = *patch.topology;
+    const PatchLod& range = patch.lodRange(lodLevel, stitchMask);
+    const GLenum mode = topology.getPrimitiveMode();
+    const GLenum indexType = topology.getIndexType();
+    const void* firstIndex = (void*)(range.firstIndex * topology.getIndexSize());
+    
     if (patch.isUploaded) {
-        glBindVertexArray(patch.VAO);
+        GLState::primitiveRestartIndex(topology.getRestartIndex());
         
-        if (useInstancing_) {
-            // glDrawArraysInstanced(GL_TRIANGLES, 0, 36, instances); // Example
-            glDrawElements(GL_TRIANGLES, patch.indices.size(), GL_UNSIGNED_INT, 0);
-        } else {
-            glDrawElements(GL_TRIANGLES, patch.indices.size(), GL_UNSIGNED_INT, 0);
+        if (patch.vertexFormat() == VertexFormat::Packed) {
+            VertexFormats::setPatchRange(patch.packedRange);
         }
         
-        glBindVertexArray(0);
+        // Left bound: the next patch's bind replaces it
+        GLState::bindVertexArray(patch.VAO);
+        glDrawElements(mode, range.indexCount, indexType, firstIndex);
+    }
+    
+    perfMonitor_->incrementDrawCalls();
+    recordPatchStats(patch, range);
+}
+
+bool MultiThreadApp::uploadTerrainBatch() {
+    if (terrainBatch_.isUploaded()) {
+        return true;
+    }
+    
+    if (!TerrainBatch::isSupported(renderMode_)) {
+        std::cout << "Indirect draws need OpenGL 4.3; using multidraw" << std::endl;
+        renderMode_ = RenderMode::MultiDraw;
     }
+    
+    if (useComputeGeneration_ && !computeGenerator_.isInitialized() && !computeGenerator_.initialize()) {
+        std::cout << "Compute generation unavailable (needs OpenGL 4.3); uploading the vertices" << std::endl;
+        useComputeGeneration_ = false;
+    }
+    
+    bool newTopology = false;
+    const double uploadStart = glfwGetTime();
+    if (!terrainBatch_.upload(*terrainGenerator_, renderMode_, &newTopology,
+                              useComputeGeneration_ ? &computeGenerator_ : nullptr)) {
+        std::cout << "Falling back to per-patch rendering" << std::endl;
+        renderMode_ = RenderMode::PerPatch;
+        return false;
+    }
+    
+    // Generated vertices cost GPU time, not an upload
+    const size_t uploadedBytes = terrainBatch_.isComputeGenerated() ? 0 : terrainBatch_.getVertexBytes();
+    perfMonitor_->addUpload(uploadedBytes, (glfwGetTime() - uploadStart) * 1000.0);
+    perfMonitor_->addVBOMemory(terrainBatch_.getVertexBytes() +
+                              (newTopology ? terrainBatch_.getTopology()->getIndexBytes() : 0));
+    return true;
+}
+
+void MultiThreadApp::renderBatch(const std::vector<const TerrainPatch*>& grid) {
+    for (size_t i = 0; i < grid.size(); i++) {
+        if (grid[i]) {
+            terrainBatch_.add(*grid[i], lodLevels_[i], stitchMasks_[i]);
+            recordPatchStats(*grid[i], grid[i]->lodRange(lodLevels_[i], stitchMasks_[i]));
+        }
+    }
+    
+    const PatchTopology& topology = *terrainBatch_.getTopology();
+    GLState::primitiveRestartIndex(topology.getRestartIndex());
+    perfMonitor_->incrementDrawCalls(terrainBatch_.flush());
+}
+
+bool MultiThreadApp::uploadInstancedTerrain() {
+    if (instancedTerrain_.isUploaded()) {
+        return true;
+    }
+    
+    bool newTopology = false;
+    const double uploadStart = glfwGetTime();
+    if (!instancedShader_.isValid() || !instancedTerrain_.upload(*terrainGenerator_, &newTopology)) {
+        std::cout << "Instancing unavailable; falling back to " << TerrainBatch::name(renderMode_) << " rendering" << std::endl;
+        useInstancing_ = false;
+        return false;
+    }
+    const size_t bytes = instancedTerrain_.getVertexBytes() + instancedTerrain_.getTextureBytes();
+    perfMonitor_->addUpload(bytes, (glfwGetTime() - uploadStart) * 1000.0);
+    perfMonitor_->addVBOMemory(instancedTerrain_.getVertexBytes() +
+                              (newTopology ? instancedTerrain_.getTopology()->getIndexBytes() : 0));
+    perfMonitor_->addTextureMemory(instancedTerrain_.getTextureBytes());
+    return true;
+}
+
+void MultiThreadApp::renderInstanced(const std::vector<const TerrainPatch*>& grid) {
+    instancedShader_.setFloat("gridSize", static_cast<float>(terrainGenerator_->getGridSize()));
+    instancedShader_.setFloat("heightScale", terrainGenerator_->getHeightScale());
+    
+    for (size_t i = 0; i < grid.size(); i++) {
+        if (grid[i]) {
+            instancedTerrain_.add(*grid[i], lodLevels_[i], stitchMasks_[i]);
+            recordPatchStats(*grid[i], grid[i]->lodRange(lodLevels_[i], stitchMasks_[i]));
+        }
+    }
+    
+    const PatchTopology& topology = *instancedTerrain_.getTopology();
+    GLState::primitiveRestartIndex(topology.getRestartIndex());
+    perfMonitor_->incrementDrawCalls(instancedTerrain_.flush());
+}
+
+bool MultiThreadApp::uploadHeightmapTerrain() {
+    if (heightmapTerrain_.isUploaded()) {
+        return true;
+    }
+    
+    bool newTopology = false;
+    const double uploadStart = glfwGetTime();
+    if (!heightmapShader_.isValid() || !heightmapTerrain_.upload(*terrainGenerator_, true, &newTopology)) {
+        std::cout << "Heightmap terrain unavailable; falling back to per-patch rendering" << std::endl;
+        renderMode_ = RenderMode::PerPatch;
+        return false;
+    }
+    const size_t bytes = heightmapTerrain_.getVertexBytes() + heightmapTerrain_.getTextureBytes();
+    perfMonitor_->addUpload(bytes, (glfwGetTime() - uploadStart) * 1000.0);
+    perfMonitor_->addVBOMemory(heightmapTerrain_.getVertexBytes() +
+                              (newTopology ? heightmapTerrain_.getTopology()->getIndexBytes() : 0));
+    perfMonitor_->addTextureMemory(heightmapTerrain_.getTextureBytes());
+    return true;
+}
+
+void MultiThreadApp::renderHeightmap(const std::vector<const TerrainPatch*>& grid) {
+    heightmapShader_.setFloat("gridSpacing", terrainGenerator_->getPatchSize());
+    heightmapShader_.setFloat("gridSize", static_cast<float>(terrainGenerator_->getGridSize()));
+    heightmapShader_.setFloat("heightScale", terrainGenerator_->getHeightScale());
+    heightmapShader_.setVec2("heightRange", heightmapTerrain_.getHeightRange());
+    
+    for (size_t i = 0; i < grid.size(); i++) {
+        if (grid[i]) {
+            heightmapTerrain_.add(*grid[i], lodLevels_[i], stitchMasks_[i]);
+            recordPatchStats(*grid[i], grid[i]->lodRange(lodLevels_[i], stitchMasks_[i]));
+        }
+    }
+    
+    const PatchTopology& topology = *heightmapTerrain_.getTopology();
+    GLState::primitiveRestartIndex(topology.getRestartIndex());
+    perfMonitor_->incrementDrawCalls(heightmapTerrain_.flush());
+}
+
+bool MultiThreadApp::uploadTessellatedTerrain() {
+    if (tessellatedTerrain_.isUploaded()) {
+        return true;
+    }
+    
+    const double uploadStart = glfwGetTime();
+    if (!tessellatedShader_.isValid() || !tessellatedTerrain_.upload(*terrainGenerator_)) {
+        std::cout << "Tessellation unavailable (needs OpenGL 4.0); falling back to " << TerrainBatch::name(renderMode_)
+                  << " rendering" << std::endl;
+        useTessellation_ = false;
+        return false;
+    }
+    const size_t bytes = tessellatedTerrain_.getVertexBytes() + tessellatedTerrain_.getTextureBytes();
+    perfMonitor_->addUpload(bytes, (glfwGetTime() - uploadStart) * 1000.0);
+    perfMonitor_->addVBOMemory(tessellatedTerrain_.getVertexBytes());
+    perfMonitor_->addTextureMemory(tessellatedTerrain_.getTextureBytes());
+    return true;
+}
+
+void MultiThreadApp::renderTessellated(float pixelScale) {
+    tessellatedShader_.setFloat("gridSpacing", terrainGenerator_->getPatchSize());
+    tessellatedShader_.setFloat("gridSize", static_cast<float>(terrainGenerator_->getGridSize()));
+    tessellatedShader_.setFloat("heightScale", terrainGenerator_->getHeightScale());
+    tessellatedShader_.setVec2("heightRange", tessellatedTerrain_.getHeightRange());
+    tessellatedShader_.setFloat("pixelScale", pixelScale);
+    tessellatedShader_.setFloat("edgePixels", tessellationEdgePixels_);
+    perfMonitor_->incrementDrawCalls(tessellatedTerrain_.draw());
+}
+
+void MultiThreadApp::renderCommandLists(const std::vector<const TerrainPatch*>& grid, int columns, float pixelScale, bool cull) {
+    RecordView view;
+    view.viewProjection = projection_ * view_;
+    view.cameraPos = cameraPos_;
+    view.scale = globalScale_;
+    view.pixelScale = pixelScale;
+    view.lodTolerance = lodTolerance_;
+    view.cull = cull;
+    
+    // LOD selection, culling, sorting and recording on the workers...
+    const double recordStart = glfwGetTime();
+    commandRecorder_->record(grid, columns, view);
+    perfMonitor_->addRecordTime((glfwGetTime() - recordStart) * 1000.0);
+    
+    // ...leave this thread one loop over plain records
+    const double submitStart = glfwGetTime();
+    commandRecorder_->replay();
+    perfMonitor_->addSubmitTime((glfwGetTime() - submitStart) * 1000.0);
+    
+    const CommandListStats stats = commandRecorder_->getStats();
+    perfMonitor_->incrementDrawCalls(stats.drawCalls);
+    perfMonitor_->addTriangles(stats.triangles);
+    perfMonitor_->addVertices(stats.vertices);
+    perfMonitor_->addFullDetailTriangles(static_cast<int>(stats.fullDetailTriangles));
+    perfMonitor_->addVertexTransforms(static_cast<int>(stats.vertexTransforms));
+    perfMonitor_->addIndexFetch(static_cast<size_t>(stats.indexBytes), static_cast<size_t>(stats.listIndexBytes));
+    perfMonitor_->addCulledPatches(stats.culledPatches);
+}
+
+void MultiThreadApp::recordPatchStats(const TerrainPatch& patch, const PatchLod& range) {
+    const PatchTopology& topology = *patch.topology;
+    perfMonitor_->addTriangles(range.triangleCount);
+    perfMonitor_->addVertexTransforms(range.vertexTransforms);
+    perfMonitor_->addIndexFetch(range.indexCount * topology.getIndexSize(), range.triangleCount * 3 * sizeof(unsigned int));
+    perfMonitor_->addFullDetailTriangles(patch.fullDetailTriangleCount());
+    perfMonitor_->addVertices(patch.vertexCount());
 }
 
 void MultiThreadApp::setupMatrices() {
@@ -371,13 +853,15 @@ void MultiThreadApp::setupMatrices() {
 void MultiThreadApp::submitPatchUploadWork() {
     std::cout << "Submitting " << totalPatches_ << " patches to render thread..." << std::endl;
     
+    // Into one buffer laid out like the vertex arena
     const auto& patches = terrainGenerator_->getPatches();
+    patchUploadsSubmitted_ = true;
+    if (!renderThread_->setUploadTarget(terrainGenerator_->getVertexMemory())) {
+        return;
+    }
     for (size_t i = 0; i < patches.size(); ++i) {
-        renderThread_->submitPatchUpload(i, 
-                                    (void*)patches[i].vertices.data(), 
-                                    patches[i].vertices.size() * sizeof(TerrainVertex),
-                                    (void*)patches[i].indices.data(),
-                                    patches[i].indices.size() * sizeof(unsigned int));
+        const size_t offset = patches[i].firstVertex * VertexFormats::stride(patches[i].vertexFormat());
+        renderThread_->submitPatchUpload(i, patches[i].gpuVertexData(), patches[i].gpuVertexBytes(), offset);
     }
     
     std::cout << "All patch upload tasks submitted!" << std::endl;
@@ -389,7 +873,35 @@ void MultiThreadApp::waitForRenderThread() {
     }
 }
 
+void MultiThreadApp::collectPatchUploads() {
+    if (!renderThread_) {
+        return;
+    }
+    
+    // The render thread only fills its buffer; VAOs belong to this context.
+    // The patch keeps no VBO of its own: the render thread owns the buffer.
+    completedUploads_.clear();
+    renderThread_->collectUploads(completedUploads_);
+    const auto& patches = terrainGenerator_->getPatches();
+    for (const auto& upload : completedUploads_) {
+        if (upload.patchId >= static_cast<int>(patches.size()) || patches[upload.patchId].isUploaded) {
+            continue;   // Uploaded here meanwhile
+        }
+        createPatchVAO(const_cast<TerrainPatch&>(patches[upload.patchId]), upload.buffer, upload.offset);
+    }
+}
+
 void MultiThreadApp::cleanup() {
+    terrainStreamer_.reset();
+    terrainBatch_.release();
+    instancedTerrain_.release();
+    heightmapTerrain_.release();
+    tessellatedTerrain_.release();
+    computeGenerator_.release();
+    frameUniforms_.release();
+    offscreenTarget_.release();
+    shaderCompiler_.shutdown();
+    
     if (renderThread_) {
         renderThread_->stop();
     }
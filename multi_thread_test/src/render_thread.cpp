@@ -2,19 +2,20 @@
 #include <iostream>
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
+#include <chrono>
 #include <cstring>
-#include "../../shared/include/terrain_generator.h"
 
 RenderThread::RenderThread()
     : workerContext_(nullptr), contextInitialized_(false),
-      isRunning_(false), shouldStop_(false), processedTasks_(0) {
+      isRunning_(false), shouldStop_(false), inFlightTasks_(0), consumedEnd_(0), targetBytes_(0), targetBuffer_(0),
+      processedTasks_(0) {
 }
 
 RenderThread::~RenderThread() {
     stop();
 }
 
-bool RenderThread::initialize(GLFWwindow* sharedContext) {
+bool RenderThread::initialize(GLFWwindow* sharedContext, size_t ringBytes) {
     if (isRunning_) {
         std::cerr << "Render thread is already running!" << std::endl;
         return false;
@@ -29,6 +30,17 @@ bool RenderThread::initialize(GLFWwindow* sharedContext) {
         return false;
     }
     
+    // Created on the calling thread; the buffer and its mapping are shared
+    // with the worker context
+    if (ringBytes > 0) {
+        if (!UploadRing::isSupported()) {
+            std::cout << "Upload ring needs OpenGL 4.4; uploading with glBufferData" << std::endl;
+        } else if (uploadRing_.create(ringBytes)) {
+            consumedEnd_ = 0;
+            std::cout << "Upload ring: " << ringBytes / (1024 * 1024) << " MB, persistently mapped" << std::endl;
+        }
+    }
+    
     std::cout << "Render thread initialized successfully!" << std::endl;
     return true;
 }
@@ -55,10 +67,11 @@ void RenderThread::stop() {
     
     shouldStop_ = true;
     
-    // Notify the thread to wake up
+    // Notify the thread to wake up, and anyone waiting for tasks it drops
     {
         std::lock_guard<std::mutex> lock(queueMutex_);
         queueCondition_.notify_one();
+        completionCondition_.notify_all();
     }
     
     // Wait for thread to finish
@@ -72,6 +85,20 @@ void RenderThread::stop() {
         workerContext_ = nullptr;
     }
     
+    // Uploads nobody collected. VAOs built on the target keep its storage
+    // alive until they are deleted.
+    {
+        std::lock_guard<std::mutex> lock(completedMutex_);
+        for (GLsync fence : completedFences_) {
+            glDeleteSync(fence);
+        }
+        completedUploads_.clear();
+        completedFences_.clear();
+    }
+    uploadRing_.destroy();
+    glDeleteBuffers(1, &targetBuffer_);
+    targetBuffer_ = 0;
+    
     isRunning_ = false;
     std::cout << "Render thread stopped. Processed " << processedTasks_.load() << " tasks." << std::endl;
 }
@@ -80,37 +107,65 @@ void RenderThread::submitTask(const RenderTask& task) {
     {
         std::lock_guard<std::mutex> lock(queueMutex_);
         taskQueue_.push(task);
+        inFlightTasks_++;
     }
     queueCondition_.notify_one();
 }
 
-void RenderThread::submitPatchUpload(int patchId, void* vertexData, size_t vertexSize,
-                                    void* indexData, size_t indexSize) {
+bool RenderThread::setUploadTarget(size_t targetBytes) {
+    std::lock_guard<std::mutex> lock(queueMutex_);
+    if (targetBytes_ != 0 && targetBytes > targetBytes_) {
+        std::cerr << "Upload target is already " << targetBytes_ << " bytes; cannot grow it to "
+                  << targetBytes << std::endl;
+        return false;
+    }
+    if (targetBytes_ == 0) {
+        targetBytes_ = targetBytes;
+    }
+    return true;
+}
+
+void RenderThread::submitPatchUpload(int patchId, const void* vertexData, size_t vertexSize, size_t targetOffset) {
+    RenderTask task(RenderTask::UPLOAD_PATCH, patchId);
+    task.vertexData = vertexData;
+    task.vertexSize = vertexSize;
+    task.targetOffset = targetOffset;
+    
+    // The worker consumes ring regions in queue order, so allocating and
+    // queueing must not interleave between producers
+    std::lock_guard<std::mutex> lock(submitMutex_);
+    if (uploadRing_.allocate(vertexSize, task.region)) {
+        std::memcpy(task.region.data, vertexData, vertexSize);
+        task.staged = true;
+    }
+    submitTask(task);
+}
+
+void RenderThread::collectUploads(std::vector<CompletedUpload>& uploads) {
+    std::vector<GLsync> fences;
     {
-        std::lock_guard<std::mutex> lock(queueMutex_);
-        RenderTask task(RenderTask::UPLOAD_PATCH, patchId);
-        
-        // Copy vertex data
-        task.vertexData.resize(vertexSize / sizeof(float));
-        std::memcpy(task.vertexData.data(), vertexData, vertexSize);
-        
-        // Copy index data
-        task.indexData.resize(indexSize / sizeof(unsigned int));
-        std::memcpy(task.indexData.data(), indexData, indexSize);
-        
-        taskQueue_.push(std::move(task));
+        std::lock_guard<std::mutex> lock(completedMutex_);
+        uploads.insert(uploads.end(), completedUploads_.begin(), completedUploads_.end());
+        completedUploads_.clear();
+        fences.swap(completedFences_);
+    }
+    
+    // A server-side wait: orders this context's draws after the worker's
+    // copies without blocking the CPU
+    for (GLsync fence : fences) {
+        glWaitSync(fence, 0, GL_TIMEOUT_IGNORED);
+        glDeleteSync(fence);
     }
-    queueCondition_.notify_one();
 }
 
 void RenderThread::waitForCompletion() {
-    std::unique_lock<std::mutex> lock(completionMutex_);
-    completionCondition_.wait(lock, [this] { return taskQueue_.empty(); });
+    std::unique_lock<std::mutex> lock(queueMutex_);
+    completionCondition_.wait(lock, [this] { return inFlightTasks_ == 0 || shouldStop_; });
 }
 
 bool RenderThread::hasPendingTasks() const {
     std::lock_guard<std::mutex> lock(queueMutex_);
-    return !taskQueue_.empty();
+    return inFlightTasks_ > 0;
 }
 
 size_t RenderThread::getQueueSize() const {
@@ -140,10 +195,17 @@ void RenderThread::threadFunction() {
     while (!shouldStop_) {
         std::unique_lock<std::mutex> lock(queueMutex_);
         
-        // Wait for tasks or stop signal
-        queueCondition_.wait(lock, [this] { return !taskQueue_.empty() || shouldStop_; });
+        // Wait for tasks or stop signal. While ring space is fenced, wake up
+        // now and then to release it.
+        auto hasWork = [this] { return !taskQueue_.empty() || shouldStop_; };
+        if (uploadRing_.hasFences()) {
+            queueCondition_.wait_for(lock, std::chrono::milliseconds(1), hasWork);
+        } else {
+            queueCondition_.wait(lock, hasWork);
+        }
         
         // Process all available tasks
+        size_t batchTasks = 0;
         while (!taskQueue_.empty() && !shouldStop_) {
             RenderTask task = taskQueue_.front();
             taskQueue_.pop();
@@ -152,30 +214,34 @@ void RenderThread::threadFunction() {
             // Process the task
             processTask(task);
             processedTasks_++;
+            batchTasks++;
             
             lock.lock();
         }
         
-        // Notify that we've completed all tasks
-        if (taskQueue_.empty()) {
-            lock.unlock();
-            {
-                std::lock_guard<std::mutex> completionLock(completionMutex_);
-                completionCondition_.notify_all();
-            }
+        // Fence the batch, then free what earlier batches read, waiting if a
+        // producer is stalled on a full ring
+        lock.unlock();
+        finishUploads();
+        uploadRing_.retire(uploadRing_.hasWaiters());
+        lock.lock();
+        
+        // The batch only counts as done once its uploads are fenced
+        inFlightTasks_ -= batchTasks;
+        if (inFlightTasks_ == 0) {
+            completionCondition_.notify_all();
         }
     }
     
     // Clean up
+    finishUploads();
     glfwMakeContextCurrent(nullptr);
 }
 
 void RenderThread::processTask(const RenderTask& task) {
     switch (task.type) {
         case RenderTask::UPLOAD_PATCH:
-            uploadPatchData(task.patchId, 
-                              task.vertexData.data(), task.vertexData.size() * sizeof(float),
-                              task.indexData.data(), task.indexData.size() * sizeof(unsigned int));
+            uploadPatchData(task);
             break;
             
         case RenderTask::UPDATE_BUFFER:
@@ -196,53 +262,63 @@ void RenderThread::processTask(const RenderTask& task) {
     }
 }
 
-void RenderThread::uploadPatchData(int patchId, const void* vertexData, size_t vertexSize,
-                                const void* indexData, size_t indexSize) {
-    // Actually upload vertex/index data to GPU
-    
-    // Convert byte sizes to vertex/index counts
-    size_t vertexCount = vertexSize / sizeof(TerrainVertex);
-    size_t indexCount = indexSize / sizeof(unsigned int);
-    
-    std::cout << "Worker thread: Uploading patch " << patchId << " data (" 
-              << vertexCount << " vertices, " << indexCount << " indices)" << std::endl;
-    
-    // Create GPU resources for this patch
-    GLuint VAO, VBO, EBO;
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-    glGenBuffers(1, &EBO);
-    
-    glBindVertexArray(VAO);
-    
-    // Upload vertex data (vertexSize is already in bytes)
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, vertexSize, vertexData, GL_STATIC_DRAW);
-    
-    // Upload index data (indexSize is already in bytes)
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexSize, indexData, GL_STATIC_DRAW);
-    
-    // Set up vertex attributes
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(TerrainVertex), 
-                        (void*)offsetof(TerrainVertex, position));
-    glEnableVertexAttribArray(0);
+void RenderThread::uploadPatchData(const RenderTask& task) {
+    if (task.targetOffset + task.vertexSize > targetBytes_) {
+        std::cerr << "Patch " << task.patchId << " upload lies outside the upload target" << std::endl;
+        if (task.staged) {
+            consumedEnd_ = task.region.end;
+        }
+        return;
+    }
     
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(TerrainVertex),
-                        (void*)offsetof(TerrainVertex, normal));
-    glEnableVertexAttribArray(1);
+    // Only the buffer: VAOs are not shared between contexts, so the main
+    // thread builds the patch's VAO once it collects the upload
+    if (targetBuffer_ == 0) {
+        // Allocated once for all patches, so uploads never make the driver
+        // allocate. With the ring it is immutable GPU-only storage.
+        glGenBuffers(1, &targetBuffer_);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, targetBuffer_);
+        if (uploadRing_.isCreated()) {
+            glBufferStorage(GL_COPY_WRITE_BUFFER, targetBytes_, nullptr, 0);
+        } else {
+            glBufferData(GL_COPY_WRITE_BUFFER, targetBytes_, nullptr, GL_STATIC_DRAW);
+        }
+    } else {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, targetBuffer_);
+    }
     
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(TerrainVertex),
-                        (void*)offsetof(TerrainVertex, texCoord));
-    glEnableVertexAttribArray(2);
+    if (task.staged) {
+        // A GPU-side copy out of the ring: no client memory for the driver
+        // to copy or stage
+        glBindBuffer(GL_COPY_READ_BUFFER, uploadRing_.getBuffer());
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, task.region.offset, task.targetOffset,
+                            task.vertexSize);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        consumedEnd_ = task.region.end;
+    } else {
+        glBufferSubData(GL_COPY_WRITE_BUFFER, task.targetOffset, task.vertexSize, task.vertexData);
+    }
     
-    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(TerrainVertex),
-                        (void*)offsetof(TerrainVertex, color));
-    glEnableVertexAttribArray(3);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    pendingUploads_.push_back({task.patchId, targetBuffer_, task.targetOffset, task.vertexSize});
+}
+
+void RenderThread::finishUploads() {
+    if (pendingUploads_.empty()) {
+        return;
+    }
     
-    // Store the patch data (in a real implementation, this would be more sophisticated)
-    // For now, we'll just complete the upload
-    glBindVertexArray(0);
+    // One fence for the main context to wait on before drawing from the
+    // buffers, one (which also flushes both) for reusing the ring space
+    GLsync ready = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    if (uploadRing_.isCreated()) {
+        uploadRing_.fence(consumedEnd_);
+    } else {
+        glFlush();
+    }
     
-    std::cout << "Worker thread: Patch " << patchId << " upload completed!" << std::endl;
-}
\ No newline at end of file
+    std::lock_guard<std::mutex> lock(completedMutex_);
+    completedUploads_.insert(completedUploads_.end(), pendingUploads_.begin(), pendingUploads_.end());
+    completedFences_.push_back(ready);
+    pendingUploads_.clear();
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstddef>
+
+// Process-wide heap allocation counters. Counting replaces the global
+// operator new/delete, so it is only compiled in with -DTRACK_ALLOCATIONS=ON;
+// otherwise isEnabled() is false and the counters stay zero.
+class AllocationTracker {
+public:
+    struct Counters {
+        size_t allocations = 0;
+        size_t bytes = 0;
+    };
+    
+    static bool isEnabled();
+    static Counters current();
+    
+    // Allocations made since start was taken
+    static Counters since(const Counters& start);
+};
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <fstream>
+#include <string>
+
+// Writes a file through a temporary next to it (path + ".tmp") that only
+// replaces path once it is complete, in one step: a crash never leaves a
+// truncated file behind, and readers see the old contents or the new ones,
+// never a missing file. Destroying the writer without commit() discards the
+// temporary.
+class AtomicFileWriter {
+public:
+    explicit AtomicFileWriter(const std::string& path);
+    ~AtomicFileWriter();
+    
+    AtomicFileWriter(const AtomicFileWriter&) = delete;
+    AtomicFileWriter& operator=(const AtomicFileWriter&) = delete;
+    
+    bool isOpen() const { return out_.is_open(); }
+    std::ofstream& stream() { return out_; }
+    
+    // Closes the temporary and moves it over path; false (path untouched)
+    // if a write failed or the move did
+    bool commit();
+
+private:
+    std::string path_;
+    std::string tempPath_;
+    std::ofstream out_;
+    bool committed_ = false;
+};
@@ -0,0 +1,75 @@
+#pragma once
+
+// GLEW must be included before any other OpenGL headers
+#include <GL/glew.h>
+
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+#include <glm/glm.hpp>
+
+enum class RenderCommandType : uint8_t {
+    BindVertexArray,        // object = VAO
+    PrimitiveRestartIndex,  // object = restart index
+    PatchRange,             // values = VertexFormats::patchRange() of the next draws
+    DrawElements            // mode, indexType, count, offset
+};
+
+// One recorded step of a frame. Plain values only: building a list calls no
+// GL function and touches no GL object, so any thread can record one; only
+// CommandList::replay() needs the context.
+struct RenderCommand {
+    RenderCommandType type;
+    GLenum mode;
+    GLenum indexType;
+    GLuint object;
+    GLsizei count;
+    uint64_t offset;        // Byte offset into the element buffer
+    glm::vec4 values;
+};
+static_assert(std::is_trivially_copyable<RenderCommand>::value, "RenderCommand must stay plain data");
+
+// What a list's draws cost, totalled while recording since PerformanceMonitor
+// belongs to the GL thread
+struct CommandListStats {
+    int drawCalls = 0;
+    int triangles = 0;
+    int vertices = 0;
+    long long fullDetailTriangles = 0;
+    long long vertexTransforms = 0;
+    long long indexBytes = 0;
+    long long listIndexBytes = 0;
+    int culledPatches = 0;
+    
+    void add(const CommandListStats& other);
+};
+
+// A recorded sequence of binds, per-draw values and draws. Recording drops a
+// bind or restart index equal to the list's previous one; replay() passes the
+// rest through GLState, which also filters across lists.
+class CommandList {
+public:
+    void clear();
+    
+    void bindVertexArray(GLuint vao);
+    void primitiveRestartIndex(GLuint index);
+    void patchRange(const glm::vec4& range);
+    void drawElements(GLenum mode, GLsizei count, GLenum indexType, uint64_t offset);
+    
+    // GL thread only
+    void replay() const;
+    
+    const std::vector<RenderCommand>& getCommands() const { return commands_; }
+    CommandListStats& getStats() { return stats_; }
+    const CommandListStats& getStats() const { return stats_; }
+    size_t size() const { return commands_.size(); }
+    bool empty() const { return commands_.empty(); }
+
+private:
+    RenderCommand& append(RenderCommandType type);
+    
+    std::vector<RenderCommand> commands_;   // Capacity is kept across clear()
+    CommandListStats stats_;
+    GLuint lastVertexArray_ = ~0u;
+    GLuint lastRestartIndex_ = ~0u;
+};
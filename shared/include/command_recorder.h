@@ -0,0 +1,86 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "command_list.h"
+#include "terrain_generator.h"
+
+// Camera and settings a frame is recorded with
+struct RecordView {
+    glm::mat4 viewProjection = glm::mat4(1.0f);
+    glm::vec3 cameraPos = glm::vec3(0.0f);  // World space, like the scaled patches
+    float scale = 1.0f;             // Uniform model scale applied to the patch bounds
+    float pixelScale = 1.0f;        // TerrainLod::pixelScale()
+    float lodTolerance = 0.0f;      // 0 = full detail
+    bool cull = true;               // Skip patches outside the view frustum
+};
+
+// Records a patch grid's per-patch draws on several threads. The grid is split
+// into one contiguous range per thread and each range gets its own
+// CommandList, so workers never share output. A frame runs in two parallel
+// passes with a short serial step between them:
+//
+//  1. Each range picks its cells' LOD levels and frustum-culls them.
+//  2. (Calling thread) Levels are constrained across range borders and the
+//     stitch masks computed, as TerrainLod::selectGridLevels() does.
+//  3. Each range sorts its visible patches front to back and records their
+//     restart index, patch range and draw, totalling the draw statistics.
+//
+// The workers are started once and reused; the calling thread takes a range
+// too. replay() then plays the lists in range order on the GL thread.
+class CommandRecorder {
+public:
+    explicit CommandRecorder(int threads); // Including the calling thread; 0 = one per core
+    ~CommandRecorder();
+    
+    CommandRecorder(const CommandRecorder&) = delete;
+    CommandRecorder& operator=(const CommandRecorder&) = delete;
+    
+    // Patches that are not uploaded yet are counted but not drawn
+    void record(const std::vector<const TerrainPatch*>& grid, int columns, const RecordView& view);
+    
+    // GL thread only; the lists stay valid until the next record()
+    void replay() const;
+    
+    // Totals of the last record()
+    CommandListStats getStats() const;
+    size_t getCommandCount() const;
+    const std::vector<int>& getLevels() const { return levels_; }  // Per grid cell, after constraining
+    int getThreadCount() const { return static_cast<int>(lists_.size()); }
+
+private:
+    enum class Pass { Select, Record };
+    
+    void workerLoop();
+    void runPass(Pass pass);
+    void runRanges(Pass pass);
+    void selectRange(int range);
+    void recordRange(int range);
+    bool isVisible(const TerrainPatch& patch) const;
+    
+    std::vector<CommandList> lists_;    // One per range
+    
+    // The frame being recorded; written by record() between passes
+    const std::vector<const TerrainPatch*>* grid_;
+    RecordView view_;
+    glm::vec4 frustumPlanes_[6];
+    std::vector<int> levels_;
+    std::vector<int> stitchMasks_;
+    std::vector<unsigned char> visible_;
+    std::vector<std::vector<std::pair<float, int>>> order_; // Per range: (distance, cell), reused
+    
+    // Pass dispatch
+    std::mutex mutex_;
+    std::condition_variable startCondition_;
+    std::condition_variable doneCondition_;
+    Pass pass_;
+    uint64_t passIndex_;
+    int busyWorkers_;
+    std::atomic<int> nextRange_;
+    bool stopping_;
+    
+    std::vector<std::thread> workers_;
+};
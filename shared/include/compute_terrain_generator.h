@@ -0,0 +1,63 @@
+#pragma once
+
+// GLEW must be included before any other OpenGL headers
+#include <GL/glew.h>
+
+#include "gl_utils.h"
+#include "terrain_generator.h"
+
+// Generates a terrain's vertices on the GPU instead of uploading them: a
+// compute shader (shaders/terrain_generate.comp) evaluates the heightfield
+// with the generator's noise and then writes every patch's VertexFormat::Float
+// vertices, normals and colors included, straight into a vertex buffer. The
+// layout is that of TerrainGenerator::getVertexArenaData(), so the buffer can
+// stand in for an uploaded copy of the arena (see TerrainBatch::upload()).
+// Results match the CPU generator to within float rounding.
+//
+// Only the generator's configuration is read; its patches need not exist.
+// Needs OpenGL 4.3 (or ARB_compute_shader and
+// ARB_shader_storage_buffer_object). GL thread only.
+class ComputeTerrainGenerator {
+public:
+    static constexpr const char* COMPUTE_SHADER = "shaders/terrain_generate.comp";
+    
+    static bool isSupported();
+    
+    // Bytes generate() writes for the generator's configuration
+    static size_t getVertexBytes(const TerrainGenerator& generator);
+    
+    ComputeTerrainGenerator() = default;
+    ~ComputeTerrainGenerator();
+    
+    ComputeTerrainGenerator(const ComputeTerrainGenerator&) = delete;
+    ComputeTerrainGenerator& operator=(const ComputeTerrainGenerator&) = delete;
+    
+    // Compiles the program; fails without compute shader support
+    bool initialize();
+    void release();
+    bool isInitialized() const { return shader_.isValid(); }
+    
+    // Fills the first getVertexBytes() bytes of vertexBuffer, which must be
+    // at least that large. Fails (writing nothing) if the heightfield or a
+    // single patch exceeds GL_MAX_SHADER_STORAGE_BLOCK_SIZE. The vertices are
+    // visible to vertex fetches and buffer reads that follow. The program
+    // bound on entry is bound again on return.
+    bool generate(const TerrainGenerator& generator, GLuint vertexBuffer);
+    
+    size_t getScratchBytes() const { return scratchBytes_; }   // Heightfield kept between calls
+
+private:
+    // Resizes buffer to at least bytes, leaving its contents undefined
+    void reserve(GLuint& buffer, size_t& capacity, size_t bytes);
+    
+    Shader shader_;
+    GLuint heightBuffer_ = 0;
+    GLuint slopeXBuffer_ = 0;       // Analytic normals only
+    GLuint slopeZBuffer_ = 0;
+    GLuint permutationBuffer_ = 0;
+    GLuint slotBuffer_ = 0;
+    size_t heightCapacity_ = 0;
+    size_t slopeXCapacity_ = 0;
+    size_t slopeZCapacity_ = 0;
+    size_t scratchBytes_ = 0;
+};
\ No newline at end of file
@@ -0,0 +1,53 @@
+#pragma once
+
+// GLEW must be included before any other OpenGL headers
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+// Per-frame shader inputs, laid out as the FrameData uniform block (std140)
+// every terrain shader declares. Members are ordered so that no std140
+// padding is needed: each vec3 shares its 16 bytes with the scalar after it.
+struct FrameUniforms {
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::mat4 model;
+    glm::mat4 normalMatrix;     // Upper 3x3 of transpose(inverse(model)), see normalMatrixOf()
+    glm::vec3 lightPos;
+    float time;
+    glm::vec3 lightColor;
+    int useLighting;            // bool in the block
+    glm::vec3 viewPos;
+    float globalScale;          // Instanced shaders only
+};
+static_assert(sizeof(FrameUniforms) == 304, "FrameUniforms must match the std140 FrameData block");
+
+// The uniform buffer behind FrameData. Programs are linked to it once with
+// Shader::bindUniformBlock(BLOCK_NAME, BINDING); after that a frame's data is
+// one update() for all of them instead of a glUniform* per value and program.
+class FrameUniformBuffer {
+public:
+    static constexpr const char* BLOCK_NAME = "FrameData";
+    static constexpr GLuint BINDING = 0;
+    
+    // Normals transform with the inverse transpose; only the rotation and
+    // scale part matters
+    static glm::mat4 normalMatrixOf(const glm::mat4& model);
+    
+    FrameUniformBuffer() = default;
+    ~FrameUniformBuffer();
+    
+    FrameUniformBuffer(const FrameUniformBuffer&) = delete;
+    FrameUniformBuffer& operator=(const FrameUniformBuffer&) = delete;
+    
+    // Creates the buffer and binds it to BINDING (context state, so once)
+    void create();
+    void release();
+    
+    void update(const FrameUniforms& uniforms);
+    
+    bool isCreated() const { return buffer_ != 0; }
+
+private:
+    GLuint buffer_ = 0;
+};
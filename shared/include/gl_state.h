@@ -0,0 +1,47 @@
+#pragma once
+
+// GLEW must be included before any other OpenGL headers
+#include <GL/glew.h>
+
+#include <cstddef>
+#include <glm/glm.hpp>
+
+struct GLStateStats {
+    size_t issued = 0;      // Calls passed on to GL
+    size_t filtered = 0;    // Calls dropped because they would not change anything
+};
+
+// Shadow copy of the state the render loops set (program, VAO, buffer
+// bindings, enables, polygon mode, depth and clear state), so that setting
+// a value that is already current never reaches the driver. Code drawing
+// through this class can bind what it needs and leave it bound.
+//
+// State is kept per thread, i.e. for the context current on it. Everything
+// starts unknown, so the first call for each value is always issued; call
+// invalidate() after making another context current or after changing any
+// of this state with plain GL calls. GL_ELEMENT_ARRAY_BUFFER is part of the
+// bound VAO and always passed through.
+class GLState {
+public:
+    static void useProgram(GLuint program);
+    static void bindVertexArray(GLuint vao);
+    static void bindBuffer(GLenum target, GLuint buffer);
+    static void enable(GLenum capability);
+    static void disable(GLenum capability);
+    static void polygonMode(GLenum mode);   // For GL_FRONT_AND_BACK
+    static void depthFunc(GLenum func);
+    static void depthMask(bool write);
+    static void clearColor(const glm::vec4& color);
+    static void primitiveRestartIndex(GLuint index);
+    
+    // Deleting a bound object unbinds it; these keep the shadow in step
+    static void deleteProgram(GLuint program);
+    static void deleteVertexArray(GLuint vao);
+    static void deleteBuffer(GLuint buffer);
+    
+    static void invalidate();
+    
+    // Counters of this thread since the last takeStats()
+    static GLStateStats getStats();
+    static GLStateStats takeStats();
+};
@@ -3,35 +3,72 @@
 // GLEW must be included before any other OpenGL headers
 #include <GL/glew.h>
 
+#include <functional>
+#include <map>
 #include <string>
 #include <vector>
 #include <glm/glm.hpp>
+#include "shader_compiler.h"
 
 
 struct Shader {
-    GLuint program = 0;
+    using ReadyCallback = std::function<void(const Shader&)>;
+    
+    // Filled in when an asynchronous build is first waited for
+    mutable GLuint program = 0;
     
     Shader() = default;
     Shader(const std::string& vertexPath, const std::string& fragmentPath);
     ~Shader();
     
     void load(const std::string& vertexPath, const std::string& fragmentPath);
+    
+    // With tessellation control and evaluation stages (GL 4.0)
+    void load(const std::string& vertexPath, const std::string& tessControlPath,
+              const std::string& tessEvaluationPath, const std::string& fragmentPath);
+    
+    // A compute program (GL 4.3)
+    void loadCompute(const std::string& computePath);
+    
+    // Like load(), but only starts the build (see ShaderCompiler). The first
+    // call that needs the program (isValid(), use(), a uniform setter, ...)
+    // waits for it and then runs onReady once, for setup such as sampler
+    // units and uniform block bindings.
+    void loadAsync(ShaderCompiler& compiler, const std::string& vertexPath, const std::string& fragmentPath,
+                   ReadyCallback onReady = nullptr);
+    void loadAsync(ShaderCompiler& compiler, const std::string& vertexPath, const std::string& tessControlPath,
+                   const std::string& tessEvaluationPath, const std::string& fragmentPath,
+                   ReadyCallback onReady = nullptr);
     void use() const;
     void dispose();
     
-    // Uniform setters
-    void setInt(const std::string& name, int value) const;
-    void setFloat(const std::string& name, float value) const;
-    void setVec2(const std::string& name, const glm::vec2& value) const;
-    void setVec3(const std::string& name, const glm::vec3& value) const;
-    void setVec4(const std::string& name, const glm::vec4& value) const;
-    void setMat4(const std::string& name, const glm::mat4& value) const;
+    // Uniform setters. Locations are looked up once per name and program.
+    void setInt(const char* name, int value) const;
+    void setFloat(const char* name, float value) const;
+    void setVec2(const char* name, const glm::vec2& value) const;
+    void setVec3(const char* name, const glm::vec3& value) const;
+    void setVec4(const char* name, const glm::vec4& value) const;
+    void setMat4(const char* name, const glm::mat4& value) const;
+    GLint getUniformLocation(const char* name) const;  // -1 if not active
     
-    bool isValid() const { return program != 0; }
+    // Sources the named uniform block from the buffer bound to binding
+    // (glBindBufferBase); blocks the program does not use are ignored
+    void bindUniformBlock(const char* name, GLuint binding) const;
+    
+    bool isValid() const { wait(); return program != 0; }
     
 private:
-    GLuint compileShader(const std::string& source, GLenum type);
+    // Builds on this thread, through ProgramCache (ShaderCompiler::buildNow())
+    void build(const ShaderStages& stages);
+    void wait() const;
     std::string loadShaderSource(const std::string& filePath);
+    
+    // Transparent comparator: found by const char* without a std::string
+    mutable std::map<std::string, GLint, std::less<>> uniformLocations_;
+    
+    // Set between loadAsync() and the first wait
+    mutable std::shared_future<GLuint> pending_;
+    mutable ReadyCallback onReady_;
 };
 
 class GLUtils {
@@ -0,0 +1,96 @@
+#pragma once
+
+// GLEW must be included before any other OpenGL headers
+#include <GL/glew.h>
+
+#include <memory>
+#include <vector>
+#include "terrain_generator.h"
+
+// A generated terrain displaced on the GPU. Instead of each patch's baked
+// vertices, the heights of the whole grid are one 2D texture (R16 over the
+// terrain's height range, or R32F) and the normals a second one (RG8,
+// octahedral-encoded). Every patch draws the same flat mesh, laid out in the
+// shared topology's vertex slots, which shaders/heightmap.vert displaces;
+// positions, normals and colors are never stored per vertex.
+//
+// Draws are queued with add() and submitted by flush(), one glDrawElements per
+// patch with the patch's grid corner as the constant value of
+// VertexFormats::PATCH_RANGE_ATTRIBUTE, so draw counts and LOD match the
+// per-patch path and only the vertex data differs. Changing heights only
+// re-uploads the edited region of the textures (updateRegion()).
+//
+// GL thread only.
+class HeightmapTerrain {
+public:
+    static constexpr GLuint HEIGHTMAP_UNIT = 0;     // Texture unit of the "heightmap" sampler
+    static constexpr GLuint NORMALMAP_UNIT = 1;     // ...and of "normalmap"
+    static constexpr const char* VERTEX_SHADER = "shaders/heightmap.vert";
+    
+    HeightmapTerrain() = default;
+    ~HeightmapTerrain();
+    
+    HeightmapTerrain(const HeightmapTerrain&) = delete;
+    HeightmapTerrain& operator=(const HeightmapTerrain&) = delete;
+    
+    // Builds the mesh and the height and normal textures of the generator's
+    // patches; fails (uploading nothing) without patches or a heightfield, or
+    // if the patches do not all share one topology. compactHeights stores
+    // 16-bit heights instead of floats. newElementBuffer is set when this
+    // created the topology's element buffer.
+    bool upload(const TerrainGenerator& generator, bool compactHeights = true, bool* newElementBuffer = nullptr);
+    void release();
+    
+    // Re-reads the grid points [gridX, gridX + width) x [gridZ, gridZ + depth)
+    // from the generator and replaces them in both textures. Heights outside
+    // the range the terrain was uploaded with are clamped in R16.
+    void updateRegion(const TerrainGenerator& generator, int gridX, int gridZ, int width, int depth);
+    
+    bool isUploaded() const { return vao_ != 0; }
+    size_t getVertexBytes() const { return vertexBytes_; }     // The one mesh
+    size_t getTextureBytes() const { return textureBytes_; }   // Heights and normals
+    const PatchTopology* getTopology() const { return topology_.get(); }
+    
+    // (min, extent) the shader's "heightRange" uniform maps texels to heights with
+    glm::vec2 getHeightRange() const { return heightRange_; }
+    
+    // Binds the textures to HEIGHTMAP_UNIT and NORMALMAP_UNIT. They filter
+    // linearly, for shaders that sample between grid points.
+    void bindTextures() const;
+    
+    // Queues a patch of the uploaded terrain
+    void add(const TerrainPatch& patch, int lodLevel, int stitchMask);
+    
+    // Submits and clears the queue; returns the number of draw calls issued
+    int flush();
+
+private:
+    struct QueuedPatch {
+        GLuint firstIndex;
+        GLuint indexCount;
+        size_t patch;       // Index into patchCorners_
+    };
+    
+    // The texels of a region, in the textures' formats
+    void buildTexels(const TerrainGenerator& generator, int gridX, int gridZ, int width, int depth);
+    
+    GLuint vao_ = 0;
+    GLuint meshBuffer_ = 0;
+    GLuint heightTexture_ = 0;
+    GLuint normalTexture_ = 0;
+    bool compactHeights_ = true;
+    int textureSize_ = 0;       // Grid points per side
+    glm::vec2 heightRange_ = glm::vec2(0.0f, 1.0f);
+    size_t vertexBytes_ = 0;
+    size_t textureBytes_ = 0;
+    std::shared_ptr<const PatchTopology> topology_;
+    const TerrainPatch* firstPatch_ = nullptr;  // Patch indices are relative to this
+    std::vector<glm::vec2> patchCorners_;       // Grid coordinate of every patch's corner
+    
+    std::vector<QueuedPatch> queue_;
+    
+    // Staging for buildTexels(), kept across updates
+    std::vector<GLushort> compactTexels_;
+    std::vector<float> floatTexels_;
+    std::vector<GLbyte> normalTexels_;
+};
@@ -0,0 +1,81 @@
+#pragma once
+
+// GLEW must be included before any other OpenGL headers
+#include <GL/glew.h>
+
+#include <memory>
+#include <vector>
+#include "terrain_generator.h"
+
+// Per-instance record of the instanced terrain (attribute
+// InstancedTerrain::INSTANCE_ATTRIBUTE)
+struct TerrainInstance {
+    glm::vec2 origin;   // World position (x, z) of the patch corner
+    float spacing;      // World distance between neighbouring grid points
+    float layer;        // The patch's layer in the height texture array
+};
+
+// A generated terrain drawn as instances of one flat patch mesh. The mesh is
+// a single patch's grid positions, laid out in the vertex slots of the
+// patches' shared topology so its index buffer and LOD ranges apply as is.
+// Heights live in a GL_TEXTURE_2D_ARRAY, one layer per patch with a
+// one-texel border from the neighbours for the normals, which
+// shaders/instanced.vert fetches per vertex. GPU memory is one mesh, the
+// heights and a 16-byte record per patch, instead of every patch's vertices.
+//
+// Draws are queued with add() and submitted by flush(): patches at the same
+// LOD range (level and stitch mask) are one glDrawElementsInstanced, so a
+// terrain without LOD is one draw call.
+//
+// GL thread only.
+class InstancedTerrain {
+public:
+    static constexpr GLuint INSTANCE_ATTRIBUTE = 4;
+    static constexpr GLuint HEIGHTMAP_UNIT = 0;     // Texture unit of the "heightmaps" sampler
+    static constexpr const char* VERTEX_SHADER = "shaders/instanced.vert";
+    
+    InstancedTerrain() = default;
+    ~InstancedTerrain();
+    
+    InstancedTerrain(const InstancedTerrain&) = delete;
+    InstancedTerrain& operator=(const InstancedTerrain&) = delete;
+    
+    // Builds the mesh, height layers and instance records of the generator's
+    // patches; fails (uploading nothing) if there are none, they do not all
+    // share one topology or there are more than the context's texture array
+    // layers. newElementBuffer is set when this created the topology's
+    // element buffer.
+    bool upload(const TerrainGenerator& generator, bool* newElementBuffer = nullptr);
+    void release();
+    
+    bool isUploaded() const { return vao_ != 0; }
+    size_t getVertexBytes() const { return vertexBytes_; }     // Mesh and instance records
+    size_t getTextureBytes() const { return textureBytes_; }   // Height layers
+    const PatchTopology* getTopology() const { return topology_.get(); }
+    
+    // Queues a patch of the uploaded terrain
+    void add(const TerrainPatch& patch, int lodLevel, int stitchMask);
+    
+    // Submits and clears the queue; returns the number of draw calls issued
+    int flush();
+
+private:
+    struct QueuedInstance {
+        GLuint firstIndex;
+        GLuint indexCount;
+        size_t patch;       // Index into instances_
+    };
+    
+    GLuint vao_ = 0;
+    GLuint meshBuffer_ = 0;
+    GLuint instanceBuffer_ = 0;     // This frame's records, grouped by LOD range
+    GLuint heightTexture_ = 0;
+    size_t vertexBytes_ = 0;
+    size_t textureBytes_ = 0;
+    std::shared_ptr<const PatchTopology> topology_;
+    const TerrainPatch* firstPatch_ = nullptr;  // Patch indices are relative to this
+    std::vector<TerrainInstance> instances_;    // Every patch's record, by patch index
+    
+    std::vector<QueuedInstance> queue_;
+    std::vector<TerrainInstance> frameInstances_;
+};
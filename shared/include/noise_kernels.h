@@ -0,0 +1,59 @@
+#pragma once
+
+// Batch evaluation of the terrain fBm noise. All kernels perform the same
+// floating-point operations in the same order, so SIMD results are
+// bit-identical to the scalar reference.
+
+enum class NoiseKernel {
+    Auto,   // Best kernel supported by the running CPU
+    Scalar,
+    SSE41,
+    AVX2
+};
+
+enum class NoiseBackend {
+    Classic,  // Hash noise; normals by finite differences over the heightfield
+    Gradient  // Perlin gradient noise with quintic fade and analytic derivatives
+};
+
+struct NoiseBatchParams {
+    const int* permutation = nullptr; // 512-entry (duplicated) permutation table
+    int octaves = 4;
+    float persistence = 0.5f;
+    float inputScale = 1.0f;          // World -> noise space
+    float outputScale = 1.0f;         // Noise -> height
+};
+
+class NoiseKernels {
+public:
+    using BatchFunction = void (*)(const NoiseBatchParams& params, const float* xs, float z,
+                                   int count, float* out);
+    
+    // Scalar reference for a single sample (in noise space, unscaled)
+    static float sample(const int* permutation, float x, float z, int octaves, float persistence);
+    
+    // out[i] = noise(xs[i] * inputScale, z * inputScale) * outputScale
+    static void evaluateScalar(const NoiseBatchParams& params, const float* xs, float z, int count, float* out);
+    static void evaluateSSE41(const NoiseBatchParams& params, const float* xs, float z, int count, float* out);
+    static void evaluateAVX2(const NoiseBatchParams& params, const float* xs, float z, int count, float* out);
+    
+    // Gradient noise fBm returning the value and its partial derivatives in one pass
+    static float sampleGradient(const int* permutation, float x, float z, int octaves, float persistence,
+                                float& dx, float& dz);
+    
+    // Like the batch kernels above; outDx/outDz receive d(out)/dx and d(out)/dz in
+    // world units and may be null when only heights are needed
+    static void evaluateGradient(const NoiseBatchParams& params, const float* xs, float z, int count,
+                                 float* out, float* outDx, float* outDz);
+    
+    // Runtime dispatch
+    static bool isSupported(NoiseKernel kernel);
+    static NoiseKernel resolve(NoiseKernel kernel);
+    static BatchFunction get(NoiseKernel kernel);
+    static const char* name(NoiseKernel kernel);
+    static const char* name(NoiseBackend backend);
+
+private:
+    static float grad(int hash, float x, float z);
+    static float gradientNoise(const int* permutation, float x, float z, float& dx, float& dz);
+};
@@ -0,0 +1,47 @@
+#pragma once
+
+// GLEW must be included before any other OpenGL headers
+#include <GL/glew.h>
+
+// How the applications run without a visible window (--headless) and how
+// long run() lasts; 0 frames and 0 seconds mean until the window closes
+struct HeadlessConfig {
+    bool enabled = false;
+    int frames = 0;
+    double seconds = 0.0;
+    
+    static constexpr int DEFAULT_FRAMES = 300;  // Headless runs must end
+};
+
+// A framebuffer object with color and depth renderbuffers, drawn into
+// instead of the window's default framebuffer by headless runs: its size is
+// the requested resolution whatever the (invisible or surfaceless) window
+// has. Once bound, frames render into it exactly as they would on screen.
+// GL thread only.
+class OffscreenTarget {
+public:
+    OffscreenTarget() = default;
+    ~OffscreenTarget();
+    
+    OffscreenTarget(const OffscreenTarget&) = delete;
+    OffscreenTarget& operator=(const OffscreenTarget&) = delete;
+    
+    // RGBA8 color and 24-bit depth; fails (creating nothing) if the
+    // framebuffer is incomplete
+    bool create(int width, int height);
+    void release();
+    
+    // Binds it for drawing and reading and sets the viewport to cover it
+    void bind() const;
+    
+    bool isCreated() const { return framebuffer_ != 0; }
+    int getWidth() const { return width_; }
+    int getHeight() const { return height_; }
+
+private:
+    GLuint framebuffer_ = 0;
+    GLuint colorBuffer_ = 0;
+    GLuint depthBuffer_ = 0;
+    int width_ = 0;
+    int height_ = 0;
+};
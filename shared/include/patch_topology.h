@@ -0,0 +1,127 @@
+#pragma once
+
+// GLEW must be included before any other OpenGL headers
+#include <GL/glew.h>
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+enum class PatchPrimitive {
+    Triangles,          // GL_TRIANGLES
+    TriangleStrips      // GL_TRIANGLE_STRIP, one strip per row joined by primitive restart
+};
+
+// A range of a topology's index data
+struct PatchLod {
+    unsigned int firstIndex;
+    unsigned int indexCount;
+    unsigned int triangleCount;     // Non-degenerate triangles drawn
+    unsigned int vertexTransforms;  // Vertex shader runs per draw (simulated cache)
+};
+
+// Post-transform vertex cache behaviour of an index list, simulated as a
+// FIFO, plus vertex fetch through a small FIFO of 64-byte memory lines
+struct VertexCacheStats {
+    size_t triangles = 0;
+    size_t uniqueVertices = 0;
+    size_t transforms = 0;      // Cache misses, i.e. vertex shader invocations
+    size_t fetchedBytes = 0;    // Memory lines loaded by those transforms
+    size_t vertexStride = 0;
+    
+    double acmr() const { return triangles ? static_cast<double>(transforms) / triangles : 0.0; }
+    double atvr() const { return uniqueVertices ? static_cast<double>(transforms) / uniqueVertices : 0.0; }
+    
+    // Bytes fetched per byte of vertex data used (1.0 is ideal)
+    double overfetch() const { return uniqueVertices ? static_cast<double>(fetchedBytes) / (uniqueVertices * vertexStride) : 0.0; }
+};
+
+// Index data for one patch resolution, shared by every patch of that size.
+// Holds every LOD level (every 2^level-th vertex) in 16 variants: one per
+// combination of edges stitched to a neighbour one level coarser. Stitched
+// edges collapse their odd vertices onto the even ones, so they match the
+// coarser neighbour's edge exactly and leave no cracks.
+//
+// Each variant's triangles are reordered for the post-transform vertex cache
+// (Tipsify), and vertices are stored in the order the full-detail variant
+// first uses them, so patch vertices must be written to the buffer position
+// vertexSlot() gives for their grid index. Strip topologies keep that vertex order, so the
+// same vertex buffer works with either primitive.
+//
+// Indices are kept as 32-bit on the CPU and uploaded as 16-bit whenever the
+// patch has fewer than 65536 vertices.
+class PatchTopology {
+public:
+    enum StitchEdge {
+        STITCH_NORTH = 1,   // -Z (first row)
+        STITCH_EAST = 2,    // +X (last column)
+        STITCH_SOUTH = 4,   // +Z (last row)
+        STITCH_WEST = 8     // -X (first column)
+    };
+    static constexpr int STITCH_VARIANTS = 16;
+    static constexpr int VERTEX_CACHE_SIZE = 16;    // FIFO entries the ordering targets
+    static constexpr unsigned int RESTART_INDEX = 0xFFFFFFFF; // In getIndices(); 0xFFFF when uploaded as 16-bit
+    
+    static const char* name(PatchPrimitive primitive);
+    
+    // Shared instance for the given resolution; freed with the last patch using it
+    static std::shared_ptr<const PatchTopology> get(int quadsPerSide, PatchPrimitive primitive = PatchPrimitive::Triangles);
+    
+    // Unshared instance; optimizeOrder = false keeps the plain row-major
+    // order (for comparison)
+    static std::shared_ptr<const PatchTopology> create(int quadsPerSide, PatchPrimitive primitive = PatchPrimitive::Triangles,
+                                                       bool optimizeOrder = true);
+    
+    // Levels a patch of this size gets: halve while the step divides the patch
+    // and leaves at least 2x2 quads
+    static int lodCountFor(int quadsPerSide);
+    
+    static VertexCacheStats simulateVertexCache(const unsigned int* indices, size_t count,
+                                                int cacheSize = VERTEX_CACHE_SIZE, size_t vertexStride = 44,
+                                                PatchPrimitive primitive = PatchPrimitive::Triangles);
+    
+    ~PatchTopology();
+    PatchTopology(const PatchTopology&) = delete;
+    PatchTopology& operator=(const PatchTopology&) = delete;
+    
+    int getQuadsPerSide() const { return quadsPerSide_; }
+    int getLodCount() const { return lodCount_; }
+    const PatchLod& range(int level, int stitchMask = 0) const { return ranges_[level * STITCH_VARIANTS + stitchMask]; }
+    const std::vector<unsigned int>& getIndices() const { return indices_; }
+    
+    // How the element buffer is drawn
+    PatchPrimitive getPrimitive() const { return primitive_; }
+    GLenum getPrimitiveMode() const { return primitive_ == PatchPrimitive::TriangleStrips ? GL_TRIANGLE_STRIP : GL_TRIANGLES; }
+    GLenum getIndexType() const { return indexType_; }
+    size_t getIndexSize() const { return indexType_ == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int); }
+    GLuint getRestartIndex() const { return indexType_ == GL_UNSIGNED_SHORT ? 0xFFFF : RESTART_INDEX; }
+    
+    size_t getIndexBytes() const { return indices_.size() * getIndexSize(); }   // As uploaded
+    size_t getListIndexBytes() const;   // The same variants as 32-bit triangle lists
+    
+    // Buffer position of the vertex at grid index z * (n + 1) + x
+    unsigned int vertexSlot(int gridIndex) const { return vertexSlots_[gridIndex]; }
+    
+    // A flat patch: the grid coordinate (x, z) relative to the patch corner
+    // of every vertex, in slot order. Meshes displaced in the vertex shader
+    // draw it with these indices.
+    std::vector<GLushort> gridMesh() const;
+    
+    // Element buffer holding all variants. Created on first use (GL thread);
+    // created is set when this call uploaded it.
+    GLuint getElementBuffer(bool* created = nullptr) const;
+
+private:
+    PatchTopology(int quadsPerSide, PatchPrimitive primitive, bool optimize);
+    void appendVariant(int step, int stitchMask);
+    void optimizeOrder();
+    
+    int quadsPerSide_;
+    int lodCount_;
+    PatchPrimitive primitive_;
+    GLenum indexType_;
+    std::vector<unsigned int> indices_;
+    std::vector<PatchLod> ranges_;
+    std::vector<unsigned int> vertexSlots_;     // Grid index -> buffer slot
+    mutable GLuint elementBuffer_;
+};
@@ -16,11 +16,23 @@ struct PerformanceMetrics {
     int drawCalls = 0;
     int trianglesDrawn = 0;
     int verticesDrawn = 0;
+    long long fullDetailTriangles = 0;  // What the same draws would cost without LOD
+    long long vertexTransforms = 0;     // Estimated vertex shader invocations
+    long long indexBytes = 0;           // Index data read by the draws
+    long long listIndexBytes = 0;       // ...had they been 32-bit triangle lists
+    double submitTime = 0.0;            // ms of CPU time spent issuing the draws
+    double recordTime = 0.0;            // ms spent recording them into command lists first
+    int culledPatches = 0;              // Patches skipped by frustum culling
+    long long stateCallsIssued = 0;     // GL state changes passed to the driver (GLState)
+    long long stateCallsFiltered = 0;   // ...and dropped as redundant
+    int frameCount = 0;
     
     // Memory metrics
     size_t memoryUsage = 0;
     size_t vboMemory = 0;
     size_t textureMemory = 0;
+    size_t uploadBytes = 0;         // Buffer data handed to the driver
+    double uploadTime = 0.0;        // ms spent in those calls
     
     // CPU metrics (approximate)
     double cpuUsage = 0.0;
@@ -46,9 +58,17 @@ public:
     void incrementDrawCalls(int count = 1) { metrics_.drawCalls += count; }
     void addTriangles(int count) { metrics_.trianglesDrawn += count; }
     void addVertices(int count) { metrics_.verticesDrawn += count; }
+    void addFullDetailTriangles(int count) { metrics_.fullDetailTriangles += count; }
+    void addVertexTransforms(int count) { metrics_.vertexTransforms += count; }
+    void addIndexFetch(size_t bytes, size_t listBytes) { metrics_.indexBytes += bytes; metrics_.listIndexBytes += listBytes; }
+    void addSubmitTime(double milliseconds) { metrics_.submitTime += milliseconds; }
+    void addRecordTime(double milliseconds) { metrics_.recordTime += milliseconds; }
+    void addCulledPatches(int count) { metrics_.culledPatches += count; }
+    void addStateCalls(size_t issued, size_t filtered) { metrics_.stateCallsIssued += issued; metrics_.stateCallsFiltered += filtered; }
     void addMemoryUsage(size_t bytes) { metrics_.memoryUsage += bytes; }
     void addVBOMemory(size_t bytes) { metrics_.vboMemory += bytes; }
     void addTextureMemory(size_t bytes) { metrics_.textureMemory += bytes; }
+    void addUpload(size_t bytes, double milliseconds) { metrics_.uploadBytes += bytes; metrics_.uploadTime += milliseconds; }
     
     // Accessors
     const PerformanceMetrics& getMetrics() const { return metrics_; }
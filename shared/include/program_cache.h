@@ -0,0 +1,66 @@
+#pragma once
+
+// GLEW must be included before any other OpenGL headers
+#include <GL/glew.h>
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// A program's stages as (shader type, GLSL source)
+using ShaderStages = std::vector<std::pair<GLenum, std::string>>;
+
+// On-disk cache of linked program binaries (glGetProgramBinary), one file
+// per program in a directory. Shader::load() looks a program up before
+// compiling it and stores it after a successful link, so every launch after
+// the first skips GLSL compilation and linking.
+//
+// A binary is only valid for the driver that produced it: the key hashes
+// every stage's type and source with GL_VENDOR, GL_RENDERER and GL_VERSION,
+// and a binary the driver still refuses (after an update that kept the
+// version string, say) is quietly replaced by a source build.
+//
+// Needs OpenGL 4.1 or ARB_get_program_binary, and a driver that reports at
+// least one binary format; otherwise lookups miss and nothing is written.
+// Any thread with a current context (see ShaderCompiler); set the directory
+// before building programs.
+class ProgramCache {
+public:
+    static constexpr uint32_t VERSION = 1;
+    
+    struct Stats {
+        int hits = 0;           // Programs loaded from a binary
+        int misses = 0;         // Programs compiled from source
+        int rejected = 0;       // Binaries the driver refused (counted as misses too)
+        int stored = 0;
+        double loadMs = 0.0;    // Time spent building programs, by outcome
+        double compileMs = 0.0;
+    };
+    
+    // Caches into directory, created on the first store; empty disables
+    // the cache. Takes effect for programs loaded afterwards.
+    static void setDirectory(const std::string& directory);
+    static const std::string& getDirectory();
+    
+    // Enabled and usable with the current context
+    static bool isEnabled();
+    
+    static uint64_t makeKey(const ShaderStages& stages);
+    
+    // A linked program from the binary stored under key, or 0 if there is
+    // none or the driver no longer accepts it
+    static GLuint load(uint64_t key);
+    
+    // Writes the program's binary under key. The program must have been
+    // linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT set.
+    static bool store(uint64_t key, GLuint program);
+    
+    // Called by ShaderCompiler for every program it builds
+    static void recordBuild(bool fromCache, double milliseconds);
+    static Stats getStats();
+    static void printReport();
+
+private:
+    static std::string pathFor(uint64_t key);
+};
@@ -0,0 +1,69 @@
+#pragma once
+
+// GLEW must be included before any other OpenGL headers
+#include <GL/glew.h>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include "program_cache.h"
+
+struct GLFWwindow;
+
+// Builds shader programs without stalling the GL thread, so that startup
+// work (terrain generation, buffer setup) overlaps shader compilation.
+// build() returns a future program; Shader::loadAsync() keeps it and waits
+// only when the program is first used.
+//
+// How depends on the context, picked by initialize():
+//   DriverThreads  GL_KHR_parallel_shader_compile: compiles and links are
+//                  issued at once and run on the driver's threads; the
+//                  future's get() checks the results on the GL thread
+//   WorkerContext  a hidden window whose context shares objects with the
+//                  application's; a thread builds the programs there
+//   Synchronous    neither is available: build() compiles right away
+//
+// Every mode goes through ProgramCache. initialize(), build() and get() on
+// the futures belong to the GL thread.
+class ShaderCompiler {
+public:
+    enum class Mode { Synchronous, DriverThreads, WorkerContext };
+    
+    static const char* modeName(Mode mode);
+    
+    // Builds a program on the calling thread and waits for it; 0 on failure
+    static GLuint buildNow(const ShaderStages& stages);
+    
+    ShaderCompiler() = default;
+    ~ShaderCompiler();
+    
+    ShaderCompiler(const ShaderCompiler&) = delete;
+    ShaderCompiler& operator=(const ShaderCompiler&) = delete;
+    
+    // Call with sharedContext's context current; falls back to
+    // Synchronous if the worker context cannot be created
+    void initialize(GLFWwindow* sharedContext);
+    
+    // Finishes queued builds and destroys the worker context. Call before
+    // the shared context goes away.
+    void shutdown();
+    
+    Mode getMode() const { return mode_; }
+    
+    // The program, or 0 if a stage failed to compile or link (reported)
+    std::shared_future<GLuint> build(const ShaderStages& stages);
+
+private:
+    void workerFunction();
+    
+    Mode mode_ = Mode::Synchronous;
+    GLFWwindow* workerContext_ = nullptr;
+    std::thread workerThread_;
+    std::mutex queueMutex_;
+    std::condition_variable queueCondition_;
+    std::deque<std::function<void()>> jobs_;
+    bool shouldStop_ = false;
+};
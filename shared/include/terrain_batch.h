@@ -0,0 +1,101 @@
+#pragma once
+
+// GLEW must be included before any other OpenGL headers
+#include <GL/glew.h>
+
+#include <memory>
+#include <vector>
+#include "terrain_generator.h"
+
+class ComputeTerrainGenerator;
+
+// How the apps submit a generated terrain
+enum class RenderMode {
+    PerPatch,   // A VAO and a glDrawElements per patch
+    MultiDraw,  // TerrainBatch: one buffer and VAO, one glMultiDrawElementsBaseVertex
+    Indirect,   // TerrainBatch: commands in a buffer, one glMultiDrawElementsIndirect
+    Instanced,  // InstancedTerrain: one mesh, heights from a texture array, glDrawElementsInstanced
+    Heightmap,  // HeightmapTerrain: one mesh displaced from height and normal textures, a draw per patch
+    Tessellated // TessellatedTerrain: coarse GL_PATCHES cells tessellated on the GPU (OpenGL 4.0)
+};
+
+// Record layout glMultiDrawElementsIndirect reads from GL_DRAW_INDIRECT_BUFFER
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+// Every patch of a generated terrain in one vertex buffer behind one VAO. The
+// vertex buffer is the generator's vertex arena, uploaded with a single call,
+// and the element buffer is the topology all patches share, so a patch's
+// draw is just its LOD range with firstVertex as the base vertex. Draws are
+// queued with add() and submitted together by flush():
+//
+//  - MultiDraw: one glMultiDrawElementsBaseVertex. Packed vertices decode
+//    with a per-patch attribute value a multi-draw cannot vary, so that
+//    format issues one glDrawElementsBaseVertex per patch instead (still
+//    without VAO switches).
+//  - Indirect: the queue is written to a GL_DRAW_INDIRECT_BUFFER as
+//    DrawElementsIndirectCommand records and drawn with one
+//    glMultiDrawElementsIndirect. Each command's baseInstance is its patch
+//    index, which selects the patch's range from an instanced attribute
+//    array, so every format takes a single call. Needs OpenGL 4.3 (or
+//    ARB_multi_draw_indirect and ARB_base_instance).
+//
+// GL thread only.
+class TerrainBatch {
+public:
+    static const char* name(RenderMode mode);
+    static bool isSupported(RenderMode mode);   // By the current context
+    
+    TerrainBatch() = default;
+    ~TerrainBatch();
+    
+    TerrainBatch(const TerrainBatch&) = delete;
+    TerrainBatch& operator=(const TerrainBatch&) = delete;
+    
+    // Uploads the generator's patches for drawing in the given (batched)
+    // mode; fails (uploading nothing) if there are none or they do not all
+    // share one topology. newElementBuffer is set when this created the
+    // topology's element buffer. Given an initialized compute generator,
+    // float vertices are generated into the buffer on the GPU instead of
+    // being uploaded (falling back to the upload if that fails).
+    bool upload(const TerrainGenerator& generator, RenderMode mode, bool* newElementBuffer = nullptr,
+                ComputeTerrainGenerator* compute = nullptr);
+    void release();
+    
+    bool isUploaded() const { return vao_ != 0; }
+    RenderMode getMode() const { return mode_; }
+    size_t getVertexBytes() const { return vertexBytes_; }
+    bool isComputeGenerated() const { return computeGenerated_; }  // No vertices were uploaded
+    const PatchTopology* getTopology() const { return topology_.get(); }
+    
+    // Queues a patch of the uploaded terrain
+    void add(const TerrainPatch& patch, int lodLevel, int stitchMask);
+    
+    // Submits and clears the queue; returns the number of draw calls issued
+    int flush();
+
+private:
+    RenderMode mode_ = RenderMode::MultiDraw;
+    GLuint vao_ = 0;
+    GLuint vbo_ = 0;
+    GLuint indirectBuffer_ = 0;     // Indirect: this frame's commands
+    GLuint patchRangeBuffer_ = 0;   // Indirect, packed: every patch's PackedVertexRange
+    size_t vertexBytes_ = 0;
+    bool computeGenerated_ = false;
+    VertexFormat format_ = VertexFormat::Float;
+    std::shared_ptr<const PatchTopology> topology_;
+    const TerrainPatch* firstPatch_ = nullptr;  // Patch indices are relative to this
+    
+    // Queued draws. MultiDraw lays them out as glMultiDrawElementsBaseVertex
+    // takes them, Indirect as commands.
+    std::vector<GLsizei> counts_;
+    std::vector<const void*> offsets_;
+    std::vector<GLint> baseVertices_;
+    std::vector<const TerrainPatch*> patches_;  // For the packed ranges
+    std::vector<DrawElementsIndirectCommand> commands_;
+};
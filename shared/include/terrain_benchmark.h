@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+
+class TerrainGenerator;
+
+// Offline CPU benchmarks for terrain generation; these run without a window
+// or OpenGL context and print their results to stdout
+class TerrainBenchmark {
+public:
+    // Samples/second for every noise kernel the CPU supports
+    static void runNoiseBenchmark(TerrainGenerator& generator, size_t sampleCount = 1 << 24);
+    
+    // Generation time and normal accuracy of finite-difference normals versus
+    // the analytic derivatives of the gradient noise backend
+    static void runNormalBenchmark(TerrainGenerator& generator);
+    
+    // Vertex memory, generation cost, copy bandwidth (a stand-in for the
+    // driver's upload copy) and decode error of each vertex format
+    static void runVertexFormatBenchmark(TerrainGenerator& generator);
+    
+    // ACMR/ATVR of the patch index buffers in plain row-major order versus
+    // the cache-optimized order, per LOD level and for a full-detail frame
+    static void runVertexCacheBenchmark(const TerrainGenerator& generator);
+};
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "terrain_generator.h"
+
+// Read-only memory mapping of a whole file
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+    
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    
+    bool open(const std::string& path);
+    void close();
+    
+    const uint8_t* data() const { return data_; }
+    size_t size() const { return size_; }
+    bool isOpen() const { return data_ != nullptr; }
+
+private:
+    const uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+#ifdef _WIN32
+    void* fileHandle_ = nullptr;
+    void* mappingHandle_ = nullptr;
+#endif
+};
+
+// Everything that influences the generated geometry; a cache file is only
+// used when its key matches the current configuration exactly
+struct TerrainCacheKey {
+    int32_t seed = -1;
+    int32_t gridSize = 0;
+    int32_t patchesPerRow = 0;
+    float heightScale = 0.0f;
+    float patchSize = 0.0f;
+    int32_t noiseBackend = 0;
+    int32_t heightfieldSubdivisions = 1;
+    int32_t analyticNormals = 0;    // Gradient backend: normals from the noise derivatives
+    
+    bool operator==(const TerrainCacheKey& other) const;
+    bool operator!=(const TerrainCacheKey& other) const { return !(*this == other); }
+};
+
+// Versioned binary terrain file:
+//   header | patch table | LOD errors | vertex blob (all patches) | heightfield
+// Blobs are 64-byte aligned so the mapped pages can be handed to
+// glBufferData directly.
+class TerrainCache {
+public:
+    static constexpr uint32_t VERSION = 5;
+    
+    static bool save(const std::string& path, const TerrainCacheKey& key, const std::vector<TerrainPatch>& patches,
+                     const std::vector<float>& heightfield, int heightfieldSize);
+    
+    // Maps the file and points every patch at its vertex data inside the
+    // mapping; index topologies (of the given primitive) are shared and
+    // rebuilt, not stored. Returns false (leaving patches untouched) if the
+    // file is missing, from another version or built with a different key.
+    // The (small) heightfield is copied out for height queries.
+    static bool load(const std::string& path, const TerrainCacheKey& key, PatchPrimitive primitive, MappedFile& file,
+                     std::vector<TerrainPatch>& patches, std::vector<float>& heightfield, int& heightfieldSize);
+};
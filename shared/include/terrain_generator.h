@@ -4,29 +4,81 @@
 #include <GL/glew.h>
 
 #include <vector>
+#include <functional>
+#include <memory>
+#include <string>
+#include <algorithm>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
-
-struct TerrainVertex {
-    glm::vec3 position;
-    glm::vec3 normal;
-    glm::vec2 texCoord;
-    glm::vec3 color;
-};
+#include "noise_kernels.h"
+#include "patch_topology.h"
+#include "vertex_format.h"
 
 struct TerrainPatch {
+    // Vertices owned by the patch; only streamed tiles use this. Patches of a
+    // generated terrain point into the generator's vertex arena (or a mapped
+    // terrain cache) instead and leave the vector empty.
     std::vector<TerrainVertex> vertices;
-    std::vector<unsigned int> indices;
+    const TerrainVertex* sharedVertices = nullptr;
+    size_t sharedVertexCount = 0;
+    size_t firstVertex = 0;     // Position of sharedVertices within that storage
+    
+    const TerrainVertex* vertexData() const { return sharedVertices ? sharedVertices : vertices.data(); }
+    size_t vertexCount() const { return sharedVertices ? sharedVertexCount : vertices.size(); }
+    
+    // Compact copy built when the generator uses VertexFormat::Packed (owned or
+    // shared like the vertices above), and the parameters the shaders decode it with
+    std::vector<PackedTerrainVertex> packedVertices;
+    const PackedTerrainVertex* sharedPackedVertices = nullptr;
+    PackedVertexRange packedRange;
+    const PackedTerrainVertex* packedVertexData() const {
+        return sharedPackedVertices ? sharedPackedVertices : packedVertices.data();
+    }
+    
+    // What gets uploaded to the GPU in the patch's vertex format
+    VertexFormat vertexFormat() const {
+        return sharedPackedVertices || !packedVertices.empty() ? VertexFormat::Packed : VertexFormat::Float;
+    }
+    const void* gpuVertexData() const;
+    size_t gpuVertexBytes() const;
+    
+    // Indices are shared by every patch of the same resolution
+    std::shared_ptr<const PatchTopology> topology;
+    const unsigned int* indexData() const { return topology->getIndices().data(); }
+    size_t indexCount() const { return topology->getIndices().size(); }
+    
+    // LOD chain: level 0 is full resolution, each level draws every 2^level-th
+    // vertex. lodErrors holds each level's max height deviation from full
+    // resolution in world units (non-decreasing).
+    std::vector<float> lodErrors;
+    int lodCount() const { return static_cast<int>(lodErrors.size()); }
+    const PatchLod& lodRange(int level, int stitchMask = 0) const { return topology->range(level, stitchMask); }
+    size_t fullDetailTriangleCount() const { return topology->range(0).triangleCount; }
+    
     glm::vec3 center;
     float boundingRadius;
     int lodLevel;
     
     GLuint VAO = 0;
     GLuint VBO = 0;
-    GLuint EBO = 0;
     bool isUploaded = false;
 };
 
+// Options applied together by TerrainGenerator::configure()
+struct TerrainConfig {
+    int gridSize = 256;
+    int patchCount = 64;
+    float heightScale = 20.0f;
+    int generationThreads = 0;      // 0 = one per hardware thread, 1 = serial
+    NoiseBackend noiseBackend = NoiseBackend::Classic;
+    int seed = -1;                  // Negative = nondeterministic (std::random_device)
+    std::string cachePath;          // Terrain cache file; empty = always generate
+    VertexFormat vertexFormat = VertexFormat::Float;
+    PatchPrimitive primitive = PatchPrimitive::Triangles;
+};
+
+class MappedFile;
+
 class TerrainGenerator {
 public:
     TerrainGenerator(int gridSize = 256, float patchSize = 1.0f, float heightScale = 20.0f);
@@ -35,20 +87,80 @@ public:
     void setGridSize(int gridSize) { gridSize_ = gridSize; }
     void setPatchCount(int patchCount) { patchesPerRow_ = std::sqrt(patchCount); }
     void setHeightScale(float scale) { heightScale_ = scale; }
+    void setGenerationThreads(int threads) { generationThreads_ = threads; } // 0 = one per hardware thread, 1 = serial
+    void setNoiseKernel(NoiseKernel kernel);
+    void setHeightfieldSubdivisions(int subdivisions) { heightfieldSubdivisions_ = std::max(1, subdivisions); }
+    void setNoiseBackend(NoiseBackend backend) { noiseBackend_ = backend; }
+    void setAnalyticNormals(bool enabled) { analyticNormals_ = enabled; } // Gradient backend only
+    void setSeed(int seed);
+    void setVertexFormat(VertexFormat format) { vertexFormat_ = format; } // Applies to patches generated afterwards
+    void setPrimitive(PatchPrimitive primitive) { primitive_ = primitive; }  // Likewise
+    void configure(const TerrainConfig& config);
     ~TerrainGenerator();
 
     // Generate terrain data
     void generateTerrain();
+    
+    // Maps a matching terrain cache, or generates and writes one. Caching
+    // needs a deterministic seed; without one this just generates.
+    void generateOrLoad(const std::string& cachePath);
+    bool loadCache(const std::string& path);
+    bool saveCache(const std::string& path) const;
     void generatePatches(int patchCount = 64);
     
+    // Frees all patches (and their GL objects), the heightfield and any mapped cache
+    void clear();
+    
+    // Deletes the patches' VAOs/VBOs and marks them not uploaded; the patches stay
+    void releaseGpuBuffers() { releaseBuffers(patches_); }
+    
+    // Streaming: builds the tile of tileSize x tileSize quads whose corner is at
+    // grid coordinate (tileX, tileZ) * tileSize. Works anywhere in the unbounded
+    // noise domain and only reads immutable state, so any thread may call it.
+    void generateTile(int tileX, int tileZ, int tileSize, TerrainPatch& patch) const;
+    
     // Accessors
     const std::vector<TerrainPatch>& getPatches() const { return patches_; }
     int getGridSize() const { return gridSize_; }
+    int getPatchesPerRow() const { return patchesPerRow_; }
     float getHeightScale() const { return heightScale_; }
+    int getGenerationThreads() const { return generationThreads_; }
+    NoiseKernel getNoiseKernel() const { return noiseKernel_; }
+    NoiseBackend getNoiseBackend() const { return noiseBackend_; }
+    bool getAnalyticNormals() const { return analyticNormals_; }
+    int getSeed() const { return seed_; }
+    VertexFormat getVertexFormat() const { return vertexFormat_; }
+    PatchPrimitive getPrimitive() const { return primitive_; }
+    
+    // Batch height evaluation (vectorized when the CPU supports it)
+    void heightRow(float z, int startX, int count, float* out) const;    // Grid columns startX.. at x = column * patchSize
+    void heightBatch(const float* xs, float z, int count, float* out) const;
+    NoiseBatchParams heightParams() const;  // What heightBatch() evaluates with
+    
+    // Heightfield stage: one (gridSize * subdivisions + 1)^2 grid of heights
+    // computed once per generateTerrain() that all patches are built from
+    const std::vector<float>& getHeightfield() const { return heightfield_; }
+    int getHeightfieldSize() const { return heightfieldSize_; }
+    int getHeightfieldSubdivisions() const { return heightfieldSubdivisions_; }
+    float sampleHeight(float worldX, float worldZ) const; // Bilinear lookup into the heightfield
+    
+    // Height and normal the patch vertex at grid point (gridX, gridZ) gets,
+    // clamped to the terrain's edge. Need the heightfield.
+    float gridHeight(int gridX, int gridZ) const;
+    glm::vec3 gridNormal(int gridX, int gridZ) const;
+    float getPatchSize() const { return patchSize_; }
     
     // Statistics
     size_t getTotalVertices() const;
-    size_t getTotalTriangles() const;
+    size_t getTotalTriangles() const;   // At full detail
+    size_t getVertexMemory() const;     // Bytes of vertex data uploaded, in the current format
+    size_t getIndexMemory() const;      // Bytes of the (shared) index topologies in use, as uploaded
+    size_t getListIndexMemory() const;  // ...if they were 32-bit triangle lists
+    
+    // Every patch's vertices as one contiguous block of getVertexMemory()
+    // bytes in the current format; patch i starts at vertex
+    // patches[i].firstVertex. Null when there are no patches.
+    const void* getVertexArenaData() const;
     
 private:
     // Height generation
@@ -56,23 +168,59 @@ private:
     float perlinNoise(float x, float z, int octaves = 4, float persistence = 0.5f) const;
     float fadeFunction(float t) const;
     float lerp(float a, float b, float t) const;
-    float grad(int hash, float x, float z) const;
     
-    // Normal calculation
-    glm::vec3 calculateNormal(float x, float z) const;
+    // Heightfield
+    void buildHeightfield();
+    float heightAt(int sampleX, int sampleZ) const;
+    glm::vec3 heightfieldNormal(int sampleX, int sampleZ) const;
     
     // Patch creation
-    void createPatch(int startX, int startZ, int patchSize, TerrainPatch& patch);
+    void createPatch(int startX, int startZ, int patchSize, size_t firstVertex, TerrainPatch& patch); // Into the arenas
+    TerrainVertex makeVertex(int gridX, int gridZ, float height, const glm::vec3& normal) const;
+    void buildLodChain(int quadsPerSide, TerrainPatch& patch) const;
+    static void computeBounds(TerrainPatch& patch);
+    void packVertices(TerrainPatch& patch, PackedTerrainVertex* packed) const; // vertexCount() entries, and packedRange
+    std::vector<const PatchTopology*> uniqueTopologies() const;
+    static void releaseBuffers(std::vector<TerrainPatch>& patches); // Uploaded VAOs/VBOs, before patches are dropped
+    void printIndexMemory() const;
+    
+    // Runs task(0..count-1) across the configured number of worker threads
+    void parallelFor(int count, const std::function<void(int)>& task) const;
+    int resolveWorkerCount(int taskCount) const;
     
     // Member variables
     int gridSize_;
     float patchSize_;
     float heightScale_;
     int patchesPerRow_;
+    int generationThreads_;
     std::vector<TerrainPatch> patches_;
     
+    // Contiguous storage the patches of a generated terrain point into (a
+    // loaded cache keeps the full-precision vertices in its mapping). Kept
+    // across regeneration so the allocations are reused.
+    std::vector<TerrainVertex> vertexArena_;
+    std::vector<PackedTerrainVertex> packedArena_;
+    
+    // Heightfield (row-major, heightfieldSize_ samples per side)
+    std::vector<float> heightfield_;
+    std::vector<float> heightfieldDx_;  // Analytic dh/dx, dh/dz (gradient backend)
+    std::vector<float> heightfieldDz_;
+    int heightfieldSize_;
+    int heightfieldSubdivisions_;
+    
+    // Terrain cache mapping the patches point into (when loaded from disk)
+    std::unique_ptr<MappedFile> mappedCache_;
+    
     // Perlin noise
     mutable std::vector<int> permutation_;
+    int seed_;
     bool noiseInitialized_;
+    NoiseKernel noiseKernel_;
+    NoiseKernels::BatchFunction noiseBatch_;
+    NoiseBackend noiseBackend_;
+    bool analyticNormals_;
+    VertexFormat vertexFormat_;
+    PatchPrimitive primitive_;
     void initializeNoise();
 };
\ No newline at end of file
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "terrain_generator.h"
+
+// Screen-space error LOD selection. A level is acceptable when its geometric
+// error, projected at the patch's nearest distance to the camera, stays
+// within the pixel tolerance.
+class TerrainLod {
+public:
+    // Pixels per world unit at distance 1 for a perspective projection
+    static float pixelScale(int viewportHeight, float fovY);
+    
+    // Coarsest acceptable level; 0 when tolerance <= 0
+    static int selectLevel(const TerrainPatch& patch, const glm::vec3& cameraPos, float pixelScale, float tolerance);
+    
+    // Selects levels for a row-major grid of patches (null cells are skipped),
+    // then refines cells until neighbours differ by at most one level. Each
+    // cell's stitch mask (PatchTopology::StitchEdge bits) marks the edges
+    // whose neighbour is one level coarser.
+    static void selectGridLevels(const std::vector<const TerrainPatch*>& grid, int columns,
+                                 const glm::vec3& cameraPos, float pixelScale, float tolerance,
+                                 std::vector<int>& levels, std::vector<int>& stitchMasks);
+    
+    // The second half of selectGridLevels(), for levels chosen elsewhere
+    // (one selectLevel() per cell, e.g. spread over threads)
+    static void constrainGridLevels(const std::vector<const TerrainPatch*>& grid, int columns,
+                                    std::vector<int>& levels, std::vector<int>& stitchMasks);
+    
+    // Projected error in pixels of an error of geometricError world units at the given distance
+    static float screenSpaceError(float geometricError, float distance, float pixelScale);
+};
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "terrain_generator.h"
+
+struct StreamingConfig {
+    bool enabled = false;
+    int tileSize = 32;                          // Quads per tile side
+    int viewRadius = 4;                         // Tiles kept around the camera
+    size_t cpuBudget = 256u * 1024 * 1024;      // Bytes of resident tile geometry
+    size_t gpuBudget = 128u * 1024 * 1024;      // Bytes of uploaded tile buffers
+    int workerThreads = 2;
+    int uploadsPerFrame = 4;                    // Caps the upload cost of a single frame
+};
+
+struct StreamingStats {
+    size_t residentTiles = 0;       // Tiles held in CPU memory
+    size_t gpuResidentTiles = 0;    // ...of which have GPU buffers
+    size_t cpuBytes = 0;
+    size_t gpuBytes = 0;
+    size_t pendingTiles = 0;        // Generation backlog
+    size_t inFlightTiles = 0;       // Being generated right now
+    size_t tilesGenerated = 0;
+    size_t tilesUploaded = 0;
+    size_t bytesUploaded = 0;       // Vertex data sent to the GPU
+    size_t cpuEvictions = 0;
+    size_t gpuEvictions = 0;
+    size_t cancelledRequests = 0;   // Left the view radius before a worker got to them
+    double averageGenerationTime = 0.0; // ms per tile
+};
+
+// Infinite terrain around the camera. Tiles are generated by background
+// workers in rings around the camera, nearest and most in-view first, and
+// uploaded a few per frame. Tiles outside the view are kept in an LRU cache
+// and evicted, GPU buffers first, when the configured budgets are exceeded.
+//
+// update() and getVisibleGrid() must be called on the GL thread.
+class TerrainStreamer {
+public:
+    TerrainStreamer(const TerrainGenerator& generator, const StreamingConfig& config);
+    ~TerrainStreamer();
+    
+    TerrainStreamer(const TerrainStreamer&) = delete;
+    TerrainStreamer& operator=(const TerrainStreamer&) = delete;
+    
+    // Requests missing tiles, collects finished ones, uploads and evicts
+    void update(const glm::vec3& cameraPos, const glm::vec3& cameraFront);
+    
+    // Uploaded tiles within the view radius as a row-major square grid centred
+    // on the camera tile; other cells are null (valid until the next update)
+    const std::vector<const TerrainPatch*>& getVisibleGrid() const { return visibleGrid_; }
+    int getGridColumns() const { return 2 * config_.viewRadius + 1; }
+    
+    StreamingStats getStats() const;
+    void printReport() const;
+
+private:
+    struct Tile {
+        int x, z;
+        TerrainPatch patch;
+        size_t cpuBytes;
+        size_t gpuBytes;
+        uint64_t lastUsedFrame;
+        std::list<uint64_t>::iterator lruPosition;
+    };
+    
+    struct CompletedTile {
+        int x, z;
+        TerrainPatch patch;
+        double generationTime;
+    };
+    
+    static uint64_t tileKey(int x, int z);
+    float requestPriority(int tileX, int tileZ) const; // Lower is sooner; needs queueMutex_
+    
+    void workerLoop();
+    void collectCompleted();
+    void uploadTile(Tile& tile);
+    void releaseGPU(Tile& tile);
+    void enforceBudgets();
+    
+    const TerrainGenerator& generator_;
+    StreamingConfig config_;
+    float tileWorldSize_;
+    uint64_t frame_;
+    
+    // GL thread only
+    std::unordered_map<uint64_t, Tile> tiles_;
+    std::list<uint64_t> lru_;                   // Most recently used first
+    std::unordered_set<uint64_t> requested_;    // Pending or being generated
+    std::vector<Tile*> visibleTiles_;              // Nearest first
+    std::vector<const TerrainPatch*> visibleGrid_;
+    size_t cpuBytes_;
+    size_t gpuBytes_;
+    size_t tilesUploaded_;
+    size_t bytesUploaded_;
+    size_t cpuEvictions_;
+    size_t gpuEvictions_;
+    size_t cancelledRequests_;
+    
+    // Shared with the workers
+    mutable std::mutex queueMutex_;
+    std::condition_variable queueCondition_;
+    std::vector<std::pair<int, int>> pending_;
+    std::vector<CompletedTile> completed_;
+    glm::vec2 cameraTile_;                      // Camera position in tile units
+    glm::vec2 cameraDirection_;                 // Normalized view direction on the ground plane
+    size_t inFlight_;
+    size_t tilesGenerated_;
+    double generationTimeTotal_;
+    bool stopping_;
+    
+    std::vector<std::thread> workers_;
+};
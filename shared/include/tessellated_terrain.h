@@ -0,0 +1,62 @@
+#pragma once
+
+// GLEW must be included before any other OpenGL headers
+#include <GL/glew.h>
+
+#include "heightmap_terrain.h"
+
+// A generated terrain drawn through hardware tessellation (GL 4.0). The grid
+// is cut into coarse cells of CELL_QUADS x CELL_QUADS quads, each submitted as
+// one 4-vertex GL_PATCHES primitive of its corners; the whole terrain is a
+// single glDrawArrays. shaders/tessellated.tesc picks every cell edge's
+// tessellation level from its projected length (about "edgePixels" pixels per
+// segment, never finer than one segment per grid quad) and drops cells
+// outside the view frustum. shaders/tessellated.tese then displaces the
+// generated vertices from the heights and normals of a HeightmapTerrain,
+// filtered between grid points.
+//
+// An edge's level depends only on its two corners, so neighbouring cells
+// always agree on it: LOD is continuous and crack-free with no per-level
+// index ranges or stitching. How many triangles that produces is only known
+// on the GPU (GL_PRIMITIVES_GENERATED).
+//
+// GL thread only.
+class TessellatedTerrain {
+public:
+    static constexpr int CELL_QUADS = 64;   // The smallest GL_MAX_TESS_GEN_LEVEL allowed
+    static constexpr const char* VERTEX_SHADER = "shaders/tessellated.vert";
+    static constexpr const char* TESS_CONTROL_SHADER = "shaders/tessellated.tesc";
+    static constexpr const char* TESS_EVALUATION_SHADER = "shaders/tessellated.tese";
+    static constexpr GLuint HEIGHTMAP_UNIT = HeightmapTerrain::HEIGHTMAP_UNIT;
+    static constexpr GLuint NORMALMAP_UNIT = HeightmapTerrain::NORMALMAP_UNIT;
+    
+    // Tessellation shaders: GL 4.0 or ARB_tessellation_shader
+    static bool isSupported();
+    
+    TessellatedTerrain() = default;
+    ~TessellatedTerrain();
+    
+    TessellatedTerrain(const TessellatedTerrain&) = delete;
+    TessellatedTerrain& operator=(const TessellatedTerrain&) = delete;
+    
+    // Uploads the height and normal textures and the cell corners; fails
+    // (uploading nothing) where HeightmapTerrain::upload() does
+    bool upload(const TerrainGenerator& generator);
+    void release();
+    
+    bool isUploaded() const { return vao_ != 0; }
+    size_t getVertexBytes() const { return vertexBytes_; }     // Cell corners
+    size_t getTextureBytes() const { return heights_.getTextureBytes(); }
+    int getCellCount() const { return cellCount_; }
+    glm::vec2 getHeightRange() const { return heights_.getHeightRange(); }
+    
+    // Draws every cell; returns the number of draw calls issued
+    int draw();
+
+private:
+    HeightmapTerrain heights_;  // Only its textures are used
+    GLuint vao_ = 0;
+    GLuint cornerBuffer_ = 0;
+    int cellCount_ = 0;
+    size_t vertexBytes_ = 0;
+};
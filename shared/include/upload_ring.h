@@ -0,0 +1,99 @@
+#pragma once
+
+// GLEW must be included before any other OpenGL headers
+#include <GL/glew.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+
+struct UploadRingStats {
+    size_t capacity = 0;
+    size_t allocations = 0;
+    size_t bytesStreamed = 0;   // Written into the ring by producers
+    size_t stalls = 0;          // Allocations that had to wait for the GPU to release space
+    double stallTime = 0.0;     // ms spent waiting
+    double streamTime = 0.0;    // ms from the first allocation until the GPU released the last region
+};
+
+// Staging space for uploads: one immutable buffer (glBufferStorage), mapped
+// persistent and coherent for its whole lifetime and handed out as a ring.
+// Producers on any thread copy their data straight into the mapping; the
+// GL thread issues the commands reading it (e.g. glCopyBufferSubData into
+// the destination buffer) and then fences the consumed space. A region is
+// handed out again only after its fence has signalled, so the CPU never
+// overwrites data the GPU has yet to read; an allocation that finds the ring
+// full blocks until the GL thread retires enough fences (a stall).
+//
+// Regions must be consumed in allocation order. Needs OpenGL 4.4 or
+// ARB_buffer_storage.
+class UploadRing {
+public:
+    struct Region {
+        size_t offset = 0;      // Into getBuffer()
+        void* data = nullptr;   // Mapped pointer to write to
+        size_t size = 0;
+        uint64_t end = 0;       // Ring position after the region, for fence()
+    };
+    
+    static bool isSupported();  // By the current context
+    
+    UploadRing() = default;
+    ~UploadRing();
+    
+    UploadRing(const UploadRing&) = delete;
+    UploadRing& operator=(const UploadRing&) = delete;
+    
+    // GL thread (or any context of the share group)
+    bool create(size_t capacity);
+    void destroy();
+    
+    bool isCreated() const { return buffer_ != 0; }
+    GLuint getBuffer() const { return buffer_; }
+    size_t getCapacity() const { return capacity_; }
+    
+    // Any thread. Reserves size bytes, waiting while the GPU still reads the
+    // space. Fails for sizes over the capacity and once destroy() started.
+    bool allocate(size_t size, Region& region);
+    
+    // GL thread. Fences the space up to end (a consumed region's end): it is
+    // reused once the commands issued so far have completed.
+    void fence(uint64_t end);
+    
+    // GL thread. Releases the space of signalled fences; with wait, first
+    // blocks until the oldest fence signals.
+    void retire(bool wait);
+    
+    bool hasFences() const;
+    bool hasWaiters() const;    // A producer is stalled in allocate()
+    
+    UploadRingStats getStats() const;
+    void printReport() const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+    
+    struct Fence {
+        GLsync sync;
+        uint64_t end;
+    };
+    
+    GLuint buffer_ = 0;
+    uint8_t* mapping_ = nullptr;
+    size_t capacity_ = 0;
+    
+    mutable std::mutex mutex_;
+    std::condition_variable released_;
+    uint64_t head_ = 0;         // Ring positions only grow; offset = position % capacity
+    uint64_t tail_ = 0;         // Everything before is free
+    std::deque<Fence> fences_;
+    int waiters_ = 0;
+    bool destroying_ = false;
+    
+    UploadRingStats stats_;
+    Clock::time_point firstAllocation_;
+    Clock::time_point lastRelease_;
+};
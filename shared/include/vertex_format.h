@@ -0,0 +1,73 @@
+#pragma once
+
+// GLEW must be included before any other OpenGL headers
+#include <GL/glew.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <glm/glm.hpp>
+
+// Full-precision vertex (44 bytes)
+struct TerrainVertex {
+    glm::vec3 position;
+    glm::vec3 normal;
+    glm::vec2 texCoord;
+    glm::vec3 color;
+};
+
+// Compact vertex (8 bytes). Position x/z and the texture coordinate follow
+// from the grid coordinate and the color from the height, so only those are
+// stored; basic_packed.vert rebuilds the rest using the patch's
+// PackedVertexRange.
+struct PackedTerrainVertex {
+    uint16_t gridX;         // Grid coordinate relative to the patch corner
+    uint16_t gridZ;
+    uint16_t height;        // Unsigned normalized over the patch's height range
+    int8_t normal[2];       // Octahedral-encoded unit normal, signed normalized
+};
+
+// Decode parameters of one patch's packed vertices
+struct PackedVertexRange {
+    glm::vec2 gridOrigin = glm::vec2(0.0f);     // Grid coordinate of the patch corner
+    float heightMin = 0.0f;
+    float heightExtent = 0.0f;
+};
+
+enum class VertexFormat {
+    Float,      // TerrainVertex
+    Packed      // PackedTerrainVertex
+};
+
+class VertexFormats {
+public:
+    // Attribute basic_packed.vert reads the PackedVertexRange from
+    static constexpr GLuint PATCH_RANGE_ATTRIBUTE = 3;
+    
+    static const char* name(VertexFormat format);
+    static size_t stride(VertexFormat format);
+    
+    // Vertex shader decoding the format
+    static const char* vertexShaderPath(VertexFormat format);
+    
+    // Attribute pointers for the bound VAO and GL_ARRAY_BUFFER, whose vertices
+    // start baseOffset bytes in
+    static void setupAttributes(VertexFormat format, size_t baseOffset = 0);
+    
+    // A patch's decode parameters as the shaders take them: (gridOrigin,
+    // heightMin, heightExtent). setPatchRange() sets them as the constant
+    // value of PATCH_RANGE_ATTRIBUTE for the following (non-indirect) draws.
+    static glm::vec4 patchRange(const PackedVertexRange& range);
+    static void setPatchRange(const PackedVertexRange& range);
+    
+    // Octahedral mapping of unit vectors onto [-1, 1]^2
+    static glm::vec2 encodeOctahedral(const glm::vec3& normal);
+    static glm::vec3 decodeOctahedral(const glm::vec2& encoded);
+    
+    // gridSpacing is the world distance between neighbouring grid points
+    static PackedVertexRange computeRange(const TerrainVertex* vertices, size_t count, float gridSpacing);
+    static PackedTerrainVertex pack(const TerrainVertex& vertex, const PackedVertexRange& range, float gridSpacing);
+    
+    // Position and normal as the shaders decode them (texCoord and color are
+    // not stored and left zero)
+    static TerrainVertex unpack(const PackedTerrainVertex& vertex, const PackedVertexRange& range, float gridSpacing);
+};
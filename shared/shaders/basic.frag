@@ -7,12 +7,22 @@ in vec3 Color;
 
 out vec4 FragColor;
 
-uniform vec3 lightPos;
-uniform vec3 lightColor;
-uniform vec3 viewPos;
+// Per frame, shared by all programs (FrameUniforms in frame_uniforms.h)
+layout(std140) uniform FrameData {
+    mat4 view;
+    mat4 projection;
+    mat4 model;
+    mat4 normalMatrix;      // transpose(inverse(model)), computed on the CPU
+    vec3 lightPos;
+    float time;
+    vec3 lightColor;
+    bool useLighting;
+    vec3 viewPos;
+    float globalScale;
+};
+
 uniform sampler2D texture1;
 uniform bool useTexture;
-uniform bool useLighting;
 
 void main() {
     vec3 result = Color;
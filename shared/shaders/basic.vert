@@ -8,17 +8,27 @@ layout(location = 3) in vec3 aColor;
 out vec3 FragPos;
 out vec3 Normal;
 out vec2 TexCoord;
-out vec3 Color;
+out vec3 VertexColor;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+// Per frame, shared by all programs (FrameUniforms in frame_uniforms.h)
+layout(std140) uniform FrameData {
+    mat4 view;
+    mat4 projection;
+    mat4 model;
+    mat4 normalMatrix;      // transpose(inverse(model)), computed on the CPU
+    vec3 lightPos;
+    float time;
+    vec3 lightColor;
+    bool useLighting;
+    vec3 viewPos;
+    float globalScale;
+};
 
 void main() {
     FragPos = vec3(model * vec4(aPosition, 1.0));
-    Normal = mat3(transpose(inverse(model))) * aNormal;
+    Normal = mat3(normalMatrix) * aNormal;
     TexCoord = aTexCoord;
-    Color = aColor;
+    VertexColor = aColor;
     
     gl_Position = projection * view * vec4(FragPos, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,59 @@
+#version 330 core
+
+// Decodes PackedTerrainVertex (see vertex_format.h)
+layout(location = 0) in vec2 aGrid;         // Grid coordinate relative to the patch corner
+layout(location = 1) in float aHeight;      // [0, 1] over the patch's height range
+layout(location = 2) in vec2 aOctNormal;    // Octahedral-encoded normal
+
+// Per patch: grid coordinate of the patch corner (xy), min height and extent
+// (zw). A constant attribute for single draws; indirect draws fetch it per
+// draw from an instanced array (see TerrainBatch)
+layout(location = 3) in vec4 aPatchRange;
+
+out vec3 FragPos;
+out vec3 Normal;
+out vec2 TexCoord;
+out vec3 VertexColor;
+
+// Per frame, shared by all programs (FrameUniforms in frame_uniforms.h)
+layout(std140) uniform FrameData {
+    mat4 view;
+    mat4 projection;
+    mat4 model;
+    mat4 normalMatrix;      // transpose(inverse(model)), computed on the CPU
+    vec3 lightPos;
+    float time;
+    vec3 lightColor;
+    bool useLighting;
+    vec3 viewPos;
+    float globalScale;
+};
+
+// Per terrain
+uniform float gridSpacing;
+uniform float gridSize;
+uniform float heightScale;
+
+vec3 octDecode(vec2 e) {
+    vec3 n = vec3(e.x, 1.0 - abs(e.x) - abs(e.y), e.y);
+    float fold = max(-n.y, 0.0);
+    n.x += n.x >= 0.0 ? -fold : fold;
+    n.z += n.z >= 0.0 ? -fold : fold;
+    return normalize(n);
+}
+
+void main() {
+    vec2 grid = aPatchRange.xy + aGrid;
+    float height = aPatchRange.z + aHeight * aPatchRange.w;
+    vec3 position = vec3(grid.x * gridSpacing, height, grid.y * gridSpacing);
+    
+    FragPos = vec3(model * vec4(position, 1.0));
+    Normal = mat3(normalMatrix) * octDecode(aOctNormal);
+    TexCoord = grid / gridSize;
+    
+    // Same height ramp TerrainGenerator bakes into TerrainVertex::color
+    float heightFactor = clamp((height + heightScale) / (2.0 * heightScale), 0.0, 1.0);
+    VertexColor = mix(vec3(0.2, 0.5, 0.1), vec3(0.9, 0.9, 0.7), heightFactor);
+    
+    gl_Position = projection * view * vec4(FragPos, 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,61 @@
+#version 330 core
+
+// Grid position within the patch, from the mesh all patches share (see HeightmapTerrain)
+layout(location = 0) in vec2 aGrid;
+
+// Per patch, a constant attribute: grid coordinate of the patch corner (xy)
+layout(location = 3) in vec4 aPatchRange;
+
+out vec3 FragPos;
+out vec3 Normal;
+out vec2 TexCoord;
+out vec3 VertexColor;
+
+// Per frame, shared by all programs (FrameUniforms in frame_uniforms.h)
+layout(std140) uniform FrameData {
+    mat4 view;
+    mat4 projection;
+    mat4 model;
+    mat4 normalMatrix;      // transpose(inverse(model)), computed on the CPU
+    vec3 lightPos;
+    float time;
+    vec3 lightColor;
+    bool useLighting;
+    vec3 viewPos;
+    float globalScale;
+};
+
+// Per terrain
+uniform float gridSpacing;
+uniform float gridSize;
+uniform float heightScale;
+uniform vec2 heightRange;   // Texel to height: min + texel * extent
+
+// One texel per grid point
+uniform sampler2D heightmap;
+uniform sampler2D normalmap;    // Octahedral-encoded
+
+vec3 octDecode(vec2 e) {
+    vec3 n = vec3(e.x, 1.0 - abs(e.x) - abs(e.y), e.y);
+    float fold = max(-n.y, 0.0);
+    n.x += n.x >= 0.0 ? -fold : fold;
+    n.z += n.z >= 0.0 ? -fold : fold;
+    return normalize(n);
+}
+
+void main() {
+    vec2 grid = aPatchRange.xy + aGrid;
+    ivec2 texel = ivec2(grid);
+    float height = heightRange.x + texelFetch(heightmap, texel, 0).r * heightRange.y;
+    vec3 position = vec3(grid.x * gridSpacing, height, grid.y * gridSpacing);
+    
+    FragPos = vec3(model * vec4(position, 1.0));
+    Normal = mat3(normalMatrix) * octDecode(texelFetch(normalmap, texel, 0).rg);
+    TexCoord = grid / gridSize;
+    
+    // Same height ramp TerrainGenerator bakes into TerrainVertex::color
+    float heightFactor = clamp((height + heightScale) / (2.0 * heightScale), 0.0, 1.0);
+    VertexColor = mix(vec3(0.2, 0.5, 0.1), vec3(0.9, 0.9, 0.7), heightFactor);
+    
+    gl_Position = projection * view * vec4(FragPos, 1.0);
+}
\ No newline at end of file
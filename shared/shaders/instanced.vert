@@ -1,33 +1,61 @@
 #version 330 core
 
-layout(location = 0) in vec3 aPosition;
-layout(location = 1) in vec3 aNormal;
-layout(location = 2) in vec2 aTexCoord;
-layout(location = 3) in vec3 aColor;
+// Grid position within the patch, from the mesh all instances share (see InstancedTerrain)
+layout(location = 0) in vec2 aGrid;
 
-// Instanced attributes
-layout(location = 4) in vec3 aInstancePosition;
-layout(location = 5) in float aInstanceScale;
-layout(location = 6) in vec3 aInstanceColor;
+// Per instance (TerrainInstance): patch corner in world units (xy), grid
+// spacing (z) and height layer (w)
+layout(location = 4) in vec4 aInstance;
 
 out vec3 FragPos;
 out vec3 Normal;
 out vec2 TexCoord;
 out vec3 VertexColor;
 
-uniform mat4 view;
-uniform mat4 projection;
-uniform float globalScale;
+// Per frame, shared by all programs (FrameUniforms in frame_uniforms.h)
+layout(std140) uniform FrameData {
+    mat4 view;
+    mat4 projection;
+    mat4 model;
+    mat4 normalMatrix;      // transpose(inverse(model)), computed on the CPU
+    vec3 lightPos;
+    float time;
+    vec3 lightColor;
+    bool useLighting;
+    vec3 viewPos;
+    float globalScale;
+};
+
+// Per terrain
+uniform float gridSize;
+uniform float heightScale;
+
+// One layer per patch, with a one-texel border taken from the neighbours
+uniform sampler2DArray heightmaps;
+
+float heightAt(ivec2 texel, int layer) {
+    return texelFetch(heightmaps, ivec3(texel, layer), 0).r;
+}
 
 void main() {
-    // Apply instance transformation
-    vec3 scaledPosition = aPosition * aInstanceScale * globalScale;
-    vec3 instancePosition = scaledPosition + aInstancePosition;
+    int layer = int(aInstance.w);
+    float spacing = aInstance.z;
+    ivec2 texel = ivec2(aGrid) + 1;
+    float height = heightAt(texel, layer);
+    
+    // Central differences, across patch borders through the border texels
+    float slopeX = (heightAt(texel + ivec2(1, 0), layer) - heightAt(texel - ivec2(1, 0), layer)) / (2.0 * spacing);
+    float slopeZ = (heightAt(texel + ivec2(0, 1), layer) - heightAt(texel - ivec2(0, 1), layer)) / (2.0 * spacing);
+    
+    vec3 position = vec3(aInstance.x + aGrid.x * spacing, height, aInstance.y + aGrid.y * spacing);
+    
+    // Same height ramp TerrainGenerator bakes into TerrainVertex::color
+    float heightFactor = clamp((height + heightScale) / (2.0 * heightScale), 0.0, 1.0);
     
-    FragPos = instancePosition;
-    Normal = aNormal;
-    TexCoord = aTexCoord;
-    VertexColor = aColor * aInstanceColor;
+    FragPos = position * globalScale;
+    Normal = normalize(vec3(-slopeX, 1.0, -slopeZ));
+    TexCoord = (aInstance.xy / spacing + aGrid) / gridSize;
+    VertexColor = mix(vec3(0.2, 0.5, 0.1), vec3(0.9, 0.9, 0.7), heightFactor);
     
     gl_Position = projection * view * vec4(FragPos, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,11 @@
+#version 400 core
+
+// Cell corner on the terrain grid (see TessellatedTerrain); the tessellation
+// stages do the rest
+layout(location = 0) in vec2 aGrid;
+
+out vec2 vGrid;
+
+void main() {
+    vGrid = aGrid;
+}
\ No newline at end of file
@@ -0,0 +1,69 @@
+#include "allocation_tracker.h"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#ifdef TRACK_ALLOCATIONS
+
+static std::atomic<size_t> allocationCount(0);
+static std::atomic<size_t> allocatedBytes(0);
+
+void* operator new(std::size_t size) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+    if (void* memory = std::malloc(size ? size : 1)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete[](void* memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept {
+    std::free(memory);
+}
+
+void operator delete[](void* memory, std::size_t) noexcept {
+    std::free(memory);
+}
+
+bool AllocationTracker::isEnabled() {
+    return true;
+}
+
+AllocationTracker::Counters AllocationTracker::current() {
+    Counters counters;
+    counters.allocations = allocationCount.load(std::memory_order_relaxed);
+    counters.bytes = allocatedBytes.load(std::memory_order_relaxed);
+    return counters;
+}
+
+#else
+
+bool AllocationTracker::isEnabled() {
+    return false;
+}
+
+AllocationTracker::Counters AllocationTracker::current() {
+    return Counters();
+}
+
+#endif
+
+AllocationTracker::Counters AllocationTracker::since(const Counters& start) {
+    const Counters now = current();
+    Counters delta;
+    delta.allocations = now.allocations - start.allocations;
+    delta.bytes = now.bytes - start.bytes;
+    return delta;
+}
@@ -0,0 +1,43 @@
+#include "atomic_file.h"
+#include <cstdio>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#endif
+
+// POSIX rename() replaces the target atomically; Windows' does not replace
+// at all
+static bool replaceFile(const std::string& from, const std::string& to) {
+#ifdef _WIN32
+    return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    return std::rename(from.c_str(), to.c_str()) == 0;
+#endif
+}
+
+AtomicFileWriter::AtomicFileWriter(const std::string& path)
+    : path_(path), tempPath_(path + ".tmp"), out_(tempPath_, std::ios::binary | std::ios::trunc) {
+}
+
+AtomicFileWriter::~AtomicFileWriter() {
+    if (!committed_) {
+        out_.close();
+        std::remove(tempPath_.c_str());
+    }
+}
+
+bool AtomicFileWriter::commit() {
+    if (!out_.is_open()) {
+        return false;
+    }
+    
+    out_.close();
+    if (!out_ || !replaceFile(tempPath_, path_)) {
+        return false;
+    }
+    committed_ = true;
+    return true;
+}
@@ -0,0 +1,76 @@
+#include "command_list.h"
+#include "gl_state.h"
+#include "vertex_format.h"
+
+void CommandListStats::add(const CommandListStats& other) {
+    drawCalls += other.drawCalls;
+    triangles += other.triangles;
+    vertices += other.vertices;
+    fullDetailTriangles += other.fullDetailTriangles;
+    vertexTransforms += other.vertexTransforms;
+    indexBytes += other.indexBytes;
+    listIndexBytes += other.listIndexBytes;
+    culledPatches += other.culledPatches;
+}
+
+void CommandList::clear() {
+    commands_.clear();
+    stats_ = CommandListStats();
+    lastVertexArray_ = ~0u;
+    lastRestartIndex_ = ~0u;
+}
+
+RenderCommand& CommandList::append(RenderCommandType type) {
+    commands_.emplace_back();   // Value-initialized
+    commands_.back().type = type;
+    return commands_.back();
+}
+
+void CommandList::bindVertexArray(GLuint vao) {
+    if (vao == lastVertexArray_) {
+        return;
+    }
+    lastVertexArray_ = vao;
+    append(RenderCommandType::BindVertexArray).object = vao;
+}
+
+void CommandList::primitiveRestartIndex(GLuint index) {
+    if (index == lastRestartIndex_) {
+        return;
+    }
+    lastRestartIndex_ = index;
+    append(RenderCommandType::PrimitiveRestartIndex).object = index;
+}
+
+void CommandList::patchRange(const glm::vec4& range) {
+    append(RenderCommandType::PatchRange).values = range;
+}
+
+void CommandList::drawElements(GLenum mode, GLsizei count, GLenum indexType, uint64_t offset) {
+    RenderCommand& command = append(RenderCommandType::DrawElements);
+    command.mode = mode;
+    command.count = count;
+    command.indexType = indexType;
+    command.offset = offset;
+}
+
+void CommandList::replay() const {
+    for (const RenderCommand& command : commands_) {
+        switch (command.type) {
+            case RenderCommandType::BindVertexArray:
+                GLState::bindVertexArray(command.object);
+                break;
+            case RenderCommandType::PrimitiveRestartIndex:
+                GLState::primitiveRestartIndex(command.object);
+                break;
+            case RenderCommandType::PatchRange:
+                glVertexAttrib4f(VertexFormats::PATCH_RANGE_ATTRIBUTE, command.values.x, command.values.y,
+                                 command.values.z, command.values.w);
+                break;
+            case RenderCommandType::DrawElements:
+                glDrawElements(command.mode, command.count, command.indexType,
+                               reinterpret_cast<const void*>(static_cast<uintptr_t>(command.offset)));
+                break;
+        }
+    }
+}
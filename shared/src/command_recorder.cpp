@@ -0,0 +1,212 @@
+#include "command_recorder.h"
+#include <algorithm>
+#include "terrain_lod.h"
+
+CommandRecorder::CommandRecorder(int threads)
+    : grid_(nullptr), pass_(Pass::Select), passIndex_(0), busyWorkers_(0), nextRange_(0), stopping_(false) {
+    if (threads <= 0) {
+        threads = static_cast<int>(std::thread::hardware_concurrency());
+    }
+    threads = std::max(1, threads);
+    lists_.resize(threads);
+    order_.resize(threads);
+    
+    for (int i = 1; i < threads; i++) {
+        workers_.emplace_back(&CommandRecorder::workerLoop, this);
+    }
+}
+
+CommandRecorder::~CommandRecorder() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    startCondition_.notify_all();
+    for (auto& worker : workers_) {
+        worker.join();
+    }
+}
+
+void CommandRecorder::record(const std::vector<const TerrainPatch*>& grid, int columns, const RecordView& view) {
+    grid_ = &grid;
+    view_ = view;
+    
+    // Frustum planes (inward normals) from the rows of the view-projection matrix
+    const glm::mat4& m = view.viewProjection;
+    const glm::vec4 rows[4] = {
+        glm::vec4(m[0][0], m[1][0], m[2][0], m[3][0]), glm::vec4(m[0][1], m[1][1], m[2][1], m[3][1]),
+        glm::vec4(m[0][2], m[1][2], m[2][2], m[3][2]), glm::vec4(m[0][3], m[1][3], m[2][3], m[3][3])
+    };
+    for (int i = 0; i < 3; i++) {
+        frustumPlanes_[i * 2] = rows[3] + rows[i];
+        frustumPlanes_[i * 2 + 1] = rows[3] - rows[i];
+    }
+    for (glm::vec4& plane : frustumPlanes_) {
+        plane = plane / std::max(glm::length(glm::vec3(plane.x, plane.y, plane.z)), 1e-6f);
+    }
+    
+    const size_t cells = grid.size();
+    levels_.assign(cells, 0);
+    stitchMasks_.assign(cells, 0);
+    visible_.assign(cells, 1);
+    
+    runPass(Pass::Select);
+    if (view.lodTolerance > 0.0f) {
+        TerrainLod::constrainGridLevels(grid, columns, levels_, stitchMasks_);
+    }
+    runPass(Pass::Record);
+}
+
+void CommandRecorder::replay() const {
+    for (const CommandList& list : lists_) {
+        list.replay();
+    }
+}
+
+CommandListStats CommandRecorder::getStats() const {
+    CommandListStats stats;
+    for (const CommandList& list : lists_) {
+        stats.add(list.getStats());
+    }
+    return stats;
+}
+
+size_t CommandRecorder::getCommandCount() const {
+    size_t count = 0;
+    for (const CommandList& list : lists_) {
+        count += list.size();
+    }
+    return count;
+}
+
+void CommandRecorder::workerLoop() {
+    uint64_t lastPass = 0;
+    while (true) {
+        Pass pass;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            startCondition_.wait(lock, [&] { return stopping_ || passIndex_ != lastPass; });
+            if (stopping_) {
+                return;
+            }
+            lastPass = passIndex_;
+            pass = pass_;
+        }
+        
+        runRanges(pass);
+        
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            busyWorkers_--;
+        }
+        doneCondition_.notify_one();
+    }
+}
+
+void CommandRecorder::runPass(Pass pass) {
+    // Every worker joins every pass, so none can still be in the previous one
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pass_ = pass;
+        nextRange_ = 0;
+        busyWorkers_ = static_cast<int>(workers_.size());
+        passIndex_++;
+    }
+    startCondition_.notify_all();
+    
+    runRanges(pass);
+    
+    std::unique_lock<std::mutex> lock(mutex_);
+    doneCondition_.wait(lock, [this] { return busyWorkers_ == 0; });
+}
+
+void CommandRecorder::runRanges(Pass pass) {
+    const int ranges = static_cast<int>(lists_.size());
+    for (int range = nextRange_++; range < ranges; range = nextRange_++) {
+        if (pass == Pass::Select) {
+            selectRange(range);
+        } else {
+            recordRange(range);
+        }
+    }
+}
+
+void CommandRecorder::selectRange(int range) {
+    const std::vector<const TerrainPatch*>& grid = *grid_;
+    const size_t ranges = lists_.size();
+    const size_t begin = grid.size() * range / ranges;
+    const size_t end = grid.size() * (range + 1) / ranges;
+    
+    // LOD in the patches' unscaled space, like culling and sorting in scaled
+    // space: the screen-space error is the same under a uniform scale
+    const glm::vec3 lodCamera = view_.cameraPos / view_.scale;
+    for (size_t i = begin; i < end; i++) {
+        if (!grid[i]) {
+            continue;
+        }
+        levels_[i] = TerrainLod::selectLevel(*grid[i], lodCamera, view_.pixelScale, view_.lodTolerance);
+        visible_[i] = !view_.cull || isVisible(*grid[i]);
+    }
+}
+
+void CommandRecorder::recordRange(int range) {
+    const std::vector<const TerrainPatch*>& grid = *grid_;
+    const size_t ranges = lists_.size();
+    const size_t begin = grid.size() * range / ranges;
+    const size_t end = grid.size() * (range + 1) / ranges;
+    CommandList& list = lists_[range];
+    CommandListStats& stats = list.getStats();
+    list.clear();
+    
+    // Front to back within the range, so the depth test rejects more fragments
+    std::vector<std::pair<float, int>>& order = order_[range];
+    order.clear();
+    for (size_t i = begin; i < end; i++) {
+        if (!grid[i]) {
+            continue;
+        }
+        if (!visible_[i]) {
+            stats.culledPatches++;
+            continue;
+        }
+        const glm::vec3 offset = grid[i]->center * view_.scale - view_.cameraPos;
+        order.emplace_back(glm::dot(offset, offset), static_cast<int>(i));
+    }
+    std::sort(order.begin(), order.end());
+    
+    for (const auto& entry : order) {
+        const int i = entry.second;
+        const TerrainPatch& patch = *grid[i];
+        const PatchTopology& topology = *patch.topology;
+        const PatchLod& lod = patch.lodRange(levels_[i], stitchMasks_[i]);
+        
+        if (patch.isUploaded) {
+            list.primitiveRestartIndex(topology.getRestartIndex());
+            if (patch.vertexFormat() == VertexFormat::Packed) {
+                list.patchRange(VertexFormats::patchRange(patch.packedRange));
+            }
+            list.bindVertexArray(patch.VAO);
+            list.drawElements(topology.getPrimitiveMode(), lod.indexCount, topology.getIndexType(),
+                              static_cast<uint64_t>(lod.firstIndex) * topology.getIndexSize());
+        }
+        
+        stats.drawCalls++;
+        stats.triangles += lod.triangleCount;
+        stats.vertices += static_cast<int>(patch.vertexCount());
+        stats.fullDetailTriangles += patch.fullDetailTriangleCount();
+        stats.vertexTransforms += lod.vertexTransforms;
+        stats.indexBytes += static_cast<long long>(lod.indexCount) * topology.getIndexSize();
+        stats.listIndexBytes += static_cast<long long>(lod.triangleCount) * 3 * sizeof(unsigned int);
+    }
+}
+
+bool CommandRecorder::isVisible(const TerrainPatch& patch) const {
+    const glm::vec3 center = patch.center * view_.scale;
+    const float radius = patch.boundingRadius * view_.scale;
+    for (const glm::vec4& plane : frustumPlanes_) {
+        if (plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w < -radius) {
+            return false;
+        }
+    }
+    return true;
+}
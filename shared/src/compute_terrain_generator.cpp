@@ -0,0 +1,170 @@
+#include "compute_terrain_generator.h"
+#include "gl_state.h"
+#include <algorithm>
+#include <iostream>
+#include <vector>
+#include "performance_monitor.h"
+
+bool ComputeTerrainGenerator::isSupported() {
+    return GLEW_VERSION_4_3 || (GLEW_ARB_compute_shader && GLEW_ARB_shader_storage_buffer_object);
+}
+
+size_t ComputeTerrainGenerator::getVertexBytes(const TerrainGenerator& generator) {
+    const int patchesPerRow = generator.getPatchesPerRow();
+    const int verticesPerRow = generator.getGridSize() / std::max(patchesPerRow, 1) + 1;
+    return static_cast<size_t>(patchesPerRow) * patchesPerRow * verticesPerRow * verticesPerRow *
+           VertexFormats::stride(VertexFormat::Float);
+}
+
+ComputeTerrainGenerator::~ComputeTerrainGenerator() {
+    release();
+}
+
+bool ComputeTerrainGenerator::initialize() {
+    release();
+    if (!isSupported()) {
+        return false;
+    }
+    
+    shader_.loadCompute(COMPUTE_SHADER);
+    if (!shader_.isValid()) {
+        return false;
+    }
+    
+    GLuint buffers[5];
+    glGenBuffers(5, buffers);
+    heightBuffer_ = buffers[0];
+    slopeXBuffer_ = buffers[1];
+    slopeZBuffer_ = buffers[2];
+    permutationBuffer_ = buffers[3];
+    slotBuffer_ = buffers[4];
+    return true;
+}
+
+void ComputeTerrainGenerator::release() {
+    if (heightBuffer_ != 0) {
+        for (GLuint buffer : { heightBuffer_, slopeXBuffer_, slopeZBuffer_, permutationBuffer_, slotBuffer_ }) {
+            GLState::deleteBuffer(buffer);
+        }
+        heightBuffer_ = 0;
+        slopeXBuffer_ = 0;
+        slopeZBuffer_ = 0;
+        permutationBuffer_ = 0;
+        slotBuffer_ = 0;
+    }
+    shader_.dispose();
+    heightCapacity_ = 0;
+    slopeXCapacity_ = 0;
+    slopeZCapacity_ = 0;
+    scratchBytes_ = 0;
+}
+
+void ComputeTerrainGenerator::reserve(GLuint& buffer, size_t& capacity, size_t bytes) {
+    if (capacity < bytes) {
+        GLState::bindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, bytes, nullptr, GL_DYNAMIC_COPY);
+        capacity = bytes;
+    }
+}
+
+bool ComputeTerrainGenerator::generate(const TerrainGenerator& generator, GLuint vertexBuffer) {
+    const int patchesPerRow = generator.getPatchesPerRow();
+    const int quadsPerPatch = generator.getGridSize() / std::max(patchesPerRow, 1);
+    if (!isInitialized() || patchesPerRow < 1 || quadsPerPatch < 1) {
+        return false;
+    }
+    
+    const int subdivisions = generator.getHeightfieldSubdivisions();
+    const int heightfieldSize = generator.getGridSize() * subdivisions + 1;
+    const size_t heightfieldBytes = static_cast<size_t>(heightfieldSize) * heightfieldSize * sizeof(float);
+    const int verticesPerRow = quadsPerPatch + 1;
+    const size_t patchBytes = static_cast<size_t>(verticesPerRow) * verticesPerRow * VertexFormats::stride(VertexFormat::Float);
+    const bool gradient = generator.getNoiseBackend() == NoiseBackend::Gradient;
+    const bool analytic = gradient && generator.getAnalyticNormals();
+    
+    // Patches are written in batches that fit one storage block binding,
+    // which need only be 16 MB
+    GLint64 maxBlockSize = 0;
+    GLint alignment = 1;
+    GLint maxGroups = 0;
+    glGetInteger64v(GL_MAX_SHADER_STORAGE_BLOCK_SIZE, &maxBlockSize);
+    glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    glGetIntegeri_v(GL_MAX_COMPUTE_WORK_GROUP_COUNT, 2, &maxGroups);
+    const size_t maxBlock = static_cast<size_t>(maxBlockSize);
+    if (heightfieldBytes > maxBlock || patchBytes + alignment > maxBlock) {
+        std::cerr << "Compute terrain generation: the heightfield (" << PerformanceMonitor::formatBytes(heightfieldBytes)
+                  << ") or a patch (" << PerformanceMonitor::formatBytes(patchBytes) << ") exceeds the "
+                  << PerformanceMonitor::formatBytes(maxBlock) << " storage block limit" << std::endl;
+        return false;
+    }
+    
+    reserve(heightBuffer_, heightCapacity_, heightfieldBytes);
+    reserve(slopeXBuffer_, slopeXCapacity_, analytic ? heightfieldBytes : sizeof(float));
+    reserve(slopeZBuffer_, slopeZCapacity_, analytic ? heightfieldBytes : sizeof(float));
+    scratchBytes_ = heightCapacity_ + slopeXCapacity_ + slopeZCapacity_;
+    
+    // The noise's permutation table and the topology's vertex order
+    const NoiseBatchParams params = generator.heightParams();
+    GLState::bindBuffer(GL_SHADER_STORAGE_BUFFER, permutationBuffer_);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, 512 * sizeof(int), params.permutation, GL_STATIC_DRAW);
+    const std::shared_ptr<const PatchTopology> topology = PatchTopology::get(quadsPerPatch, generator.getPrimitive());
+    std::vector<GLuint> slots(static_cast<size_t>(verticesPerRow) * verticesPerRow);
+    for (size_t i = 0; i < slots.size(); i++) {
+        slots[i] = topology->vertexSlot(static_cast<int>(i));
+    }
+    GLState::bindBuffer(GL_SHADER_STORAGE_BUFFER, slotBuffer_);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, slots.size() * sizeof(GLuint), slots.data(), GL_STATIC_DRAW);
+    
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, heightBuffer_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, slopeXBuffer_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, slopeZBuffer_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, permutationBuffer_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, slotBuffer_);
+    
+    // Callers may be mid-frame with their draw program bound; it is bound
+    // again when the dispatches are issued
+    GLint previousProgram = 0;
+    glGetIntegerv(GL_CURRENT_PROGRAM, &previousProgram);
+    shader_.use();
+    shader_.setInt("gradientNoise", gradient ? 1 : 0);
+    shader_.setInt("analyticNormals", analytic ? 1 : 0);
+    shader_.setInt("octaves", params.octaves);
+    shader_.setFloat("persistence", params.persistence);
+    shader_.setFloat("inputScale", params.inputScale);
+    shader_.setFloat("outputScale", params.outputScale);
+    shader_.setInt("heightfieldSize", heightfieldSize);
+    shader_.setInt("subdivisions", subdivisions);
+    shader_.setFloat("patchSize", generator.getPatchSize());
+    shader_.setFloat("heightScale", generator.getHeightScale());
+    shader_.setInt("gridSize", generator.getGridSize());
+    shader_.setInt("quadsPerPatch", quadsPerPatch);
+    shader_.setInt("patchesPerRow", patchesPerRow);
+    
+    // Work groups are 8x8 invocations
+    auto groups = [](int invocations) { return static_cast<GLuint>((invocations + 7) / 8); };
+    
+    shader_.setInt("stage", 0);
+    glDispatchCompute(groups(heightfieldSize), groups(heightfieldSize), 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    
+    // One work group layer per patch
+    shader_.setInt("stage", 1);
+    const int patchCount = patchesPerRow * patchesPerRow;
+    const int batchPatches = static_cast<int>(std::min<size_t>((maxBlock - alignment) / patchBytes,
+                                                               static_cast<size_t>(std::max(maxGroups, 1))));
+    for (int first = 0; first < patchCount; first += batchPatches) {
+        const int count = std::min(batchPatches, patchCount - first);
+        const size_t offset = first * patchBytes;
+        const size_t boundOffset = offset / alignment * alignment;
+        glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 0, vertexBuffer, static_cast<GLintptr>(boundOffset),
+                          static_cast<GLsizeiptr>(offset - boundOffset + count * patchBytes));
+        shader_.setInt("firstPatch", first);
+        shader_.setInt("baseFloat", static_cast<int>((offset - boundOffset) / sizeof(float)));
+        glDispatchCompute(groups(verticesPerRow), groups(verticesPerRow), static_cast<GLuint>(count));
+    }
+    
+    // For drawing from the buffer and for reading it back
+    glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+    GLState::useProgram(static_cast<GLuint>(previousProgram));
+    return true;
+}
\ No newline at end of file
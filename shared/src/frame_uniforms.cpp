@@ -0,0 +1,30 @@
+#include "frame_uniforms.h"
+#include "gl_state.h"
+
+glm::mat4 FrameUniformBuffer::normalMatrixOf(const glm::mat4& model) {
+    return glm::mat4(glm::transpose(glm::inverse(glm::mat3(model))));
+}
+
+FrameUniformBuffer::~FrameUniformBuffer() {
+    release();
+}
+
+void FrameUniformBuffer::create() {
+    release();
+    glGenBuffers(1, &buffer_);
+    GLState::bindBuffer(GL_UNIFORM_BUFFER, buffer_);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniforms), nullptr, GL_DYNAMIC_DRAW);
+    glBindBufferBase(GL_UNIFORM_BUFFER, BINDING, buffer_);
+}
+
+void FrameUniformBuffer::release() {
+    if (buffer_ != 0) {
+        GLState::deleteBuffer(buffer_);
+        buffer_ = 0;
+    }
+}
+
+void FrameUniformBuffer::update(const FrameUniforms& uniforms) {
+    GLState::bindBuffer(GL_UNIFORM_BUFFER, buffer_);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameUniforms), &uniforms);
+}
@@ -0,0 +1,196 @@
+#include "gl_state.h"
+
+static constexpr GLuint UNKNOWN = ~0u;
+
+// Buffer targets with a cached binding
+static constexpr GLenum BUFFER_TARGETS[] = {
+    GL_ARRAY_BUFFER, GL_UNIFORM_BUFFER, GL_DRAW_INDIRECT_BUFFER, GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER
+};
+static constexpr int BUFFER_TARGET_COUNT = sizeof(BUFFER_TARGETS) / sizeof(BUFFER_TARGETS[0]);
+
+// Capabilities with a cached enable; others are passed through
+static constexpr GLenum CAPABILITIES[] = {
+    GL_DEPTH_TEST, GL_PRIMITIVE_RESTART, GL_CULL_FACE, GL_BLEND
+};
+static constexpr int CAPABILITY_COUNT = sizeof(CAPABILITIES) / sizeof(CAPABILITIES[0]);
+
+enum class Known : unsigned char { Unknown, Off, On };
+
+struct ShadowState {
+    GLuint program = UNKNOWN;
+    GLuint vertexArray = UNKNOWN;
+    GLuint buffers[BUFFER_TARGET_COUNT];
+    Known capabilities[CAPABILITY_COUNT];
+    GLenum polygonMode = UNKNOWN;
+    GLenum depthFunc = UNKNOWN;
+    Known depthMask = Known::Unknown;
+    bool clearColorKnown = false;
+    glm::vec4 clearColor = glm::vec4(0.0f);
+    GLuint restartIndex = UNKNOWN;
+    GLStateStats stats;
+    
+    ShadowState() { reset(); }
+    
+    void reset() {
+        program = vertexArray = UNKNOWN;
+        for (GLuint& buffer : buffers) {
+            buffer = UNKNOWN;
+        }
+        for (Known& capability : capabilities) {
+            capability = Known::Unknown;
+        }
+        polygonMode = depthFunc = UNKNOWN;
+        depthMask = Known::Unknown;
+        clearColorKnown = false;
+        restartIndex = UNKNOWN;
+    }
+};
+
+static thread_local ShadowState state;
+
+static int bufferSlot(GLenum target) {
+    for (int i = 0; i < BUFFER_TARGET_COUNT; i++) {
+        if (BUFFER_TARGETS[i] == target) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int capabilitySlot(GLenum capability) {
+    for (int i = 0; i < CAPABILITY_COUNT; i++) {
+        if (CAPABILITIES[i] == capability) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Records value as current; returns false (counting a filtered call) if it
+// already was
+template <typename T>
+static bool change(T& current, const T& value) {
+    if (current == value) {
+        state.stats.filtered++;
+        return false;
+    }
+    current = value;
+    state.stats.issued++;
+    return true;
+}
+
+void GLState::useProgram(GLuint program) {
+    if (change(state.program, program)) {
+        glUseProgram(program);
+    }
+}
+
+void GLState::bindVertexArray(GLuint vao) {
+    if (change(state.vertexArray, vao)) {
+        glBindVertexArray(vao);
+    }
+}
+
+void GLState::bindBuffer(GLenum target, GLuint buffer) {
+    const int slot = bufferSlot(target);
+    if (slot < 0) {
+        state.stats.issued++;
+        glBindBuffer(target, buffer);
+    } else if (change(state.buffers[slot], buffer)) {
+        glBindBuffer(target, buffer);
+    }
+}
+
+void GLState::enable(GLenum capability) {
+    const int slot = capabilitySlot(capability);
+    if (slot < 0) {
+        state.stats.issued++;
+        glEnable(capability);
+    } else if (change(state.capabilities[slot], Known::On)) {
+        glEnable(capability);
+    }
+}
+
+void GLState::disable(GLenum capability) {
+    const int slot = capabilitySlot(capability);
+    if (slot < 0) {
+        state.stats.issued++;
+        glDisable(capability);
+    } else if (change(state.capabilities[slot], Known::Off)) {
+        glDisable(capability);
+    }
+}
+
+void GLState::polygonMode(GLenum mode) {
+    if (change(state.polygonMode, mode)) {
+        glPolygonMode(GL_FRONT_AND_BACK, mode);
+    }
+}
+
+void GLState::depthFunc(GLenum func) {
+    if (change(state.depthFunc, func)) {
+        glDepthFunc(func);
+    }
+}
+
+void GLState::depthMask(bool write) {
+    if (change(state.depthMask, write ? Known::On : Known::Off)) {
+        glDepthMask(write ? GL_TRUE : GL_FALSE);
+    }
+}
+
+void GLState::clearColor(const glm::vec4& color) {
+    if (state.clearColorKnown && state.clearColor.x == color.x && state.clearColor.y == color.y &&
+        state.clearColor.z == color.z && state.clearColor.w == color.w) {
+        state.stats.filtered++;
+        return;
+    }
+    state.clearColorKnown = true;
+    state.clearColor = color;
+    state.stats.issued++;
+    glClearColor(color.x, color.y, color.z, color.w);
+}
+
+void GLState::primitiveRestartIndex(GLuint index) {
+    if (change(state.restartIndex, index)) {
+        glPrimitiveRestartIndex(index);
+    }
+}
+
+void GLState::deleteProgram(GLuint program) {
+    // A current program stays in use (and its name taken) until replaced
+    glDeleteProgram(program);
+}
+
+void GLState::deleteVertexArray(GLuint vao) {
+    glDeleteVertexArrays(1, &vao);
+    if (vao != 0 && state.vertexArray == vao) {
+        state.vertexArray = 0;
+    }
+}
+
+void GLState::deleteBuffer(GLuint buffer) {
+    glDeleteBuffers(1, &buffer);
+    if (buffer == 0) {
+        return;
+    }
+    for (GLuint& bound : state.buffers) {
+        if (bound == buffer) {
+            bound = 0;
+        }
+    }
+}
+
+void GLState::invalidate() {
+    state.reset();
+}
+
+GLStateStats GLState::getStats() {
+    return state.stats;
+}
+
+GLStateStats GLState::takeStats() {
+    const GLStateStats stats = state.stats;
+    state.stats = GLStateStats();
+    return stats;
+}
@@ -1,4 +1,5 @@
 #include "gl_utils.h"
+#include "gl_state.h"
 #include <fstream>
 #include <sstream>
 #include <iostream>
@@ -15,106 +16,147 @@ Shader::~Shader() {
 
 void Shader::load(const std::string& vertexPath, const std::string& fragmentPath) {
     // Clean up existing shader
-    if (program != 0) {
-        glDeleteProgram(program);
-    }
+    dispose();
     
-    // Load shader sources
-    std::string vertexSource = loadShaderSource(vertexPath);
-    std::string fragmentSource = loadShaderSource(fragmentPath);
+    build({ { GL_VERTEX_SHADER, loadShaderSource(vertexPath) },
+            { GL_FRAGMENT_SHADER, loadShaderSource(fragmentPath) } });
+}
+
+void Shader::load(const std::string& vertexPath, const std::string& tessControlPath,
+                  const std::string& tessEvaluationPath, const std::string& fragmentPath) {
+    dispose();
     
-    // Compile shaders
-    GLuint vertexShader = compileShader(vertexSource, GL_VERTEX_SHADER);
-    GLuint fragmentShader = compileShader(fragmentSource, GL_FRAGMENT_SHADER);
+    build({ { GL_VERTEX_SHADER, loadShaderSource(vertexPath) },
+            { GL_TESS_CONTROL_SHADER, loadShaderSource(tessControlPath) },
+            { GL_TESS_EVALUATION_SHADER, loadShaderSource(tessEvaluationPath) },
+            { GL_FRAGMENT_SHADER, loadShaderSource(fragmentPath) } });
+}
+
+void Shader::loadCompute(const std::string& computePath) {
+    dispose();
     
-    // Create and link program
-    program = glCreateProgram();
-    glAttachShader(program, vertexShader);
-    glAttachShader(program, fragmentShader);
-    glLinkProgram(program);
+    build({ { GL_COMPUTE_SHADER, loadShaderSource(computePath) } });
+}
+
+void Shader::loadAsync(ShaderCompiler& compiler, const std::string& vertexPath, const std::string& fragmentPath,
+                       ReadyCallback onReady) {
+    dispose();
     
-    // Check linking errors
-    GLint success;
-    glGetProgramiv(program, GL_LINK_STATUS, &success);
-    if (!success) {
-        GLchar infoLog[512];
-        glGetProgramInfoLog(program, 512, nullptr, infoLog);
-        std::cerr << "Shader linking failed:\n" << infoLog << std::endl;
-        program = 0;
+    pending_ = compiler.build({ { GL_VERTEX_SHADER, loadShaderSource(vertexPath) },
+                                { GL_FRAGMENT_SHADER, loadShaderSource(fragmentPath) } });
+    onReady_ = std::move(onReady);
+}
+
+void Shader::loadAsync(ShaderCompiler& compiler, const std::string& vertexPath, const std::string& tessControlPath,
+                       const std::string& tessEvaluationPath, const std::string& fragmentPath, ReadyCallback onReady) {
+    dispose();
+    
+    pending_ = compiler.build({ { GL_VERTEX_SHADER, loadShaderSource(vertexPath) },
+                                { GL_TESS_CONTROL_SHADER, loadShaderSource(tessControlPath) },
+                                { GL_TESS_EVALUATION_SHADER, loadShaderSource(tessEvaluationPath) },
+                                { GL_FRAGMENT_SHADER, loadShaderSource(fragmentPath) } });
+    onReady_ = std::move(onReady);
+}
+
+void Shader::build(const ShaderStages& stages) {
+    program = ShaderCompiler::buildNow(stages);
+}
+
+void Shader::wait() const {
+    if (!pending_.valid()) {
+        return;
     }
     
-    // Clean up individual shaders
-    glDeleteShader(vertexShader);
-    glDeleteShader(fragmentShader);
+    program = pending_.get();
+    pending_ = std::shared_future<GLuint>();
+    
+    // Cleared first: the callback uses the shader, which must not wait again
+    ReadyCallback onReady = std::move(onReady_);
+    onReady_ = nullptr;
+    if (onReady) {
+        // The callback may bind this program in the middle of someone else's
+        // draws; they keep the program they had bound
+        GLint previous = 0;
+        glGetIntegerv(GL_CURRENT_PROGRAM, &previous);
+        onReady(*this);
+        GLState::useProgram(static_cast<GLuint>(previous));
+    }
 }
 
 void Shader::use() const {
-    if (program != 0) {
-        glUseProgram(program);
+    if (isValid()) {
+        GLState::useProgram(program);
     }
 }
 
 void Shader::dispose() {
+    // A build in flight is waited for so that its program can be deleted
+    onReady_ = nullptr;
+    wait();
     if (program != 0) {
-        glDeleteProgram(program);
+        GLState::deleteProgram(program);
         program = 0;
     }
+    uniformLocations_.clear();
 }
 
-void Shader::setInt(const std::string& name, int value) const {
-    if (program != 0) {
-        glUniform1i(glGetUniformLocation(program, name.c_str()), value);
+GLint Shader::getUniformLocation(const char* name) const {
+    if (!isValid()) {
+        return -1;
+    }
+    
+    auto it = uniformLocations_.find(name);
+    if (it == uniformLocations_.end()) {
+        it = uniformLocations_.emplace(name, glGetUniformLocation(program, name)).first;
     }
+    return it->second;
 }
 
-void Shader::setFloat(const std::string& name, float value) const {
-    if (program != 0) {
-        glUniform1f(glGetUniformLocation(program, name.c_str()), value);
+void Shader::setInt(const char* name, int value) const {
+    if (isValid()) {
+        glUniform1i(getUniformLocation(name), value);
     }
 }
 
-void Shader::setVec2(const std::string& name, const glm::vec2& value) const {
-    if (program != 0) {
-        glUniform2fv(glGetUniformLocation(program, name.c_str()), 1, &value[0]);
+void Shader::setFloat(const char* name, float value) const {
+    if (isValid()) {
+        glUniform1f(getUniformLocation(name), value);
     }
 }
 
-void Shader::setVec3(const std::string& name, const glm::vec3& value) const {
-    if (program != 0) {
-        glUniform3fv(glGetUniformLocation(program, name.c_str()), 1, &value[0]);
+void Shader::setVec2(const char* name, const glm::vec2& value) const {
+    if (isValid()) {
+        glUniform2fv(getUniformLocation(name), 1, &value[0]);
     }
 }
 
-void Shader::setVec4(const std::string& name, const glm::vec4& value) const {
-    if (program != 0) {
-        glUniform4fv(glGetUniformLocation(program, name.c_str()), 1, &value[0]);
+void Shader::setVec3(const char* name, const glm::vec3& value) const {
+    if (isValid()) {
+        glUniform3fv(getUniformLocation(name), 1, &value[0]);
     }
 }
 
-void Shader::setMat4(const std::string& name, const glm::mat4& value) const {
-    if (program != 0) {
-        glUniformMatrix4fv(glGetUniformLocation(program, name.c_str()), 1, GL_FALSE, &value[0][0]);
+void Shader::setVec4(const char* name, const glm::vec4& value) const {
+    if (isValid()) {
+        glUniform4fv(getUniformLocation(name), 1, &value[0]);
     }
 }
 
-GLuint Shader::compileShader(const std::string& source, GLenum type) {
-    GLuint shader = glCreateShader(type);
-    const char* sourcePtr = source.c_str();
-    glShaderSource(shader, 1, &sourcePtr, nullptr);
-    glCompileShader(shader);
-    
-    // Check compilation errors
-    GLint success;
-    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        GLchar infoLog[512];
-        glGetShaderInfoLog(shader, 512, nullptr, infoLog);
-        std::cerr << "Shader compilation failed:\n" << infoLog << std::endl;
-        glDeleteShader(shader);
-        return 0;
+void Shader::setMat4(const char* name, const glm::mat4& value) const {
+    if (isValid()) {
+        glUniformMatrix4fv(getUniformLocation(name), 1, GL_FALSE, &value[0][0]);
+    }
+}
+
+void Shader::bindUniformBlock(const char* name, GLuint binding) const {
+    if (!isValid()) {
+        return;
     }
     
-    return shader;
+    const GLuint index = glGetUniformBlockIndex(program, name);
+    if (index != GL_INVALID_INDEX) {
+        glUniformBlockBinding(program, index, binding);
+    }
 }
 
 std::string Shader::loadShaderSource(const std::string& filePath) {
@@ -226,7 +268,7 @@ GLuint GLUtils::createVAO() {
 
 void GLUtils::deleteVAO(GLuint vao) {
     if (vao != 0) {
-        glDeleteVertexArrays(1, &vao);
+        GLState::deleteVertexArray(vao);
     }
 }
 
@@ -238,7 +280,7 @@ GLuint GLUtils::createVBO() {
 
 void GLUtils::deleteVBO(GLuint vbo) {
     if (vbo != 0) {
-        glDeleteBuffers(1, &vbo);
+        GLState::deleteBuffer(vbo);
     }
 }
 
@@ -250,7 +292,7 @@ GLuint GLUtils::createEBO() {
 
 void GLUtils::deleteEBO(GLuint ebo) {
     if (ebo != 0) {
-        glDeleteBuffers(1, &ebo);
+        GLState::deleteBuffer(ebo);
     }
 }
 
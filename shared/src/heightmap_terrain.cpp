@@ -0,0 +1,209 @@
+#include "heightmap_terrain.h"
+#include "gl_state.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include "performance_monitor.h"
+
+HeightmapTerrain::~HeightmapTerrain() {
+    release();
+}
+
+bool HeightmapTerrain::upload(const TerrainGenerator& generator, bool compactHeights, bool* newElementBuffer) {
+    release();
+    
+    const std::vector<TerrainPatch>& patches = generator.getPatches();
+    if (patches.empty() || generator.getHeightfield().empty()) {
+        return false;
+    }
+    for (const auto& patch : patches) {
+        if (patch.topology != patches.front().topology) {
+            std::cerr << "Heightmap terrain needs patches of a single resolution" << std::endl;
+            return false;
+        }
+    }
+    
+    topology_ = patches.front().topology;
+    firstPatch_ = &patches.front();
+    compactHeights_ = compactHeights;
+    textureSize_ = generator.getGridSize() + 1;
+    
+    const float spacing = generator.getPatchSize();
+    patchCorners_.resize(patches.size());
+    for (size_t i = 0; i < patches.size(); i++) {
+        const glm::vec3& corner = patches[i].vertexData()[topology_->vertexSlot(0)].position;
+        patchCorners_[i] = glm::vec2(std::round(corner.x / spacing), std::round(corner.z / spacing));
+    }
+    
+    // R16 spans the heights of the grid points; floats are stored as is
+    heightRange_ = glm::vec2(0.0f, 1.0f);
+    if (compactHeights_) {
+        float minHeight = generator.gridHeight(0, 0);
+        float maxHeight = minHeight;
+        for (int z = 0; z < textureSize_; z++) {
+            for (int x = 0; x < textureSize_; x++) {
+                const float height = generator.gridHeight(x, z);
+                minHeight = std::min(minHeight, height);
+                maxHeight = std::max(maxHeight, height);
+            }
+        }
+        heightRange_ = glm::vec2(minHeight, std::max(maxHeight - minHeight, 1e-6f));
+    }
+    
+    const std::vector<GLushort> mesh = topology_->gridMesh();
+    glGenVertexArrays(1, &vao_);
+    glGenBuffers(1, &meshBuffer_);
+    GLState::bindVertexArray(vao_);
+    GLState::bindBuffer(GL_ARRAY_BUFFER, meshBuffer_);
+    glBufferData(GL_ARRAY_BUFFER, mesh.size() * sizeof(GLushort), mesh.data(), GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 2, GL_UNSIGNED_SHORT, GL_FALSE, 2 * sizeof(GLushort), (void*)0);
+    glEnableVertexAttribArray(0);
+    GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, topology_->getElementBuffer(newElementBuffer));
+    GLState::bindVertexArray(0);
+    
+    // Allocated here and filled by updateRegion(), which is also the edit path
+    auto createTexture = [this](GLuint& texture, GLenum unit, GLint internalFormat, GLenum format, GLenum type) {
+        glGenTextures(1, &texture);
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, textureSize_, textureSize_, 0, format, type, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    };
+    if (compactHeights_) {
+        createTexture(heightTexture_, HEIGHTMAP_UNIT, GL_R16, GL_RED, GL_UNSIGNED_SHORT);
+    } else {
+        createTexture(heightTexture_, HEIGHTMAP_UNIT, GL_R32F, GL_RED, GL_FLOAT);
+    }
+    createTexture(normalTexture_, NORMALMAP_UNIT, GL_RG8_SNORM, GL_RG, GL_BYTE);
+    updateRegion(generator, 0, 0, textureSize_, textureSize_);
+    
+    const size_t texels = static_cast<size_t>(textureSize_) * textureSize_;
+    vertexBytes_ = mesh.size() * sizeof(GLushort);
+    textureBytes_ = texels * ((compactHeights_ ? sizeof(GLushort) : sizeof(float)) + 2 * sizeof(GLbyte));
+    std::cout << "Heightmap terrain: " << PerformanceMonitor::formatBytes(vertexBytes_) << " mesh, "
+              << PerformanceMonitor::formatBytes(textureBytes_) << " heights and normals (" << textureSize_ << "x"
+              << textureSize_ << ", " << (compactHeights_ ? "R16" : "R32F") << ") for "
+              << PerformanceMonitor::formatBytes(generator.getVertexMemory()) << " of patch vertices" << std::endl;
+    return true;
+}
+
+void HeightmapTerrain::release() {
+    if (vao_ != 0) {
+        GLState::deleteVertexArray(vao_);
+        GLState::deleteBuffer(meshBuffer_);
+        vao_ = 0;
+        meshBuffer_ = 0;
+    }
+    if (heightTexture_ != 0) {
+        const GLuint textures[2] = { heightTexture_, normalTexture_ };
+        glDeleteTextures(2, textures);
+        heightTexture_ = 0;
+        normalTexture_ = 0;
+    }
+    textureSize_ = 0;
+    vertexBytes_ = 0;
+    textureBytes_ = 0;
+    topology_.reset();
+    firstPatch_ = nullptr;
+    patchCorners_.clear();
+    queue_.clear();
+}
+
+void HeightmapTerrain::updateRegion(const TerrainGenerator& generator, int gridX, int gridZ, int width, int depth) {
+    // Clip to the textures
+    const int x0 = std::max(gridX, 0);
+    const int z0 = std::max(gridZ, 0);
+    const int x1 = std::min(gridX + width, textureSize_);
+    const int z1 = std::min(gridZ + depth, textureSize_);
+    if (!isUploaded() || x0 >= x1 || z0 >= z1) {
+        return;
+    }
+    
+    buildTexels(generator, x0, z0, x1 - x0, z1 - z0);
+    
+    // Rows of 2-byte texels are not 4-byte aligned in general
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glActiveTexture(GL_TEXTURE0 + HEIGHTMAP_UNIT);
+    glBindTexture(GL_TEXTURE_2D, heightTexture_);
+    if (compactHeights_) {
+        glTexSubImage2D(GL_TEXTURE_2D, 0, x0, z0, x1 - x0, z1 - z0, GL_RED, GL_UNSIGNED_SHORT, compactTexels_.data());
+    } else {
+        glTexSubImage2D(GL_TEXTURE_2D, 0, x0, z0, x1 - x0, z1 - z0, GL_RED, GL_FLOAT, floatTexels_.data());
+    }
+    glActiveTexture(GL_TEXTURE0 + NORMALMAP_UNIT);
+    glBindTexture(GL_TEXTURE_2D, normalTexture_);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, x0, z0, x1 - x0, z1 - z0, GL_RG, GL_BYTE, normalTexels_.data());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
+void HeightmapTerrain::buildTexels(const TerrainGenerator& generator, int gridX, int gridZ, int width, int depth) {
+    const size_t texels = static_cast<size_t>(width) * depth;
+    if (compactHeights_) {
+        compactTexels_.resize(texels);
+    } else {
+        floatTexels_.resize(texels);
+    }
+    normalTexels_.resize(texels * 2);
+    
+    // Same quantization as VertexFormats::pack()
+    auto quantize = [](float value, float scale) {
+        return std::round(glm::clamp(value, -1.0f, 1.0f) * scale);
+    };
+    for (int z = 0; z < depth; z++) {
+        for (int x = 0; x < width; x++) {
+            const size_t texel = static_cast<size_t>(z) * width + x;
+            const float height = generator.gridHeight(gridX + x, gridZ + z);
+            if (compactHeights_) {
+                const float normalized = (height - heightRange_.x) / heightRange_.y;
+                compactTexels_[texel] = static_cast<GLushort>(quantize(normalized, 65535.0f));
+            } else {
+                floatTexels_[texel] = height;
+            }
+            
+            const glm::vec2 normal = VertexFormats::encodeOctahedral(generator.gridNormal(gridX + x, gridZ + z));
+            normalTexels_[texel * 2] = static_cast<GLbyte>(quantize(normal.x, 127.0f));
+            normalTexels_[texel * 2 + 1] = static_cast<GLbyte>(quantize(normal.y, 127.0f));
+        }
+    }
+}
+
+void HeightmapTerrain::bindTextures() const {
+    glActiveTexture(GL_TEXTURE0 + HEIGHTMAP_UNIT);
+    glBindTexture(GL_TEXTURE_2D, heightTexture_);
+    glActiveTexture(GL_TEXTURE0 + NORMALMAP_UNIT);
+    glBindTexture(GL_TEXTURE_2D, normalTexture_);
+}
+
+void HeightmapTerrain::add(const TerrainPatch& patch, int lodLevel, int stitchMask) {
+    const PatchLod& range = topology_->range(lodLevel, stitchMask);
+    QueuedPatch queued;
+    queued.firstIndex = range.firstIndex;
+    queued.indexCount = range.indexCount;
+    queued.patch = static_cast<size_t>(&patch - firstPatch_);
+    queue_.push_back(queued);
+}
+
+int HeightmapTerrain::flush() {
+    if (queue_.empty()) {
+        return 0;
+    }
+    
+    GLState::bindVertexArray(vao_);
+    bindTextures();
+    
+    const GLenum mode = topology_->getPrimitiveMode();
+    const GLenum indexType = topology_->getIndexType();
+    for (const QueuedPatch& queued : queue_) {
+        const glm::vec2& corner = patchCorners_[queued.patch];
+        glVertexAttrib4f(VertexFormats::PATCH_RANGE_ATTRIBUTE, corner.x, corner.y, 0.0f, 0.0f);
+        glDrawElements(mode, static_cast<GLsizei>(queued.indexCount), indexType,
+                       (void*)(static_cast<size_t>(queued.firstIndex) * topology_->getIndexSize()));
+    }
+    
+    const int drawCalls = static_cast<int>(queue_.size());
+    queue_.clear();
+    return drawCalls;
+}
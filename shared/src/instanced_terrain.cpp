@@ -0,0 +1,180 @@
+#include "instanced_terrain.h"
+#include "gl_state.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include "performance_monitor.h"
+
+InstancedTerrain::~InstancedTerrain() {
+    release();
+}
+
+bool InstancedTerrain::upload(const TerrainGenerator& generator, bool* newElementBuffer) {
+    release();
+    
+    const std::vector<TerrainPatch>& patches = generator.getPatches();
+    if (patches.empty() || generator.getHeightfield().empty()) {
+        return false;
+    }
+    for (const auto& patch : patches) {
+        if (patch.topology != patches.front().topology) {
+            std::cerr << "Instanced terrain needs patches of a single resolution" << std::endl;
+            return false;
+        }
+    }
+    GLint maxLayers = 0;
+    glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+    if (static_cast<GLint>(patches.size()) > maxLayers) {
+        std::cerr << "Instanced terrain: " << patches.size() << " patches exceed the " << maxLayers
+                  << " texture array layers" << std::endl;
+        return false;
+    }
+    
+    topology_ = patches.front().topology;
+    firstPatch_ = &patches.front();
+    const int quadsPerSide = topology_->getQuadsPerSide();
+    const int verticesPerRow = quadsPerSide + 1;
+    
+    const std::vector<GLushort> mesh = topology_->gridMesh();
+    
+    // Heights at the grid points plus a border row and column on each side,
+    // clamped at the terrain edge
+    const float spacing = generator.getPatchSize();
+    const int layerSize = verticesPerRow + 2;
+    const size_t layerSamples = static_cast<size_t>(layerSize) * layerSize;
+    std::vector<float> heights(layerSamples * patches.size());
+    instances_.resize(patches.size());
+    for (size_t i = 0; i < patches.size(); i++) {
+        const glm::vec3& corner = patches[i].vertexData()[topology_->vertexSlot(0)].position;
+        const int cornerX = static_cast<int>(std::lround(corner.x / spacing));
+        const int cornerZ = static_cast<int>(std::lround(corner.z / spacing));
+        
+        float* layer = heights.data() + i * layerSamples;
+        for (int z = 0; z < layerSize; z++) {
+            for (int x = 0; x < layerSize; x++) {
+                layer[z * layerSize + x] = generator.gridHeight(cornerX + x - 1, cornerZ + z - 1);
+            }
+        }
+        
+        instances_[i].origin = glm::vec2(cornerX * spacing, cornerZ * spacing);
+        instances_[i].spacing = spacing;
+        instances_[i].layer = static_cast<float>(i);
+    }
+    
+    glGenVertexArrays(1, &vao_);
+    glGenBuffers(1, &meshBuffer_);
+    glGenBuffers(1, &instanceBuffer_);
+    GLState::bindVertexArray(vao_);
+    
+    GLState::bindBuffer(GL_ARRAY_BUFFER, meshBuffer_);
+    glBufferData(GL_ARRAY_BUFFER, mesh.size() * sizeof(GLushort), mesh.data(), GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 2, GL_UNSIGNED_SHORT, GL_FALSE, 2 * sizeof(GLushort), (void*)0);
+    glEnableVertexAttribArray(0);
+    GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, topology_->getElementBuffer(newElementBuffer));
+    
+    // Filled per frame by flush(), which also points the attribute at each group
+    GLState::bindBuffer(GL_ARRAY_BUFFER, instanceBuffer_);
+    glBufferData(GL_ARRAY_BUFFER, instances_.size() * sizeof(TerrainInstance), nullptr, GL_STREAM_DRAW);
+    glVertexAttribPointer(INSTANCE_ATTRIBUTE, 4, GL_FLOAT, GL_FALSE, sizeof(TerrainInstance), (void*)0);
+    glEnableVertexAttribArray(INSTANCE_ATTRIBUTE);
+    glVertexAttribDivisor(INSTANCE_ATTRIBUTE, 1);
+    GLState::bindVertexArray(0);
+    
+    glGenTextures(1, &heightTexture_);
+    glActiveTexture(GL_TEXTURE0 + HEIGHTMAP_UNIT);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, heightTexture_);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_R32F, layerSize, layerSize, static_cast<GLsizei>(patches.size()), 0,
+                 GL_RED, GL_FLOAT, heights.data());
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    
+    vertexBytes_ = mesh.size() * sizeof(GLushort) + instances_.size() * sizeof(TerrainInstance);
+    textureBytes_ = heights.size() * sizeof(float);
+    std::cout << "Instanced terrain: " << PerformanceMonitor::formatBytes(vertexBytes_) << " mesh and instances, "
+              << PerformanceMonitor::formatBytes(textureBytes_) << " heights (" << patches.size() << " layers of "
+              << layerSize << "x" << layerSize << ") for " << PerformanceMonitor::formatBytes(generator.getVertexMemory())
+              << " of patch vertices" << std::endl;
+    return true;
+}
+
+void InstancedTerrain::release() {
+    if (vao_ != 0) {
+        GLState::deleteVertexArray(vao_);
+        GLState::deleteBuffer(meshBuffer_);
+        GLState::deleteBuffer(instanceBuffer_);
+        vao_ = 0;
+        meshBuffer_ = 0;
+        instanceBuffer_ = 0;
+    }
+    if (heightTexture_ != 0) {
+        glDeleteTextures(1, &heightTexture_);
+        heightTexture_ = 0;
+    }
+    vertexBytes_ = 0;
+    textureBytes_ = 0;
+    topology_.reset();
+    firstPatch_ = nullptr;
+    instances_.clear();
+    queue_.clear();
+    frameInstances_.clear();
+}
+
+void InstancedTerrain::add(const TerrainPatch& patch, int lodLevel, int stitchMask) {
+    const PatchLod& range = topology_->range(lodLevel, stitchMask);
+    QueuedInstance queued;
+    queued.firstIndex = range.firstIndex;
+    queued.indexCount = range.indexCount;
+    queued.patch = static_cast<size_t>(&patch - firstPatch_);
+    queue_.push_back(queued);
+}
+
+int InstancedTerrain::flush() {
+    if (queue_.empty()) {
+        return 0;
+    }
+    
+    // Instances drawing the same range end up adjacent
+    std::sort(queue_.begin(), queue_.end(), [](const QueuedInstance& a, const QueuedInstance& b) {
+        return a.firstIndex != b.firstIndex ? a.firstIndex < b.firstIndex : a.indexCount < b.indexCount;
+    });
+    frameInstances_.clear();
+    for (const QueuedInstance& queued : queue_) {
+        frameInstances_.push_back(instances_[queued.patch]);
+    }
+    
+    GLState::bindVertexArray(vao_);
+    GLState::bindBuffer(GL_ARRAY_BUFFER, instanceBuffer_);
+    
+    // Respecified every frame, like TerrainBatch's indirect commands
+    glBufferData(GL_ARRAY_BUFFER, frameInstances_.size() * sizeof(TerrainInstance), frameInstances_.data(),
+                 GL_STREAM_DRAW);
+    glActiveTexture(GL_TEXTURE0 + HEIGHTMAP_UNIT);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, heightTexture_);
+    
+    const GLenum mode = topology_->getPrimitiveMode();
+    const GLenum indexType = topology_->getIndexType();
+    int drawCalls = 0;
+    size_t first = 0;
+    while (first < queue_.size()) {
+        size_t end = first + 1;
+        while (end < queue_.size() && queue_[end].firstIndex == queue_[first].firstIndex &&
+               queue_[end].indexCount == queue_[first].indexCount) {
+            end++;
+        }
+        
+        // Base instances need 4.2, so each group moves the attribute's start instead
+        glVertexAttribPointer(INSTANCE_ATTRIBUTE, 4, GL_FLOAT, GL_FALSE, sizeof(TerrainInstance),
+                              (void*)(first * sizeof(TerrainInstance)));
+        glDrawElementsInstanced(mode, static_cast<GLsizei>(queue_[first].indexCount), indexType,
+                                (void*)(static_cast<size_t>(queue_[first].firstIndex) * topology_->getIndexSize()),
+                                static_cast<GLsizei>(end - first));
+        drawCalls++;
+        first = end;
+    }
+    
+    // Keeps the capacity for the next frame
+    queue_.clear();
+    return drawCalls;
+}
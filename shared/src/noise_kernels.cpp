@@ -0,0 +1,347 @@
+#include "noise_kernels.h"
+#include <cmath>
+#include <iostream>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define NOISE_KERNELS_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// GCC/Clang compile the SIMD kernels per function so the rest of the
+// library keeps the baseline instruction set; MSVC needs no flags
+#if defined(NOISE_KERNELS_X86) && (defined(__GNUC__) || defined(__clang__))
+#define NOISE_TARGET(isa) __attribute__((target(isa)))
+#else
+#define NOISE_TARGET(isa)
+#endif
+
+float NoiseKernels::grad(int hash, float x, float z) {
+    int h = hash & 15;
+    float u = h < 8 ? x : z;
+    float v = h < 4 ? z : h == 12 || h == 14 ? x : 0;
+    return ((h & 1) == 0 ? u : -u) + ((h & 2) == 0 ? v : -v);
+}
+
+float NoiseKernels::sample(const int* permutation, float x, float z, int octaves, float persistence) {
+    float total = 0.0f;
+    float frequency = 1.0f;
+    float amplitude = 1.0f;
+    float maxValue = 0.0f;
+
+    for (int i = 0; i < octaves; i++) {
+        total += grad(permutation[static_cast<int>(x * frequency) & 255] +
+                      permutation[static_cast<int>(z * frequency) & 255],
+                      x * frequency, z * frequency) * amplitude;
+
+        maxValue += amplitude;
+        amplitude *= persistence;
+        frequency *= 2.0f;
+    }
+
+    return total / maxValue;
+}
+
+void NoiseKernels::evaluateScalar(const NoiseBatchParams& params, const float* xs, float z,
+                                  int count, float* out) {
+    const float nz = z * params.inputScale;
+    for (int i = 0; i < count; i++) {
+        out[i] = sample(params.permutation, xs[i] * params.inputScale, nz,
+                        params.octaves, params.persistence) * params.outputScale;
+    }
+}
+
+// Gradient directions indexed by the low three hash bits
+static const float GRADIENTS[8][2] = {
+    { 1.0f,  1.0f}, {-1.0f,  1.0f}, { 1.0f, -1.0f}, {-1.0f, -1.0f},
+    { 1.0f,  0.0f}, {-1.0f,  0.0f}, { 0.0f,  1.0f}, { 0.0f, -1.0f}
+};
+
+static inline float fade(float t) {
+    return t * t * t * (t * (t * 6.0f - 15.0f) + 10.0f);
+}
+
+static inline float fadeDerivative(float t) {
+    return 30.0f * t * t * (t * (t - 2.0f) + 1.0f);
+}
+
+float NoiseKernels::gradientNoise(const int* permutation, float x, float z, float& dx, float& dz) {
+    const float cellX = std::floor(x);
+    const float cellZ = std::floor(z);
+    const int xi = static_cast<int>(cellX) & 255;
+    const int zi = static_cast<int>(cellZ) & 255;
+    const float fx = x - cellX;
+    const float fz = z - cellZ;
+
+    // Corner gradients: a = (0,0), b = (1,0), c = (0,1), d = (1,1)
+    const float* ga = GRADIENTS[permutation[permutation[xi] + zi] & 7];
+    const float* gb = GRADIENTS[permutation[permutation[xi + 1] + zi] & 7];
+    const float* gc = GRADIENTS[permutation[permutation[xi] + zi + 1] & 7];
+    const float* gd = GRADIENTS[permutation[permutation[xi + 1] + zi + 1] & 7];
+
+    const float va = ga[0] * fx + ga[1] * fz;
+    const float vb = gb[0] * (fx - 1.0f) + gb[1] * fz;
+    const float vc = gc[0] * fx + gc[1] * (fz - 1.0f);
+    const float vd = gd[0] * (fx - 1.0f) + gd[1] * (fz - 1.0f);
+
+    const float ux = fade(fx);
+    const float uz = fade(fz);
+    const float k = va - vb - vc + vd;
+
+    // Product rule over the bilinear blend of the corner ramps
+    dx = ga[0] + ux * (gb[0] - ga[0]) + uz * (gc[0] - ga[0]) + ux * uz * (ga[0] - gb[0] - gc[0] + gd[0])
+       + fadeDerivative(fx) * (uz * k + vb - va);
+    dz = ga[1] + ux * (gb[1] - ga[1]) + uz * (gc[1] - ga[1]) + ux * uz * (ga[1] - gb[1] - gc[1] + gd[1])
+       + fadeDerivative(fz) * (ux * k + vc - va);
+
+    return va + ux * (vb - va) + uz * (vc - va) + ux * uz * k;
+}
+
+float NoiseKernels::sampleGradient(const int* permutation, float x, float z, int octaves, float persistence,
+                                   float& dx, float& dz) {
+    float total = 0.0f;
+    float frequency = 1.0f;
+    float amplitude = 1.0f;
+    float maxValue = 0.0f;
+    dx = 0.0f;
+    dz = 0.0f;
+
+    for (int i = 0; i < octaves; i++) {
+        float octaveDx, octaveDz;
+        total += gradientNoise(permutation, x * frequency, z * frequency, octaveDx, octaveDz) * amplitude;
+        dx += octaveDx * amplitude * frequency;
+        dz += octaveDz * amplitude * frequency;
+
+        maxValue += amplitude;
+        amplitude *= persistence;
+        frequency *= 2.0f;
+    }
+
+    dx /= maxValue;
+    dz /= maxValue;
+    return total / maxValue;
+}
+
+void NoiseKernels::evaluateGradient(const NoiseBatchParams& params, const float* xs, float z, int count,
+                                    float* out, float* outDx, float* outDz) {
+    const float nz = z * params.inputScale;
+    const float derivativeScale = params.inputScale * params.outputScale;
+
+    for (int i = 0; i < count; i++) {
+        float dx, dz;
+        out[i] = sampleGradient(params.permutation, xs[i] * params.inputScale, nz,
+                                params.octaves, params.persistence, dx, dz) * params.outputScale;
+        if (outDx) outDx[i] = dx * derivativeScale;
+        if (outDz) outDz[i] = dz * derivativeScale;
+    }
+}
+
+#ifdef NOISE_KERNELS_X86
+
+// grad() for four lanes: select u/v with blends and apply the sign bits
+// from the hash directly, mirroring the branches of the scalar version
+NOISE_TARGET("sse4.1")
+static inline __m128 gradSSE41(__m128i hash, __m128 x, __m128 z) {
+    const __m128i h = _mm_and_si128(hash, _mm_set1_epi32(15));
+    const __m128 lt8 = _mm_castsi128_ps(_mm_cmplt_epi32(h, _mm_set1_epi32(8)));
+    const __m128 lt4 = _mm_castsi128_ps(_mm_cmplt_epi32(h, _mm_set1_epi32(4)));
+    const __m128 useX = _mm_castsi128_ps(_mm_or_si128(_mm_cmpeq_epi32(h, _mm_set1_epi32(12)),
+                                                      _mm_cmpeq_epi32(h, _mm_set1_epi32(14))));
+
+    __m128 u = _mm_blendv_ps(z, x, lt8);
+    __m128 v = _mm_blendv_ps(_mm_and_ps(useX, x), z, lt4);
+    u = _mm_xor_ps(u, _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(1)), 31)));
+    v = _mm_xor_ps(v, _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(2)), 30)));
+    return _mm_add_ps(u, v);
+}
+
+NOISE_TARGET("sse4.1")
+void NoiseKernels::evaluateSSE41(const NoiseBatchParams& params, const float* xs, float z,
+                                 int count, float* out) {
+    const int* permutation = params.permutation;
+    const float nz = z * params.inputScale;
+    const __m128 inputScale = _mm_set1_ps(params.inputScale);
+    const __m128i mask = _mm_set1_epi32(255);
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const __m128 nx = _mm_mul_ps(_mm_loadu_ps(xs + i), inputScale);
+        __m128 total = _mm_setzero_ps();
+        float frequency = 1.0f;
+        float amplitude = 1.0f;
+        float maxValue = 0.0f;
+
+        for (int octave = 0; octave < params.octaves; octave++) {
+            const __m128 fx = _mm_mul_ps(nx, _mm_set1_ps(frequency));
+            const float fz = nz * frequency;
+
+            // No gather before AVX2: pull the four table entries through memory
+            alignas(16) int xi[4];
+            _mm_store_si128(reinterpret_cast<__m128i*>(xi), _mm_and_si128(_mm_cvttps_epi32(fx), mask));
+            const __m128i hash = _mm_add_epi32(
+                _mm_setr_epi32(permutation[xi[0]], permutation[xi[1]], permutation[xi[2]], permutation[xi[3]]),
+                _mm_set1_epi32(permutation[static_cast<int>(fz) & 255]));
+
+            total = _mm_add_ps(total, _mm_mul_ps(gradSSE41(hash, fx, _mm_set1_ps(fz)), _mm_set1_ps(amplitude)));
+
+            maxValue += amplitude;
+            amplitude *= params.persistence;
+            frequency *= 2.0f;
+        }
+
+        _mm_storeu_ps(out + i, _mm_mul_ps(_mm_div_ps(total, _mm_set1_ps(maxValue)),
+                                          _mm_set1_ps(params.outputScale)));
+    }
+
+    if (i < count) {
+        evaluateScalar(params, xs + i, z, count - i, out + i);
+    }
+}
+
+NOISE_TARGET("avx2")
+static inline __m256 gradAVX2(__m256i hash, __m256 x, __m256 z) {
+    const __m256i h = _mm256_and_si256(hash, _mm256_set1_epi32(15));
+    const __m256 lt8 = _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32(8), h));
+    const __m256 lt4 = _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32(4), h));
+    const __m256 useX = _mm256_castsi256_ps(_mm256_or_si256(_mm256_cmpeq_epi32(h, _mm256_set1_epi32(12)),
+                                                            _mm256_cmpeq_epi32(h, _mm256_set1_epi32(14))));
+
+    __m256 u = _mm256_blendv_ps(z, x, lt8);
+    __m256 v = _mm256_blendv_ps(_mm256_and_ps(useX, x), z, lt4);
+    u = _mm256_xor_ps(u, _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(h, _mm256_set1_epi32(1)), 31)));
+    v = _mm256_xor_ps(v, _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(h, _mm256_set1_epi32(2)), 30)));
+    return _mm256_add_ps(u, v);
+}
+
+NOISE_TARGET("avx2")
+void NoiseKernels::evaluateAVX2(const NoiseBatchParams& params, const float* xs, float z,
+                                int count, float* out) {
+    const int* permutation = params.permutation;
+    const float nz = z * params.inputScale;
+    const __m256 inputScale = _mm256_set1_ps(params.inputScale);
+    const __m256i mask = _mm256_set1_epi32(255);
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256 nx = _mm256_mul_ps(_mm256_loadu_ps(xs + i), inputScale);
+        __m256 total = _mm256_setzero_ps();
+        float frequency = 1.0f;
+        float amplitude = 1.0f;
+        float maxValue = 0.0f;
+
+        for (int octave = 0; octave < params.octaves; octave++) {
+            const __m256 fx = _mm256_mul_ps(nx, _mm256_set1_ps(frequency));
+            const float fz = nz * frequency;
+
+            // z is constant along a row, so only the x lookups need a gather
+            const __m256i xi = _mm256_and_si256(_mm256_cvttps_epi32(fx), mask);
+            const __m256i hash = _mm256_add_epi32(_mm256_i32gather_epi32(permutation, xi, 4),
+                                                  _mm256_set1_epi32(permutation[static_cast<int>(fz) & 255]));
+
+            total = _mm256_add_ps(total, _mm256_mul_ps(gradAVX2(hash, fx, _mm256_set1_ps(fz)),
+                                                       _mm256_set1_ps(amplitude)));
+
+            maxValue += amplitude;
+            amplitude *= params.persistence;
+            frequency *= 2.0f;
+        }
+
+        _mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_div_ps(total, _mm256_set1_ps(maxValue)),
+                                                _mm256_set1_ps(params.outputScale)));
+    }
+
+    if (i < count) {
+        evaluateSSE41(params, xs + i, z, count - i, out + i);
+    }
+}
+
+static bool cpuSupports(NoiseKernel kernel) {
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_cpu_init();
+    if (kernel == NoiseKernel::AVX2) return __builtin_cpu_supports("avx2");
+    if (kernel == NoiseKernel::SSE41) return __builtin_cpu_supports("sse4.1");
+    return true;
+#elif defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    const bool sse41 = (info[2] & (1 << 19)) != 0;
+    if (kernel == NoiseKernel::SSE41) return sse41;
+    if (kernel == NoiseKernel::AVX2) {
+        // AVX state must also be enabled by the OS (OSXSAVE + XCR0)
+        const bool osxsave = (info[2] & (1 << 27)) != 0;
+        if (!osxsave || (_xgetbv(0) & 0x6) != 0x6) return false;
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+    }
+    return true;
+#else
+    return kernel == NoiseKernel::Scalar;
+#endif
+}
+
+#else // !NOISE_KERNELS_X86
+
+void NoiseKernels::evaluateSSE41(const NoiseBatchParams& params, const float* xs, float z,
+                                 int count, float* out) {
+    evaluateScalar(params, xs, z, count, out);
+}
+
+void NoiseKernels::evaluateAVX2(const NoiseBatchParams& params, const float* xs, float z,
+                                int count, float* out) {
+    evaluateScalar(params, xs, z, count, out);
+}
+
+static bool cpuSupports(NoiseKernel kernel) {
+    return kernel == NoiseKernel::Scalar;
+}
+
+#endif
+
+bool NoiseKernels::isSupported(NoiseKernel kernel) {
+    if (kernel == NoiseKernel::Auto || kernel == NoiseKernel::Scalar) {
+        return true;
+    }
+    return cpuSupports(kernel);
+}
+
+NoiseKernel NoiseKernels::resolve(NoiseKernel kernel) {
+    if (kernel == NoiseKernel::Auto) {
+        if (isSupported(NoiseKernel::AVX2)) return NoiseKernel::AVX2;
+        if (isSupported(NoiseKernel::SSE41)) return NoiseKernel::SSE41;
+        return NoiseKernel::Scalar;
+    }
+
+    if (!isSupported(kernel)) {
+        std::cerr << "Noise kernel " << name(kernel) << " not supported by this CPU, using scalar" << std::endl;
+        return NoiseKernel::Scalar;
+    }
+    return kernel;
+}
+
+NoiseKernels::BatchFunction NoiseKernels::get(NoiseKernel kernel) {
+    switch (resolve(kernel)) {
+        case NoiseKernel::AVX2: return evaluateAVX2;
+        case NoiseKernel::SSE41: return evaluateSSE41;
+        default: return evaluateScalar;
+    }
+}
+
+const char* NoiseKernels::name(NoiseKernel kernel) {
+    switch (kernel) {
+        case NoiseKernel::Auto: return "auto";
+        case NoiseKernel::Scalar: return "scalar";
+        case NoiseKernel::SSE41: return "sse4.1";
+        case NoiseKernel::AVX2: return "avx2";
+    }
+    return "unknown";
+}
+
+const char* NoiseKernels::name(NoiseBackend backend) {
+    switch (backend) {
+        case NoiseBackend::Classic: return "classic";
+        case NoiseBackend::Gradient: return "gradient";
+    }
+    return "unknown";
+}
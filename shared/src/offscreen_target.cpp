@@ -0,0 +1,56 @@
+#include "offscreen_target.h"
+#include <iostream>
+
+OffscreenTarget::~OffscreenTarget() {
+    release();
+}
+
+bool OffscreenTarget::create(int width, int height) {
+    release();
+    
+    GLuint renderbuffers[2];
+    glGenRenderbuffers(2, renderbuffers);
+    colorBuffer_ = renderbuffers[0];
+    depthBuffer_ = renderbuffers[1];
+    glBindRenderbuffer(GL_RENDERBUFFER, colorBuffer_);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer_);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    
+    glGenFramebuffers(1, &framebuffer_);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorBuffer_);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer_);
+    const GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        std::cerr << "Offscreen framebuffer incomplete: 0x" << std::hex << status << std::dec << std::endl;
+        release();
+        return false;
+    }
+    
+    width_ = width;
+    height_ = height;
+    return true;
+}
+
+void OffscreenTarget::release() {
+    if (framebuffer_ != 0) {
+        glDeleteFramebuffers(1, &framebuffer_);
+        framebuffer_ = 0;
+    }
+    if (colorBuffer_ != 0) {
+        const GLuint renderbuffers[2] = { colorBuffer_, depthBuffer_ };
+        glDeleteRenderbuffers(2, renderbuffers);
+        colorBuffer_ = 0;
+        depthBuffer_ = 0;
+    }
+    width_ = 0;
+    height_ = 0;
+}
+
+void OffscreenTarget::bind() const {
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_);
+    glViewport(0, 0, width_, height_);
+}
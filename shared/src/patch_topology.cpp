@@ -0,0 +1,368 @@
+#include "patch_topology.h"
+#include "gl_state.h"
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <map>
+#include <mutex>
+
+static std::mutex s_registryMutex;
+static std::map<std::pair<int, PatchPrimitive>, std::weak_ptr<const PatchTopology>> s_registry;
+
+const char* PatchTopology::name(PatchPrimitive primitive) {
+    switch (primitive) {
+        case PatchPrimitive::Triangles: return "triangles";
+        case PatchPrimitive::TriangleStrips: return "strips";
+    }
+    return "unknown";
+}
+
+std::shared_ptr<const PatchTopology> PatchTopology::get(int quadsPerSide, PatchPrimitive primitive) {
+    std::lock_guard<std::mutex> lock(s_registryMutex);
+    
+    std::weak_ptr<const PatchTopology>& entry = s_registry[std::make_pair(quadsPerSide, primitive)];
+    std::shared_ptr<const PatchTopology> topology = entry.lock();
+    if (!topology) {
+        topology = create(quadsPerSide, primitive);
+        entry = topology;
+    }
+    return topology;
+}
+
+std::shared_ptr<const PatchTopology> PatchTopology::create(int quadsPerSide, PatchPrimitive primitive, bool optimizeOrder) {
+    return std::shared_ptr<const PatchTopology>(new PatchTopology(quadsPerSide, primitive, optimizeOrder));
+}
+
+int PatchTopology::lodCountFor(int quadsPerSide) {
+    int count = 1;
+    for (int step = 2; quadsPerSide % step == 0 && quadsPerSide / step >= 2; step *= 2) {
+        count++;
+    }
+    return count;
+}
+
+PatchTopology::PatchTopology(int quadsPerSide, PatchPrimitive primitive, bool optimize)
+    : quadsPerSide_(quadsPerSide), lodCount_(lodCountFor(quadsPerSide)), primitive_(primitive), elementBuffer_(0) {
+    const size_t vertexCount = static_cast<size_t>(quadsPerSide + 1) * (quadsPerSide + 1);
+    indexType_ = vertexCount <= 0xFFFF ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT; // 0xFFFF stays free for restart
+    
+    ranges_.reserve(static_cast<size_t>(lodCount_) * STITCH_VARIANTS);
+    
+    for (int level = 0; level < lodCount_; level++) {
+        const int step = 1 << level;
+        for (int mask = 0; mask < STITCH_VARIANTS; mask++) {
+            // The coarsest level has no coarser neighbour to stitch to
+            if (level == lodCount_ - 1 && mask != 0) {
+                ranges_.push_back(ranges_[level * STITCH_VARIANTS]);
+                continue;
+            }
+            appendVariant(step, mask);
+        }
+    }
+    
+    vertexSlots_.resize(vertexCount);
+    for (size_t i = 0; i < vertexCount; i++) {
+        vertexSlots_[i] = static_cast<unsigned int>(i);
+    }
+    if (optimize) {
+        if (primitive_ == PatchPrimitive::Triangles) {
+            optimizeOrder();
+        } else {
+            // Strips keep their row order but share the triangle lists' vertex order
+            vertexSlots_ = PatchTopology(quadsPerSide, PatchPrimitive::Triangles, true).vertexSlots_;
+        }
+        for (unsigned int& index : indices_) {
+            if (index != RESTART_INDEX) {
+                index = vertexSlots_[index];
+            }
+        }
+    }
+    
+    for (PatchLod& range : ranges_) {
+        range.vertexTransforms = static_cast<unsigned int>(simulateVertexCache(
+            &indices_[range.firstIndex], range.indexCount, VERTEX_CACHE_SIZE, 44, primitive_).transforms);
+    }
+}
+
+PatchTopology::~PatchTopology() {
+    if (elementBuffer_ != 0) {
+        GLState::deleteBuffer(elementBuffer_);
+    }
+}
+
+void PatchTopology::appendVariant(int step, int stitchMask) {
+    const int n = quadsPerSide_;
+    const unsigned int verticesPerRow = n + 1;
+    
+    // Odd vertices (at this step) on a stitched edge move to the previous
+    // even vertex of that edge
+    auto vertex = [&](int x, int z) {
+        if ((stitchMask & STITCH_NORTH) && z == 0 && (x / step) % 2 == 1) x -= step;
+        if ((stitchMask & STITCH_SOUTH) && z == n && (x / step) % 2 == 1) x -= step;
+        if ((stitchMask & STITCH_WEST) && x == 0 && (z / step) % 2 == 1) z -= step;
+        if ((stitchMask & STITCH_EAST) && x == n && (z / step) % 2 == 1) z -= step;
+        return static_cast<unsigned int>(z) * verticesPerRow + x;
+    };
+    
+    PatchLod range;
+    range.firstIndex = static_cast<unsigned int>(indices_.size());
+    
+    range.triangleCount = 0;
+    
+    auto addTriangle = [&](unsigned int a, unsigned int b, unsigned int c) {
+        if (a == b || b == c || a == c) return; // Collapsed by stitching
+        indices_.insert(indices_.end(), { a, b, c });
+        range.triangleCount++;
+    };
+    
+    if (primitive_ == PatchPrimitive::TriangleStrips) {
+        // Zigzag down each row of quads: top, bottom, top, bottom... gives the
+        // same two triangles per quad, with the same winding, as the list.
+        // Stitching only makes some of them degenerate, which the GPU drops.
+        for (int z = 0; z < n; z += step) {
+            if (z > 0) {
+                indices_.push_back(RESTART_INDEX);
+            }
+            const size_t rowStart = indices_.size();
+            for (int x = 0; x <= n; x += step) {
+                indices_.push_back(vertex(x, z));
+                indices_.push_back(vertex(x, z + step));
+            }
+            for (size_t i = rowStart; i + 2 < indices_.size(); i++) {
+                const unsigned int a = indices_[i], b = indices_[i + 1], c = indices_[i + 2];
+                if (a != b && b != c && a != c) {
+                    range.triangleCount++;
+                }
+            }
+        }
+    } else {
+        for (int z = 0; z < n; z += step) {
+            for (int x = 0; x < n; x += step) {
+                const unsigned int topLeft = vertex(x, z);
+                const unsigned int topRight = vertex(x + step, z);
+                const unsigned int bottomLeft = vertex(x, z + step);
+                const unsigned int bottomRight = vertex(x + step, z + step);
+                
+                // Two triangles per quad
+                addTriangle(topLeft, bottomLeft, topRight);
+                addTriangle(topRight, bottomLeft, bottomRight);
+            }
+        }
+    }
+    
+    range.indexCount = static_cast<unsigned int>(indices_.size()) - range.firstIndex;
+    range.vertexTransforms = 0;
+    ranges_.push_back(range);
+}
+
+size_t PatchTopology::getListIndexBytes() const {
+    size_t total = 0;
+    for (size_t i = 0; i < ranges_.size(); i++) {
+        if (i > 0 && ranges_[i].firstIndex == ranges_[i - 1].firstIndex) continue; // Coarsest level copies
+        total += ranges_[i].triangleCount * 3 * sizeof(unsigned int);
+    }
+    return total;
+}
+
+// Tipsify (Sander, Nehab and Barczak, "Fast Triangle Reordering for Vertex
+// Locality and Reduced Overdraw", 2007): emits all remaining triangles around
+// a fanning vertex, then continues with the most recently used vertex that
+// will still be cached after its own remaining triangles are emitted
+static void tipsify(unsigned int* indices, size_t indexCount, size_t vertexCount, int cacheSize) {
+    const size_t triangleCount = indexCount / 3;
+    
+    // Vertex -> triangle adjacency, and the number of unemitted triangles per vertex
+    std::vector<unsigned int> live(vertexCount, 0);
+    for (size_t i = 0; i < indexCount; i++) {
+        live[indices[i]]++;
+    }
+    std::vector<unsigned int> offsets(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; v++) {
+        offsets[v + 1] = offsets[v] + live[v];
+    }
+    std::vector<unsigned int> adjacency(indexCount);
+    std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < indexCount; i++) {
+        adjacency[fill[indices[i]]++] = static_cast<unsigned int>(i / 3);
+    }
+    
+    std::vector<unsigned int> cacheTime(vertexCount, 0);
+    std::vector<char> emitted(triangleCount, 0);
+    std::vector<unsigned int> deadEnd;
+    std::vector<unsigned int> candidates;
+    std::vector<unsigned int> output;
+    output.reserve(indexCount);
+    unsigned int timestamp = cacheSize + 1;
+    size_t cursor = 0;
+    
+    // Fallback when no candidate qualifies: the most recent vertex with
+    // triangles left, else the next one in input order
+    auto skipDeadEnd = [&]() -> long {
+        while (!deadEnd.empty()) {
+            const unsigned int v = deadEnd.back();
+            deadEnd.pop_back();
+            if (live[v] > 0) return v;
+        }
+        for (; cursor < vertexCount; cursor++) {
+            if (live[cursor] > 0) return static_cast<long>(cursor);
+        }
+        return -1;
+    };
+    
+    long fanning = skipDeadEnd();
+    while (fanning >= 0) {
+        candidates.clear();
+        for (unsigned int a = offsets[fanning]; a < offsets[fanning + 1]; a++) {
+            const unsigned int triangle = adjacency[a];
+            if (emitted[triangle]) continue;
+            emitted[triangle] = 1;
+            
+            for (int corner = 0; corner < 3; corner++) {
+                const unsigned int v = indices[triangle * 3 + corner];
+                output.push_back(v);
+                deadEnd.push_back(v);
+                candidates.push_back(v);
+                live[v]--;
+                if (timestamp - cacheTime[v] > static_cast<unsigned int>(cacheSize)) {
+                    cacheTime[v] = timestamp++;
+                }
+            }
+        }
+        
+        long best = -1;
+        int bestPriority = -1;
+        for (unsigned int v : candidates) {
+            if (live[v] == 0) continue;
+            int priority = 0;
+            if (timestamp - cacheTime[v] + 2 * live[v] <= static_cast<unsigned int>(cacheSize)) {
+                priority = static_cast<int>(timestamp - cacheTime[v]);
+            }
+            if (priority > bestPriority) {
+                best = v;
+                bestPriority = priority;
+            }
+        }
+        fanning = best >= 0 ? best : skipDeadEnd();
+    }
+    
+    std::copy(output.begin(), output.end(), indices);
+}
+
+void PatchTopology::optimizeOrder() {
+    const size_t vertexCount = vertexSlots_.size();
+    
+    // Triangle order, per variant (the coarsest level's copies share one range)
+    for (size_t i = 0; i < ranges_.size(); i++) {
+        const PatchLod& range = ranges_[i];
+        if (i > 0 && range.firstIndex == ranges_[i - 1].firstIndex) continue;
+        tipsify(&indices_[range.firstIndex], range.indexCount, vertexCount, VERTEX_CACHE_SIZE);
+    }
+    
+    // Vertex order: first use by the full-detail variant (which references
+    // every vertex), so cache misses fetch memory close to the previous ones
+    const unsigned int unassigned = UINT_MAX;
+    std::fill(vertexSlots_.begin(), vertexSlots_.end(), unassigned);
+    unsigned int nextSlot = 0;
+    for (unsigned int index : indices_) {
+        if (vertexSlots_[index] == unassigned) {
+            vertexSlots_[index] = nextSlot++;
+        }
+    }
+    for (unsigned int& slot : vertexSlots_) {
+        if (slot == unassigned) {
+            slot = nextSlot++;
+        }
+    }
+}
+
+VertexCacheStats PatchTopology::simulateVertexCache(const unsigned int* indices, size_t count, int cacheSize,
+                                                   size_t vertexStride, PatchPrimitive primitive) {
+    const size_t lineSize = 64;
+    const size_t lineCount = 64;
+    
+    VertexCacheStats stats;
+    stats.vertexStride = vertexStride;
+    if (primitive == PatchPrimitive::Triangles) {
+        stats.triangles = count / 3;
+    } else {
+        // Every index after the first two of a strip adds a triangle
+        size_t stripLength = 0;
+        for (size_t i = 0; i < count; i++) {
+            stripLength = indices[i] == RESTART_INDEX ? 0 : stripLength + 1;
+            if (stripLength >= 3) {
+                stats.triangles++;
+            }
+        }
+    }
+    
+    std::vector<unsigned int> fifo(cacheSize, UINT_MAX);
+    size_t head = 0;
+    std::vector<size_t> lines(lineCount, SIZE_MAX);
+    size_t lineHead = 0;
+    std::vector<char> seen;
+    
+    for (size_t i = 0; i < count; i++) {
+        const unsigned int v = indices[i];
+        if (v == RESTART_INDEX) {
+            continue;
+        }
+        if (v >= seen.size()) {
+            seen.resize(v + 1, 0);
+        }
+        if (!seen[v]) {
+            seen[v] = 1;
+            stats.uniqueVertices++;
+        }
+        
+        if (std::find(fifo.begin(), fifo.end(), v) != fifo.end()) {
+            continue;
+        }
+        fifo[head] = v;
+        head = (head + 1) % fifo.size();
+        stats.transforms++;
+        
+        // A vertex may straddle two lines
+        const size_t firstLine = v * vertexStride / lineSize;
+        const size_t lastLine = (v * vertexStride + vertexStride - 1) / lineSize;
+        for (size_t line = firstLine; line <= lastLine; line++) {
+            if (std::find(lines.begin(), lines.end(), line) == lines.end()) {
+                lines[lineHead] = line;
+                lineHead = (lineHead + 1) % lines.size();
+                stats.fetchedBytes += lineSize;
+            }
+        }
+    }
+    return stats;
+}
+
+std::vector<GLushort> PatchTopology::gridMesh() const {
+    const int verticesPerRow = quadsPerSide_ + 1;
+    std::vector<GLushort> mesh(vertexSlots_.size() * 2);
+    for (int z = 0; z < verticesPerRow; z++) {
+        for (int x = 0; x < verticesPerRow; x++) {
+            const size_t slot = vertexSlots_[z * verticesPerRow + x];
+            mesh[slot * 2] = static_cast<GLushort>(x);
+            mesh[slot * 2 + 1] = static_cast<GLushort>(z);
+        }
+    }
+    return mesh;
+}
+
+GLuint PatchTopology::getElementBuffer(bool* created) const {
+    if (created) {
+        *created = elementBuffer_ == 0;
+    }
+    
+    if (elementBuffer_ == 0) {
+        glGenBuffers(1, &elementBuffer_);
+        GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementBuffer_);
+        if (indexType_ == GL_UNSIGNED_SHORT) {
+            // Restart markers truncate to 0xFFFF
+            std::vector<unsigned short> shortIndices(indices_.begin(), indices_.end());
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, getIndexBytes(), shortIndices.data(), GL_STATIC_DRAW);
+        } else {
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, getIndexBytes(), indices_.data(), GL_STATIC_DRAW);
+        }
+    }
+    return elementBuffer_;
+}
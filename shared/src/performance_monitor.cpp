@@ -13,6 +13,7 @@ void PerformanceMonitor::beginFrame() {
 
 void PerformanceMonitor::endFrame() {
     std::lock_guard<std::mutex> lock(metricsMutex_);
+    metrics_.frameCount++;
     
     auto now = std::chrono::high_resolution_clock::now();
     auto duration = std::chrono::duration_cast<std::chrono::microseconds>(now - metrics_.lastFrameTime);
@@ -82,11 +83,57 @@ void PerformanceMonitor::printReport() const {
     std::cout << "Draw Calls: " << metrics_.drawCalls << std::endl;
     std::cout << "Triangles Drawn: " << metrics_.trianglesDrawn << std::endl;
     std::cout << "Vertices Drawn: " << metrics_.verticesDrawn << std::endl;
+    if (metrics_.frameCount > 0) {
+        const double trianglesPerFrame = static_cast<double>(metrics_.trianglesDrawn) / metrics_.frameCount;
+        std::cout << "Draw Calls/Frame: " << std::fixed << std::setprecision(1)
+                  << static_cast<double>(metrics_.drawCalls) / metrics_.frameCount << std::endl;
+        if (metrics_.submitTime > 0.0) {
+            std::cout << "CPU Submit Time/Frame: " << formatTime(metrics_.submitTime / metrics_.frameCount) << std::endl;
+        }
+        if (metrics_.recordTime > 0.0) {
+            std::cout << "CPU Record Time/Frame: " << formatTime(metrics_.recordTime / metrics_.frameCount) << std::endl;
+        }
+        if (metrics_.culledPatches > 0) {
+            std::cout << "Culled Patches/Frame: " << std::setprecision(1)
+                      << static_cast<double>(metrics_.culledPatches) / metrics_.frameCount << std::endl;
+        }
+        const long long stateCalls = metrics_.stateCallsIssued + metrics_.stateCallsFiltered;
+        if (stateCalls > 0) {
+            std::cout << "State Calls/Frame: " << std::setprecision(1)
+                      << static_cast<double>(metrics_.stateCallsIssued) / metrics_.frameCount << " issued, "
+                      << static_cast<double>(metrics_.stateCallsFiltered) / metrics_.frameCount << " filtered ("
+                      << 100.0 * metrics_.stateCallsFiltered / stateCalls << "%)" << std::endl;
+        }
+        std::cout << "Triangles/Frame: " << std::fixed << std::setprecision(0) << trianglesPerFrame << std::endl;
+        if (metrics_.fullDetailTriangles > 0) {
+            const double fullDetailPerFrame = static_cast<double>(metrics_.fullDetailTriangles) / metrics_.frameCount;
+            std::cout << "Full-Detail Triangles/Frame: " << fullDetailPerFrame << " (LOD saves "
+                      << std::setprecision(1) << 100.0 * (1.0 - trianglesPerFrame / fullDetailPerFrame) << "%)"
+                      << std::endl;
+        }
+        if (metrics_.vertexTransforms > 0) {
+            std::cout << "Vertex Shader Invocations/Frame (est.): " << std::setprecision(0)
+                      << static_cast<double>(metrics_.vertexTransforms) / metrics_.frameCount << std::endl;
+        }
+        if (metrics_.listIndexBytes > 0) {
+            std::cout << "Index Fetch/Frame: " << formatBytes(metrics_.indexBytes / metrics_.frameCount) << " ("
+                      << std::setprecision(1) << 100.0 * (1.0 - static_cast<double>(metrics_.indexBytes) / metrics_.listIndexBytes)
+                      << "% less than 32-bit triangle lists)" << std::endl;
+        }
+    }
     
     std::cout << "\nMemory Usage:" << std::endl;
     std::cout << "Total Memory: " << formatBytes(metrics_.memoryUsage) << std::endl;
     std::cout << "VBO Memory: " << formatBytes(metrics_.vboMemory) << std::endl;
     std::cout << "Texture Memory: " << formatBytes(metrics_.textureMemory) << std::endl;
+    if (metrics_.uploadBytes > 0) {
+        std::cout << "Uploaded: " << formatBytes(metrics_.uploadBytes) << " in " << formatTime(metrics_.uploadTime);
+        if (metrics_.uploadTime > 0.0) {
+            std::cout << " (" << std::fixed << std::setprecision(1)
+                      << metrics_.uploadBytes / (1024.0 * 1024.0) / (metrics_.uploadTime / 1000.0) << " MB/s)";
+        }
+        std::cout << std::endl;
+    }
     
     if (totalRuntime.count() > 0) {
         double avgDrawCallsPerSecond = static_cast<double>(metrics_.drawCalls) / totalRuntime.count();
@@ -0,0 +1,215 @@
+#include "program_cache.h"
+#include "atomic_file.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include "performance_monitor.h"
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+static const char PROGRAM_MAGIC[8] = { 'G', 'L', 'P', 'R', 'O', 'G', 'B', '\0' };
+
+struct ProgramHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t binaryFormat;      // As returned by glGetProgramBinary
+    uint64_t key;
+    uint64_t binarySize;
+};
+
+static std::string s_directory;
+static ProgramCache::Stats s_stats;
+static std::mutex s_statsMutex;     // Programs may be built on a worker context
+
+// FNV-1a, 64 bit
+static uint64_t hashBytes(uint64_t hash, const void* data, size_t size) {
+    const auto* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+// Length first, so that no two different sequences of strings hash alike
+static uint64_t hashString(uint64_t hash, const std::string& text) {
+    const uint64_t length = text.size();
+    hash = hashBytes(hash, &length, sizeof(length));
+    return hashBytes(hash, text.data(), text.size());
+}
+
+static std::string glString(GLenum name) {
+    const GLubyte* value = glGetString(name);
+    return value ? reinterpret_cast<const char*>(value) : "";
+}
+
+static bool isFormatSupported(GLenum format) {
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &count);
+    if (count <= 0) {
+        return false;
+    }
+    std::vector<GLint> formats(count);
+    glGetIntegerv(GL_PROGRAM_BINARY_FORMATS, formats.data());
+    return std::find(formats.begin(), formats.end(), static_cast<GLint>(format)) != formats.end();
+}
+
+void ProgramCache::setDirectory(const std::string& directory) {
+    s_directory = directory;
+    while (s_directory.size() > 1 && (s_directory.back() == '/' || s_directory.back() == '\\')) {
+        s_directory.pop_back();
+    }
+}
+
+const std::string& ProgramCache::getDirectory() {
+    return s_directory;
+}
+
+bool ProgramCache::isEnabled() {
+    if (s_directory.empty() || !(GLEW_VERSION_4_1 || GLEW_ARB_get_program_binary)) {
+        return false;
+    }
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &count);
+    return count > 0;
+}
+
+uint64_t ProgramCache::makeKey(const ShaderStages& stages) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    hash = hashBytes(hash, &VERSION, sizeof(VERSION));
+    hash = hashString(hash, glString(GL_VENDOR));
+    hash = hashString(hash, glString(GL_RENDERER));
+    hash = hashString(hash, glString(GL_VERSION));
+    for (const auto& stage : stages) {
+        const uint32_t type = stage.first;
+        hash = hashBytes(hash, &type, sizeof(type));
+        hash = hashString(hash, stage.second);
+    }
+    return hash;
+}
+
+std::string ProgramCache::pathFor(uint64_t key) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.bin", static_cast<unsigned long long>(key));
+    return s_directory + "/" + name;
+}
+
+GLuint ProgramCache::load(uint64_t key) {
+    if (!isEnabled()) {
+        return 0;
+    }
+    
+    // A missing or unreadable file is an ordinary miss: nothing is reported
+    std::ifstream in(pathFor(key), std::ios::binary);
+    ProgramHeader header;
+    if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        std::memcmp(header.magic, PROGRAM_MAGIC, sizeof(PROGRAM_MAGIC)) != 0 || header.version != VERSION ||
+        header.key != key || header.binarySize == 0 || header.binarySize > 0x7fffffffull) {
+        return 0;
+    }
+    std::vector<char> binary(static_cast<size_t>(header.binarySize));
+    if (!in.read(binary.data(), static_cast<std::streamsize>(binary.size()))) {
+        return 0;
+    }
+    
+    // Formats the driver does not list would raise GL_INVALID_ENUM
+    if (!isFormatSupported(header.binaryFormat)) {
+        std::lock_guard<std::mutex> lock(s_statsMutex);
+        s_stats.rejected++;
+        return 0;
+    }
+    
+    GLuint program = glCreateProgram();
+    glProgramBinary(program, header.binaryFormat, binary.data(), static_cast<GLsizei>(binary.size()));
+    GLint success = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success) {
+        glDeleteProgram(program);
+        std::lock_guard<std::mutex> lock(s_statsMutex);
+        s_stats.rejected++;
+        return 0;
+    }
+    return program;
+}
+
+bool ProgramCache::store(uint64_t key, GLuint program) {
+    if (!isEnabled()) {
+        return false;
+    }
+    
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) {
+        return false;
+    }
+    std::vector<char> binary(static_cast<size_t>(length));
+    GLenum format = 0;
+    GLsizei written = 0;
+    glGetProgramBinary(program, length, &written, &format, binary.data());
+    if (written <= 0) {
+        return false;
+    }
+
+#ifdef _WIN32
+    _mkdir(s_directory.c_str());
+#else
+    mkdir(s_directory.c_str(), 0755);
+#endif
+
+    ProgramHeader header = {};
+    std::memcpy(header.magic, PROGRAM_MAGIC, sizeof(PROGRAM_MAGIC));
+    header.version = VERSION;
+    header.binaryFormat = format;
+    header.key = key;
+    header.binarySize = static_cast<uint64_t>(written);
+    
+    const std::string path = pathFor(key);
+    AtomicFileWriter file(path);
+    if (!file.isOpen()) {
+        std::cerr << "Failed to write program binary: " << path << ".tmp" << std::endl;
+        return false;
+    }
+    file.stream().write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.stream().write(binary.data(), written);
+    if (!file.commit()) {
+        std::cerr << "Failed to write program binary: " << path << std::endl;
+        return false;
+    }
+    
+    std::lock_guard<std::mutex> lock(s_statsMutex);
+    s_stats.stored++;
+    return true;
+}
+
+void ProgramCache::recordBuild(bool fromCache, double milliseconds) {
+    std::lock_guard<std::mutex> lock(s_statsMutex);
+    if (fromCache) {
+        s_stats.hits++;
+        s_stats.loadMs += milliseconds;
+    } else {
+        s_stats.misses++;
+        s_stats.compileMs += milliseconds;
+    }
+}
+
+ProgramCache::Stats ProgramCache::getStats() {
+    std::lock_guard<std::mutex> lock(s_statsMutex);
+    return s_stats;
+}
+
+void ProgramCache::printReport() {
+    const Stats stats = getStats();
+    std::cout << "\n=== Shader Program Cache ===" << std::endl;
+    std::cout << "Directory: " << (s_directory.empty() ? "(disabled)" : s_directory) << std::endl;
+    std::cout << "From Binaries: " << stats.hits << " (" << PerformanceMonitor::formatTime(stats.loadMs) << ")"
+              << std::endl;
+    std::cout << "Compiled: " << stats.misses << " (" << PerformanceMonitor::formatTime(stats.compileMs) << ", "
+              << stats.rejected << " stale binaries, " << stats.stored << " stored)" << std::endl;
+    std::cout << "============================\n" << std::endl;
+}
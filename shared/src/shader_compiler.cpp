@@ -0,0 +1,185 @@
+#include "shader_compiler.h"
+#include <GLFW/glfw3.h>
+#include <chrono>
+#include <iostream>
+#include <memory>
+
+// A program whose compile and link have been issued but not checked
+struct PendingProgram {
+    GLuint program = 0;
+    std::vector<GLuint> shaders;    // Empty for a cached binary
+    uint64_t key = 0;
+    bool cached = false;            // ProgramCache enabled
+    bool fromCache = false;
+    double milliseconds = 0.0;      // GL thread time spent so far
+};
+
+static double millisecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Issues everything without querying a status, which is what would wait
+// for a parallel compile
+static PendingProgram beginProgram(const ShaderStages& stages) {
+    const auto start = std::chrono::steady_clock::now();
+    PendingProgram pending;
+    
+    // A cached binary skips compiling and linking altogether
+    pending.cached = ProgramCache::isEnabled();
+    pending.key = pending.cached ? ProgramCache::makeKey(stages) : 0;
+    pending.program = pending.cached ? ProgramCache::load(pending.key) : 0;
+    pending.fromCache = pending.program != 0;
+    if (!pending.fromCache) {
+        pending.program = glCreateProgram();
+        for (const auto& stage : stages) {
+            GLuint shader = glCreateShader(stage.first);
+            const char* sourcePtr = stage.second.c_str();
+            glShaderSource(shader, 1, &sourcePtr, nullptr);
+            glCompileShader(shader);
+            glAttachShader(pending.program, shader);
+            pending.shaders.push_back(shader);
+        }
+        if (pending.cached) {
+            glProgramParameteri(pending.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        }
+        glLinkProgram(pending.program);
+    }
+    
+    pending.milliseconds = millisecondsSince(start);
+    return pending;
+}
+
+static GLuint finishProgram(PendingProgram& pending) {
+    const auto start = std::chrono::steady_clock::now();
+    if (!pending.fromCache) {
+        GLint success;
+        glGetProgramiv(pending.program, GL_LINK_STATUS, &success);
+        if (!success) {
+            // A stage that failed to compile is the likelier culprit
+            for (GLuint shader : pending.shaders) {
+                glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+                if (!success) {
+                    GLchar infoLog[512];
+                    glGetShaderInfoLog(shader, 512, nullptr, infoLog);
+                    std::cerr << "Shader compilation failed:\n" << infoLog << std::endl;
+                }
+            }
+            GLchar infoLog[512];
+            glGetProgramInfoLog(pending.program, 512, nullptr, infoLog);
+            std::cerr << "Shader linking failed:\n" << infoLog << std::endl;
+            glDeleteProgram(pending.program);
+            pending.program = 0;
+        }
+        
+        // Clean up individual shaders
+        for (GLuint shader : pending.shaders) {
+            glDeleteShader(shader);
+        }
+        pending.shaders.clear();
+        
+        if (pending.cached && pending.program != 0) {
+            ProgramCache::store(pending.key, pending.program);
+        }
+    }
+    
+    ProgramCache::recordBuild(pending.fromCache, pending.milliseconds + millisecondsSince(start));
+    return pending.program;
+}
+
+const char* ShaderCompiler::modeName(Mode mode) {
+    switch (mode) {
+        case Mode::DriverThreads: return "driver threads (KHR_parallel_shader_compile)";
+        case Mode::WorkerContext: return "worker context";
+        default: return "synchronous";
+    }
+}
+
+GLuint ShaderCompiler::buildNow(const ShaderStages& stages) {
+    PendingProgram pending = beginProgram(stages);
+    return finishProgram(pending);
+}
+
+ShaderCompiler::~ShaderCompiler() {
+    shutdown();
+}
+
+void ShaderCompiler::initialize(GLFWwindow* sharedContext) {
+    shutdown();
+    
+    if (GLEW_KHR_parallel_shader_compile) {
+        // Let the driver pick how many threads to use
+        glMaxShaderCompilerThreadsKHR(0xFFFFFFFFu);
+        mode_ = Mode::DriverThreads;
+    } else if (sharedContext) {
+        // Like the render thread's context (shared with the main context)
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        workerContext_ = glfwCreateWindow(1, 1, "Shader Compiler Context", NULL, sharedContext);
+        if (workerContext_) {
+            shouldStop_ = false;
+            workerThread_ = std::thread(&ShaderCompiler::workerFunction, this);
+            mode_ = Mode::WorkerContext;
+        }
+    }
+    std::cout << "Shader compilation: " << modeName(mode_) << std::endl;
+}
+
+void ShaderCompiler::shutdown() {
+    if (workerThread_.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(queueMutex_);
+            shouldStop_ = true;
+        }
+        queueCondition_.notify_one();
+        workerThread_.join();
+    }
+    if (workerContext_) {
+        glfwDestroyWindow(workerContext_);
+        workerContext_ = nullptr;
+    }
+    mode_ = Mode::Synchronous;
+}
+
+std::shared_future<GLuint> ShaderCompiler::build(const ShaderStages& stages) {
+    if (mode_ == Mode::DriverThreads) {
+        // Deferred: the status checks run in get(), on the thread that waits
+        auto pending = std::make_shared<PendingProgram>(beginProgram(stages));
+        return std::async(std::launch::deferred, [pending]() { return finishProgram(*pending); }).share();
+    }
+    
+    auto promise = std::make_shared<std::promise<GLuint>>();
+    std::shared_future<GLuint> program = promise->get_future().share();
+    if (mode_ == Mode::WorkerContext) {
+        std::lock_guard<std::mutex> lock(queueMutex_);
+        jobs_.push_back([stages, promise]() {
+            GLuint built = buildNow(stages);
+            // Complete before the program is used from the other context
+            glFinish();
+            promise->set_value(built);
+        });
+        queueCondition_.notify_one();
+    } else {
+        promise->set_value(buildNow(stages));
+    }
+    return program;
+}
+
+void ShaderCompiler::workerFunction() {
+    glfwMakeContextCurrent(workerContext_);
+    
+    // Queued builds are finished even when stopping: their futures are waited on
+    while (true) {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(queueMutex_);
+            queueCondition_.wait(lock, [this] { return shouldStop_ || !jobs_.empty(); });
+            if (jobs_.empty()) {
+                break;
+            }
+            job = std::move(jobs_.front());
+            jobs_.pop_front();
+        }
+        job();
+    }
+    
+    glfwMakeContextCurrent(NULL);
+}
@@ -0,0 +1,178 @@
+#include "terrain_batch.h"
+#include "compute_terrain_generator.h"
+#include "gl_state.h"
+#include <iostream>
+
+const char* TerrainBatch::name(RenderMode mode) {
+    switch (mode) {
+        case RenderMode::PerPatch: return "patches";
+        case RenderMode::MultiDraw: return "multidraw";
+        case RenderMode::Indirect: return "indirect";
+        case RenderMode::Instanced: return "instanced";
+        case RenderMode::Heightmap: return "heightmap";
+        case RenderMode::Tessellated: return "tessellated";
+    }
+    return "unknown";
+}
+
+bool TerrainBatch::isSupported(RenderMode mode) {
+    if (mode == RenderMode::Indirect) {
+        // baseInstance in indirect commands is only honoured from 4.2 / ARB_base_instance
+        return GLEW_VERSION_4_3 || (GLEW_ARB_multi_draw_indirect && GLEW_ARB_base_instance);
+    }
+    return true;    // Core in 3.2
+}
+
+TerrainBatch::~TerrainBatch() {
+    release();
+}
+
+bool TerrainBatch::upload(const TerrainGenerator& generator, RenderMode mode, bool* newElementBuffer,
+                          ComputeTerrainGenerator* compute) {
+    release();
+    
+    const std::vector<TerrainPatch>& patches = generator.getPatches();
+    if (patches.empty() || mode == RenderMode::PerPatch || mode == RenderMode::Instanced ||
+        mode == RenderMode::Heightmap || mode == RenderMode::Tessellated) {
+        return false;
+    }
+    for (const auto& patch : patches) {
+        if (patch.topology != patches.front().topology) {
+            std::cerr << "Terrain batch needs patches of a single resolution" << std::endl;
+            return false;
+        }
+    }
+    
+    mode_ = mode;
+    topology_ = patches.front().topology;
+    format_ = patches.front().vertexFormat();
+    vertexBytes_ = generator.getVertexMemory();
+    firstPatch_ = &patches.front();
+    
+    glGenVertexArrays(1, &vao_);
+    glGenBuffers(1, &vbo_);
+    GLState::bindVertexArray(vao_);
+    
+    // The arena is already laid out patch after patch, and so is what the
+    // compute generator writes
+    GLState::bindBuffer(GL_ARRAY_BUFFER, vbo_);
+    if (compute && compute->isInitialized() && format_ == VertexFormat::Float &&
+        ComputeTerrainGenerator::getVertexBytes(generator) == vertexBytes_) {
+        glBufferData(GL_ARRAY_BUFFER, vertexBytes_, nullptr, GL_STATIC_DRAW);
+        computeGenerated_ = compute->generate(generator, vbo_);
+    }
+    if (!computeGenerated_) {
+        glBufferData(GL_ARRAY_BUFFER, vertexBytes_, generator.getVertexArenaData(), GL_STATIC_DRAW);
+    }
+    GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, topology_->getElementBuffer(newElementBuffer));
+    VertexFormats::setupAttributes(format_);
+    
+    if (mode_ == RenderMode::Indirect) {
+        glGenBuffers(1, &indirectBuffer_);
+        
+        // One range per patch, advanced per instance: with instanceCount 1
+        // a draw reads the entry at its baseInstance
+        if (format_ == VertexFormat::Packed) {
+            std::vector<glm::vec4> ranges;
+            ranges.reserve(patches.size());
+            for (const auto& patch : patches) {
+                ranges.push_back(VertexFormats::patchRange(patch.packedRange));
+            }
+            
+            glGenBuffers(1, &patchRangeBuffer_);
+            GLState::bindBuffer(GL_ARRAY_BUFFER, patchRangeBuffer_);
+            glBufferData(GL_ARRAY_BUFFER, ranges.size() * sizeof(glm::vec4), ranges.data(), GL_STATIC_DRAW);
+            glVertexAttribPointer(VertexFormats::PATCH_RANGE_ATTRIBUTE, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (void*)0);
+            glEnableVertexAttribArray(VertexFormats::PATCH_RANGE_ATTRIBUTE);
+            glVertexAttribDivisor(VertexFormats::PATCH_RANGE_ATTRIBUTE, 1);
+            vertexBytes_ += ranges.size() * sizeof(glm::vec4);
+        }
+    }
+    
+    GLState::bindVertexArray(0);
+    return true;
+}
+
+void TerrainBatch::release() {
+    if (vao_ != 0) {
+        GLState::deleteVertexArray(vao_);
+        GLState::deleteBuffer(vbo_);
+        vao_ = 0;
+        vbo_ = 0;
+    }
+    if (indirectBuffer_ != 0) {
+        GLState::deleteBuffer(indirectBuffer_);
+        indirectBuffer_ = 0;
+    }
+    if (patchRangeBuffer_ != 0) {
+        GLState::deleteBuffer(patchRangeBuffer_);
+        patchRangeBuffer_ = 0;
+    }
+    vertexBytes_ = 0;
+    computeGenerated_ = false;
+    topology_.reset();
+    firstPatch_ = nullptr;
+    counts_.clear();
+    offsets_.clear();
+    baseVertices_.clear();
+    patches_.clear();
+    commands_.clear();
+}
+
+void TerrainBatch::add(const TerrainPatch& patch, int lodLevel, int stitchMask) {
+    const PatchLod& range = topology_->range(lodLevel, stitchMask);
+    if (mode_ == RenderMode::Indirect) {
+        DrawElementsIndirectCommand command;
+        command.count = static_cast<GLuint>(range.indexCount);
+        command.instanceCount = 1;
+        command.firstIndex = static_cast<GLuint>(range.firstIndex);
+        command.baseVertex = static_cast<GLint>(patch.firstVertex);
+        command.baseInstance = static_cast<GLuint>(&patch - firstPatch_);
+        commands_.push_back(command);
+        return;
+    }
+    
+    counts_.push_back(static_cast<GLsizei>(range.indexCount));
+    offsets_.push_back(reinterpret_cast<const void*>(range.firstIndex * topology_->getIndexSize()));
+    baseVertices_.push_back(static_cast<GLint>(patch.firstVertex));
+    patches_.push_back(&patch);
+}
+
+int TerrainBatch::flush() {
+    const GLenum mode = topology_ ? topology_->getPrimitiveMode() : GL_TRIANGLES;
+    const GLenum indexType = topology_ ? topology_->getIndexType() : GL_UNSIGNED_INT;
+    int drawCalls = 0;
+    
+    if (!commands_.empty()) {
+        GLState::bindVertexArray(vao_);
+        GLState::bindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer_);
+        
+        // Respecified every frame; the driver hands out fresh storage if the
+        // previous frame's draw is still reading the old commands
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, commands_.size() * sizeof(DrawElementsIndirectCommand),
+                     commands_.data(), GL_STREAM_DRAW);
+        glMultiDrawElementsIndirect(mode, indexType, (void*)0, static_cast<GLsizei>(commands_.size()), 0);
+        drawCalls = 1;
+    } else if (!counts_.empty()) {
+        GLState::bindVertexArray(vao_);
+        if (format_ == VertexFormat::Packed) {
+            for (size_t i = 0; i < counts_.size(); i++) {
+                VertexFormats::setPatchRange(patches_[i]->packedRange);
+                glDrawElementsBaseVertex(mode, counts_[i], indexType, offsets_[i], baseVertices_[i]);
+            }
+            drawCalls = static_cast<int>(counts_.size());
+        } else {
+            glMultiDrawElementsBaseVertex(mode, counts_.data(), indexType, offsets_.data(),
+                                          static_cast<GLsizei>(counts_.size()), baseVertices_.data());
+            drawCalls = 1;
+        }
+    }
+    
+    // Keeps the capacity for the next frame
+    counts_.clear();
+    offsets_.clear();
+    baseVertices_.clear();
+    patches_.clear();
+    commands_.clear();
+    return drawCalls;
+}
@@ -0,0 +1,282 @@
+#include "terrain_benchmark.h"
+#include "terrain_generator.h"
+#include <algorithm>
+#include <cmath>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+void TerrainBenchmark::runNoiseBenchmark(TerrainGenerator& generator, size_t sampleCount) {
+    const NoiseKernel originalKernel = generator.getNoiseKernel();
+    const NoiseBackend originalBackend = generator.getNoiseBackend();
+    const int rowLength = std::max(1, generator.getGridSize() + 1);
+    const size_t rowCount = std::max<size_t>(1, sampleCount / rowLength);
+    
+    std::cout << "\n=== Noise Kernel Benchmark ===" << std::endl;
+    std::cout << "Samples: " << rowCount * rowLength << " (" << rowCount << " rows of "
+              << rowLength << ")" << std::endl;
+    
+    // The kernels only implement the classic noise; the gradient backend
+    // would ignore the selection
+    generator.setNoiseBackend(NoiseBackend::Classic);
+    
+    // Reference rows from the scalar kernel, used to check the SIMD output
+    std::vector<float> reference(rowLength);
+    std::vector<float> row(rowLength);
+    double scalarRate = 0.0;
+    
+    const NoiseKernel kernels[] = { NoiseKernel::Scalar, NoiseKernel::SSE41, NoiseKernel::AVX2 };
+    for (NoiseKernel kernel : kernels) {
+        if (!NoiseKernels::isSupported(kernel)) {
+            std::cout << std::setw(8) << NoiseKernels::name(kernel) << ": not supported on this CPU" << std::endl;
+            continue;
+        }
+        generator.setNoiseKernel(kernel);
+        
+        float checksum = 0.0f;
+        auto start = std::chrono::high_resolution_clock::now();
+        for (size_t z = 0; z < rowCount; z++) {
+            generator.heightRow(static_cast<float>(z), 0, rowLength, row.data());
+            checksum += row[z % rowLength];
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+        double rate = (rowCount * rowLength) / std::max(seconds, 1e-9);
+        
+        // Bit-exact comparison against scalar on a handful of rows
+        bool matches = true;
+        for (size_t z = 0; z < std::min<size_t>(rowCount, 64); z++) {
+            generator.setNoiseKernel(NoiseKernel::Scalar);
+            generator.heightRow(static_cast<float>(z) * 0.37f, -rowLength / 2, rowLength, reference.data());
+            generator.setNoiseKernel(kernel);
+            generator.heightRow(static_cast<float>(z) * 0.37f, -rowLength / 2, rowLength, row.data());
+            matches = matches && std::memcmp(reference.data(), row.data(), rowLength * sizeof(float)) == 0;
+        }
+        
+        if (kernel == NoiseKernel::Scalar) {
+            scalarRate = rate;
+        }
+        
+        std::cout << std::setw(8) << NoiseKernels::name(kernel) << ": "
+                  << std::fixed << std::setprecision(1) << rate / 1e6 << " M samples/s"
+                  << "  (" << std::setprecision(2) << rate / scalarRate << "x scalar"
+                  << ", " << (matches ? "bit-exact" : "MISMATCH") << ", checksum " << checksum << ")" << std::endl;
+    }
+    
+    generator.setNoiseKernel(originalKernel);
+    generator.setNoiseBackend(originalBackend);
+    std::cout << "==============================\n" << std::endl;
+}
+
+void TerrainBenchmark::runNormalBenchmark(TerrainGenerator& generator) {
+    const NoiseBackend originalBackend = generator.getNoiseBackend();
+    const int originalSubdivisions = generator.getHeightfieldSubdivisions();
+    const bool originalAnalyticNormals = generator.getAnalyticNormals();
+    
+    auto timeGeneration = [&generator]() {
+        auto start = std::chrono::high_resolution_clock::now();
+        generator.generateTerrain();
+        return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    };
+    
+    auto collectNormals = [&generator]() {
+        std::vector<glm::vec3> normals;
+        normals.reserve(generator.getTotalVertices());
+        for (const auto& patch : generator.getPatches()) {
+            for (size_t i = 0; i < patch.vertexCount(); i++) {
+                normals.push_back(patch.vertexData()[i].normal);
+            }
+        }
+        return normals;
+    };
+    
+    std::cout << "\n=== Normal Generation Benchmark ===" << std::endl;
+    
+    generator.setNoiseBackend(NoiseBackend::Classic);
+    generator.setHeightfieldSubdivisions(1);
+    const double classicMs = timeGeneration();
+    
+    // Ground truth: analytic derivatives of the gradient noise
+    generator.setNoiseBackend(NoiseBackend::Gradient);
+    generator.setAnalyticNormals(true);
+    const double analyticMs = timeGeneration();
+    const std::vector<glm::vec3> reference = collectNormals();
+    
+    struct Result { int subdivisions; double ms; double meanError; double maxError; };
+    std::vector<Result> results;
+    
+    generator.setAnalyticNormals(false);
+    for (int subdivisions : { 1, 2, 4 }) {
+        generator.setHeightfieldSubdivisions(subdivisions);
+        Result result{ subdivisions, timeGeneration(), 0.0, 0.0 };
+        
+        const std::vector<glm::vec3> normals = collectNormals();
+        for (size_t i = 0; i < normals.size(); i++) {
+            double cosine = glm::clamp(glm::dot(normals[i], reference[i]), -1.0f, 1.0f);
+            double degrees = std::acos(cosine) * 180.0 / 3.14159265358979;
+            result.meanError += degrees;
+            result.maxError = std::max(result.maxError, degrees);
+        }
+        result.meanError /= std::max<size_t>(normals.size(), 1);
+        results.push_back(result);
+    }
+    
+    std::cout << "\nGeneration time (" << generator.getTotalVertices() << " vertices):" << std::endl;
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "  classic noise, finite differences:  " << classicMs << " ms" << std::endl;
+    std::cout << "  gradient noise, analytic normals:   " << analyticMs << " ms" << std::endl;
+    for (const Result& result : results) {
+        std::cout << "  gradient noise, finite differences (" << result.subdivisions << "x heightfield): "
+                  << result.ms << " ms, normal error mean " << std::setprecision(3) << result.meanError
+                  << " deg / max " << result.maxError << " deg" << std::setprecision(2) << std::endl;
+    }
+    std::cout << "==================================\n" << std::endl;
+    
+    generator.setNoiseBackend(originalBackend);
+    generator.setHeightfieldSubdivisions(originalSubdivisions);
+    generator.setAnalyticNormals(originalAnalyticNormals);
+}
+
+void TerrainBenchmark::runVertexFormatBenchmark(TerrainGenerator& generator) {
+    const VertexFormat originalFormat = generator.getVertexFormat();
+    const float gridSpacing = generator.getPatchSize();
+    
+    std::cout << "\n=== Vertex Format Benchmark ===" << std::endl;
+    
+    struct Result { VertexFormat format; double generationMs; size_t bytes; double copyMs; };
+    std::vector<Result> results;
+    double maxPositionError = 0.0;
+    double maxNormalError = 0.0;
+    
+    for (VertexFormat format : { VertexFormat::Float, VertexFormat::Packed }) {
+        generator.setVertexFormat(format);
+        
+        auto start = std::chrono::high_resolution_clock::now();
+        generator.generateTerrain();
+        Result result{ format, std::chrono::duration<double, std::milli>(
+            std::chrono::high_resolution_clock::now() - start).count(), generator.getVertexMemory(), 0.0 };
+        
+        // Copy every patch's GPU data into one staging buffer, best of 5
+        std::vector<uint8_t> staging(result.bytes);
+        result.copyMs = 1e9;
+        for (int run = 0; run < 5; run++) {
+            start = std::chrono::high_resolution_clock::now();
+            size_t offset = 0;
+            for (const auto& patch : generator.getPatches()) {
+                std::memcpy(staging.data() + offset, patch.gpuVertexData(), patch.gpuVertexBytes());
+                offset += patch.gpuVertexBytes();
+            }
+            result.copyMs = std::min(result.copyMs, std::chrono::duration<double, std::milli>(
+                std::chrono::high_resolution_clock::now() - start).count());
+        }
+        results.push_back(result);
+        
+        if (format == VertexFormat::Packed) {
+            for (const auto& patch : generator.getPatches()) {
+                for (size_t i = 0; i < patch.vertexCount(); i++) {
+                    const TerrainVertex& reference = patch.vertexData()[i];
+                    const TerrainVertex decoded = VertexFormats::unpack(patch.packedVertexData()[i], patch.packedRange, gridSpacing);
+                    
+                    // x/z are exact grid positions; only height and normal are quantized
+                    maxPositionError = std::max(maxPositionError, static_cast<double>(
+                        std::fabs(decoded.position.y - reference.position.y) +
+                        glm::length(glm::vec2(decoded.position.x - reference.position.x,
+                                              decoded.position.z - reference.position.z))));
+                    double cosine = glm::clamp(glm::dot(decoded.normal, reference.normal), -1.0f, 1.0f);
+                    maxNormalError = std::max(maxNormalError, std::acos(cosine) * 180.0 / 3.14159265358979);
+                }
+            }
+        }
+    }
+    
+    std::cout << "Vertices: " << generator.getTotalVertices() << std::endl;
+    std::cout << std::fixed << std::setprecision(2);
+    for (const Result& result : results) {
+        std::cout << std::setw(8) << VertexFormats::name(result.format) << ": "
+                  << VertexFormats::stride(result.format) << " bytes/vertex, "
+                  << result.bytes / (1024.0 * 1024.0) << " MB, generation " << result.generationMs << " ms, copy "
+                  << result.copyMs << " ms (" << result.bytes / (1024.0 * 1024.0) / std::max(result.copyMs / 1000.0, 1e-9)
+                  << " MB/s)" << std::endl;
+    }
+    std::cout << "Packed/float memory: " << std::setprecision(1)
+              << 100.0 * results[1].bytes / std::max<size_t>(results[0].bytes, 1) << "%" << std::endl;
+    std::cout << "Packed decode error: position " << std::setprecision(4) << maxPositionError
+              << " units, normal " << maxNormalError << " deg (max)" << std::endl;
+    std::cout << "================================\n" << std::endl;
+    
+    generator.setVertexFormat(originalFormat);
+}
+
+void TerrainBenchmark::runVertexCacheBenchmark(const TerrainGenerator& generator) {
+    const int quadsPerSide = generator.getGridSize() / generator.getPatchesPerRow();
+    const int patchCount = generator.getPatchesPerRow() * generator.getPatchesPerRow();
+    
+    auto timeCreation = [quadsPerSide](bool optimize, std::shared_ptr<const PatchTopology>& topology) {
+        auto start = std::chrono::high_resolution_clock::now();
+        topology = PatchTopology::create(quadsPerSide, PatchPrimitive::Triangles, optimize);
+        return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    };
+    std::shared_ptr<const PatchTopology> rowMajor, optimized;
+    const double rowMajorMs = timeCreation(false, rowMajor);
+    const double optimizedMs = timeCreation(true, optimized);
+    
+    std::cout << "\n=== Vertex Cache Benchmark ===" << std::endl;
+    std::cout << "Patch: " << quadsPerSide << "x" << quadsPerSide << " quads, " << optimized->getLodCount()
+              << " LOD levels x " << PatchTopology::STITCH_VARIANTS << " stitch variants" << std::endl;
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "Topology build: " << rowMajorMs << " ms row-major, " << optimizedMs << " ms optimized" << std::endl;
+    
+    auto stats = [](const PatchTopology& topology, int level, int cacheSize) {
+        const PatchLod& range = topology.range(level);
+        return PatchTopology::simulateVertexCache(&topology.getIndices()[range.firstIndex], range.indexCount, cacheSize,
+                                                  sizeof(TerrainVertex));
+    };
+    
+    for (int cacheSize : { 16, 32 }) {
+        std::cout << "\nFIFO cache of " << cacheSize << " vertices (ACMR / ATVR / fetch overfetch):" << std::endl;
+        for (int level = 0; level < optimized->getLodCount(); level++) {
+            const VertexCacheStats before = stats(*rowMajor, level, cacheSize);
+            const VertexCacheStats after = stats(*optimized, level, cacheSize);
+            std::cout << "  level " << level << " (" << std::setw(6) << after.triangles << " tris): row-major "
+                      << std::setprecision(3) << before.acmr() << " / " << before.atvr() << " / "
+                      << before.overfetch() << ", optimized "
+                      << std::setprecision(3) << after.acmr() << " / " << after.atvr() << " / "
+                      << after.overfetch() << std::endl;
+        }
+    }
+    
+    // What a frame drawing every patch at full detail costs in vertex shader runs
+    const size_t before = stats(*rowMajor, 0, PatchTopology::VERTEX_CACHE_SIZE).transforms * patchCount;
+    const size_t after = stats(*optimized, 0, PatchTopology::VERTEX_CACHE_SIZE).transforms * patchCount;
+    std::cout << "\nVertex shader invocations per full-detail frame (" << patchCount << " patches): "
+              << before << " row-major, " << after << " optimized (" << std::setprecision(1)
+              << 100.0 * (1.0 - static_cast<double>(after) / std::max<size_t>(before, 1)) << "% fewer)" << std::endl;
+    
+    // Index size and primitive: memory of all variants, and index data read
+    // by one full-detail frame
+    const auto strips = PatchTopology::create(quadsPerSide, PatchPrimitive::TriangleStrips);
+    const PatchLod& listRange = optimized->range(0);
+    const PatchLod& stripRange = strips->range(0);
+    const VertexCacheStats stripStats = PatchTopology::simulateVertexCache(
+        &strips->getIndices()[stripRange.firstIndex], stripRange.indexCount, PatchTopology::VERTEX_CACHE_SIZE,
+        sizeof(TerrainVertex), PatchPrimitive::TriangleStrips);
+    
+    struct IndexFormat { const char* name; size_t memory; size_t frameBytes; double acmr; };
+    const IndexFormat formats[] = {
+        { "32-bit triangles", optimized->getListIndexBytes(), listRange.indexCount * sizeof(unsigned int),
+          stats(*optimized, 0, PatchTopology::VERTEX_CACHE_SIZE).acmr() },
+        { (optimized->getIndexSize() == 2 ? "16-bit triangles" : "32-bit triangles"), optimized->getIndexBytes(),
+          listRange.indexCount * optimized->getIndexSize(), stats(*optimized, 0, PatchTopology::VERTEX_CACHE_SIZE).acmr() },
+        { (strips->getIndexSize() == 2 ? "16-bit strips" : "32-bit strips"), strips->getIndexBytes(),
+          stripRange.indexCount * strips->getIndexSize(), stripStats.acmr() },
+    };
+    std::cout << "\nIndex formats (all variants / per full-detail frame / ACMR):" << std::endl;
+    for (const IndexFormat& format : formats) {
+        std::cout << "  " << std::setw(16) << format.name << ": " << std::setprecision(1)
+                  << format.memory / 1024.0 << " KB / " << format.frameBytes * patchCount / 1024.0 << " KB ("
+                  << 100.0 * format.memory / std::max<size_t>(formats[0].memory, 1) << "%) / "
+                  << std::setprecision(3) << format.acmr << std::endl;
+    }
+    std::cout << "==============================\n" << std::endl;
+}
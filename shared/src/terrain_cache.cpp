@@ -0,0 +1,296 @@
+#include "terrain_cache.h"
+#include "atomic_file.h"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const char CACHE_MAGIC[8] = { 'T', 'E', 'R', 'R', 'A', 'I', 'N', '\0' };
+static const uint64_t BLOB_ALIGNMENT = 64;
+
+struct CacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t vertexStride;      // sizeof(TerrainVertex) when written
+    TerrainCacheKey key;
+    uint32_t patchCount;
+    uint32_t heightfieldSize;   // Samples per side
+    uint64_t patchTableOffset;
+    uint64_t lodErrorOffset;
+    uint64_t lodErrorCount;
+    uint64_t vertexDataOffset;
+    uint64_t heightfieldOffset;
+    uint64_t fileSize;
+};
+
+struct CachePatchEntry {
+    uint64_t firstVertex;       // In vertices from the start of the vertex blob
+    uint64_t vertexCount;
+    float center[3];
+    float boundingRadius;
+    int32_t lodLevel;
+    int32_t quadsPerSide;       // Selects the shared index topology
+    uint32_t firstLodError;     // Into the LOD error table
+    uint32_t lodCount;
+};
+
+static uint64_t alignUp(uint64_t value) {
+    return (value + BLOB_ALIGNMENT - 1) & ~(BLOB_ALIGNMENT - 1);
+}
+
+static void writePadding(std::ofstream& out, uint64_t alignedOffset) {
+    static const char zeros[BLOB_ALIGNMENT] = {};
+    uint64_t position = static_cast<uint64_t>(out.tellp());
+    out.write(zeros, static_cast<std::streamsize>(alignedOffset - position));
+}
+
+// MappedFile implementation
+MappedFile::~MappedFile() {
+    close();
+}
+
+bool MappedFile::open(const std::string& path) {
+    close();
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+        CloseHandle(file);
+        return false;
+    }
+    
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping) {
+        CloseHandle(file);
+        return false;
+    }
+    
+    void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!view) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+    
+    fileHandle_ = file;
+    mappingHandle_ = mapping;
+    data_ = static_cast<const uint8_t*>(view);
+    size_ = static_cast<size_t>(fileSize.QuadPart);
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        ::close(fd);
+        return false;
+    }
+    
+    void* view = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd); // The mapping keeps its own reference to the file
+    if (view == MAP_FAILED) {
+        return false;
+    }
+    
+    // Upload walks the blobs front to back
+    madvise(view, static_cast<size_t>(info.st_size), MADV_SEQUENTIAL);
+    
+    data_ = static_cast<const uint8_t*>(view);
+    size_ = static_cast<size_t>(info.st_size);
+#endif
+    return true;
+}
+
+void MappedFile::close() {
+    if (!data_) {
+        return;
+    }
+
+#ifdef _WIN32
+    UnmapViewOfFile(data_);
+    CloseHandle(static_cast<HANDLE>(mappingHandle_));
+    CloseHandle(static_cast<HANDLE>(fileHandle_));
+    mappingHandle_ = nullptr;
+    fileHandle_ = nullptr;
+#else
+    munmap(const_cast<uint8_t*>(data_), size_);
+#endif
+    data_ = nullptr;
+    size_ = 0;
+}
+
+// TerrainCacheKey implementation
+bool TerrainCacheKey::operator==(const TerrainCacheKey& other) const {
+    return seed == other.seed && gridSize == other.gridSize && patchesPerRow == other.patchesPerRow &&
+           heightScale == other.heightScale && patchSize == other.patchSize &&
+           noiseBackend == other.noiseBackend && heightfieldSubdivisions == other.heightfieldSubdivisions &&
+           analyticNormals == other.analyticNormals;
+}
+
+// TerrainCache implementation
+bool TerrainCache::save(const std::string& path, const TerrainCacheKey& key, const std::vector<TerrainPatch>& patches,
+                        const std::vector<float>& heightfield, int heightfieldSize) {
+    CacheHeader header = {};
+    std::memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    header.version = VERSION;
+    header.vertexStride = sizeof(TerrainVertex);
+    header.key = key;
+    header.patchCount = static_cast<uint32_t>(patches.size());
+    header.heightfieldSize = static_cast<uint32_t>(heightfieldSize);
+    
+    // Indices are not stored: every patch of a resolution shares one topology
+    // that is cheap to rebuild
+    std::vector<CachePatchEntry> entries(patches.size());
+    std::vector<float> lodErrors;
+    uint64_t totalVertices = 0;
+    for (size_t i = 0; i < patches.size(); i++) {
+        const TerrainPatch& patch = patches[i];
+        CachePatchEntry& entry = entries[i];
+        entry.firstVertex = totalVertices;
+        entry.vertexCount = patch.vertexCount();
+        entry.center[0] = patch.center.x;
+        entry.center[1] = patch.center.y;
+        entry.center[2] = patch.center.z;
+        entry.boundingRadius = patch.boundingRadius;
+        entry.lodLevel = patch.lodLevel;
+        entry.quadsPerSide = patch.topology->getQuadsPerSide();
+        entry.firstLodError = static_cast<uint32_t>(lodErrors.size());
+        entry.lodCount = static_cast<uint32_t>(patch.lodErrors.size());
+        lodErrors.insert(lodErrors.end(), patch.lodErrors.begin(), patch.lodErrors.end());
+        
+        totalVertices += entry.vertexCount;
+    }
+    
+    header.patchTableOffset = alignUp(sizeof(CacheHeader));
+    header.lodErrorOffset = alignUp(header.patchTableOffset + entries.size() * sizeof(CachePatchEntry));
+    header.lodErrorCount = lodErrors.size();
+    header.vertexDataOffset = alignUp(header.lodErrorOffset + lodErrors.size() * sizeof(float));
+    header.heightfieldOffset = alignUp(header.vertexDataOffset + totalVertices * sizeof(TerrainVertex));
+    header.fileSize = header.heightfieldOffset + heightfield.size() * sizeof(float);
+    
+    // Written beside the old cache and swapped in once complete
+    AtomicFileWriter file(path);
+    if (!file.isOpen()) {
+        std::cerr << "Failed to write terrain cache: " << path << ".tmp" << std::endl;
+        return false;
+    }
+    std::ofstream& out = file.stream();
+    
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    writePadding(out, header.patchTableOffset);
+    out.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(CachePatchEntry));
+    
+    writePadding(out, header.lodErrorOffset);
+    out.write(reinterpret_cast<const char*>(lodErrors.data()), lodErrors.size() * sizeof(float));
+    
+    writePadding(out, header.vertexDataOffset);
+    for (const auto& patch : patches) {
+        out.write(reinterpret_cast<const char*>(patch.vertexData()), patch.vertexCount() * sizeof(TerrainVertex));
+    }
+    
+    writePadding(out, header.heightfieldOffset);
+    out.write(reinterpret_cast<const char*>(heightfield.data()), heightfield.size() * sizeof(float));
+    
+    if (!file.commit()) {
+        std::cerr << "Failed to write terrain cache: " << path << std::endl;
+        return false;
+    }
+    
+    std::cout << "Wrote terrain cache " << path << " (" << header.fileSize << " bytes)" << std::endl;
+    return true;
+}
+
+bool TerrainCache::load(const std::string& path, const TerrainCacheKey& key, PatchPrimitive primitive, MappedFile& file,
+                        std::vector<TerrainPatch>& patches, std::vector<float>& heightfield, int& heightfieldSize) {
+    if (!file.open(path)) {
+        return false;
+    }
+    
+    auto reject = [&file, &path](const char* reason) {
+        std::cout << "Ignoring terrain cache " << path << ": " << reason << std::endl;
+        file.close();
+        return false;
+    };
+    
+    if (file.size() < sizeof(CacheHeader)) {
+        return reject("truncated header");
+    }
+    
+    CacheHeader header;
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (std::memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0) {
+        return reject("not a terrain cache");
+    }
+    if (header.version != VERSION || header.vertexStride != sizeof(TerrainVertex)) {
+        return reject("format version mismatch");
+    }
+    if (header.key != key) {
+        return reject("built with different terrain settings");
+    }
+    if (header.fileSize != file.size() ||
+        header.patchTableOffset + header.patchCount * sizeof(CachePatchEntry) > header.lodErrorOffset ||
+        header.lodErrorOffset + header.lodErrorCount * sizeof(float) > header.vertexDataOffset ||
+        header.vertexDataOffset > header.heightfieldOffset ||
+        header.heightfieldOffset + static_cast<uint64_t>(header.heightfieldSize) * header.heightfieldSize * sizeof(float) !=
+            header.fileSize) {
+        return reject("corrupt layout");
+    }
+    
+    const auto* entries = reinterpret_cast<const CachePatchEntry*>(file.data() + header.patchTableOffset);
+    const auto* lodErrors = reinterpret_cast<const float*>(file.data() + header.lodErrorOffset);
+    const auto* vertexBlob = reinterpret_cast<const TerrainVertex*>(file.data() + header.vertexDataOffset);
+    const uint64_t vertexCapacity = (header.heightfieldOffset - header.vertexDataOffset) / sizeof(TerrainVertex);
+    
+    for (uint32_t i = 0; i < header.patchCount; i++) {
+        const CachePatchEntry& entry = entries[i];
+        const uint64_t verticesPerRow = static_cast<uint64_t>(entry.quadsPerSide) + 1;
+        if (entry.firstVertex + entry.vertexCount > vertexCapacity ||
+            static_cast<uint64_t>(entry.firstLodError) + entry.lodCount > header.lodErrorCount ||
+            entry.quadsPerSide <= 0 || entry.vertexCount != verticesPerRow * verticesPerRow ||
+            static_cast<int>(entry.lodCount) != PatchTopology::lodCountFor(entry.quadsPerSide)) {
+            return reject("patch table out of range");
+        }
+    }
+    
+    // Patches reference the mapped pages directly; nothing is copied
+    patches.clear();
+    patches.resize(header.patchCount);
+    for (uint32_t i = 0; i < header.patchCount; i++) {
+        const CachePatchEntry& entry = entries[i];
+        TerrainPatch& patch = patches[i];
+        patch.sharedVertices = vertexBlob + entry.firstVertex;
+        patch.sharedVertexCount = static_cast<size_t>(entry.vertexCount);
+        patch.firstVertex = static_cast<size_t>(entry.firstVertex);
+        patch.topology = PatchTopology::get(entry.quadsPerSide, primitive);
+        patch.lodErrors.assign(lodErrors + entry.firstLodError, lodErrors + entry.firstLodError + entry.lodCount);
+        patch.center = glm::vec3(entry.center[0], entry.center[1], entry.center[2]);
+        patch.boundingRadius = entry.boundingRadius;
+        patch.lodLevel = entry.lodLevel;
+    }
+    
+    const auto* heights = reinterpret_cast<const float*>(file.data() + header.heightfieldOffset);
+    heightfieldSize = static_cast<int>(header.heightfieldSize);
+    heightfield.assign(heights, heights + static_cast<size_t>(heightfieldSize) * heightfieldSize);
+    
+    return true;
+}
@@ -1,34 +1,72 @@
 #include "terrain_generator.h"
+#include "terrain_cache.h"
+#include "allocation_tracker.h"
+#include "gl_state.h"
 #include <cmath>
 #include <random>
 #include <algorithm>
+#include <numeric>
 #include <iostream>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+const void* TerrainPatch::gpuVertexData() const {
+    if (vertexFormat() == VertexFormat::Packed) {
+        return packedVertexData();
+    }
+    return vertexData();
+}
+
+size_t TerrainPatch::gpuVertexBytes() const {
+    return vertexCount() * VertexFormats::stride(vertexFormat());
+}
 
 TerrainGenerator::TerrainGenerator(int gridSize, float patchSize, float heightScale)
     : gridSize_(gridSize), patchSize_(patchSize), heightScale_(heightScale), 
-      patchesPerRow_(8), noiseInitialized_(false) { // Default 8x8 = 64 patches
+      patchesPerRow_(8), generationThreads_(0), heightfieldSize_(0), heightfieldSubdivisions_(1),
+      seed_(-1), noiseInitialized_(false), noiseBackend_(NoiseBackend::Classic),
+      analyticNormals_(true), vertexFormat_(VertexFormat::Float),
+      primitive_(PatchPrimitive::Triangles) { // Default 8x8 = 64 patches
     initializeNoise();
+    setNoiseKernel(NoiseKernel::Auto);
 }
 
 TerrainGenerator::~TerrainGenerator() {
+    clear();
+}
+
+void TerrainGenerator::releaseBuffers(std::vector<TerrainPatch>& patches) {
     // Clean up OpenGL resources if they were created
-    for (auto& patch : patches_) {
+    for (auto& patch : patches) {
         if (patch.VAO != 0) {
-            glDeleteVertexArrays(1, &patch.VAO);
-            glDeleteBuffers(1, &patch.VBO);
-            glDeleteBuffers(1, &patch.EBO);
+            GLState::deleteVertexArray(patch.VAO);
+            GLState::deleteBuffer(patch.VBO);
+            patch.VAO = 0;
+            patch.VBO = 0;
+            patch.isUploaded = false;
         }
     }
 }
 
+void TerrainGenerator::clear() {
+    releaseBuffers(patches_);
+    patches_.clear();
+    mappedCache_.reset();
+    std::vector<TerrainVertex>().swap(vertexArena_);
+    std::vector<PackedTerrainVertex>().swap(packedArena_);
+    heightfield_.clear();
+    heightfieldDx_.clear();
+    heightfieldDz_.clear();
+}
+
 void TerrainGenerator::initializeNoise() {
     if (noiseInitialized_) return;
     
     // Initialize permutation table for Perlin noise
     permutation_.resize(256);
     std::iota(permutation_.begin(), permutation_.end(), 0);
-    std::random_device rd;
-    std::mt19937 g(rd());
+    std::mt19937 g(seed_ >= 0 ? static_cast<std::mt19937::result_type>(seed_) : std::random_device{}());
     std::shuffle(permutation_.begin(), permutation_.end(), g);
     
     // Duplicate for overflow
@@ -36,130 +74,520 @@ void TerrainGenerator::initializeNoise() {
     noiseInitialized_ = true;
 }
 
+void TerrainGenerator::setSeed(int seed) {
+    if (seed == seed_ && noiseInitialized_) return;
+    
+    seed_ = seed;
+    noiseInitialized_ = false;
+    initializeNoise();
+}
+
+void TerrainGenerator::configure(const TerrainConfig& config) {
+    setGridSize(config.gridSize);
+    setPatchCount(config.patchCount);
+    setHeightScale(config.heightScale);
+    setGenerationThreads(config.generationThreads);
+    setNoiseBackend(config.noiseBackend);
+    setVertexFormat(config.vertexFormat);
+    setPrimitive(config.primitive);
+    if (config.seed >= 0) {
+        setSeed(config.seed);
+    }
+}
+
+void TerrainGenerator::setNoiseKernel(NoiseKernel kernel) {
+    noiseKernel_ = NoiseKernels::resolve(kernel);
+    noiseBatch_ = NoiseKernels::get(noiseKernel_);
+}
+
 float TerrainGenerator::getHeight(float x, float z) const {
+    if (noiseBackend_ == NoiseBackend::Gradient) {
+        float dx, dz;
+        return NoiseKernels::sampleGradient(permutation_.data(), x * 0.1f, z * 0.1f, 4, 0.5f, dx, dz) * heightScale_;
+    }
     return perlinNoise(x * 0.1f, z * 0.1f, 4, 0.5f) * heightScale_;
 }
 
 float TerrainGenerator::perlinNoise(float x, float z, int octaves, float persistence) const {
-    float total = 0.0f;
-    float frequency = 1.0f;
-    float amplitude = 1.0f;
-    float maxValue = 0.0f;
-    
-    for (int i = 0; i < octaves; i++) {
-        total += grad(permutation_[static_cast<int>(x * frequency) & 255] + 
-                     permutation_[static_cast<int>(z * frequency) & 255],
-                     x * frequency, z * frequency) * amplitude;
-        
-        maxValue += amplitude;
-        amplitude *= persistence;
-        frequency *= 2.0f;
-    }
-    
-    return total / maxValue;
+    return NoiseKernels::sample(permutation_.data(), x, z, octaves, persistence);
+}
+
+NoiseBatchParams TerrainGenerator::heightParams() const {
+    // Same noise parameters as getHeight()
+    NoiseBatchParams params;
+    params.permutation = permutation_.data();
+    params.octaves = 4;
+    params.persistence = 0.5f;
+    params.inputScale = 0.1f;
+    params.outputScale = heightScale_;
+    return params;
 }
 
-float TerrainGenerator::grad(int hash, float x, float z) const {
-    int h = hash & 15;
-    float u = h < 8 ? x : z;
-    float v = h < 4 ? z : h == 12 || h == 14 ? x : 0;
-    return ((h & 1) == 0 ? u : -u) + ((h & 2) == 0 ? v : -v);
+void TerrainGenerator::heightBatch(const float* xs, float z, int count, float* out) const {
+    if (noiseBackend_ == NoiseBackend::Gradient) {
+        NoiseKernels::evaluateGradient(heightParams(), xs, z, count, out, nullptr, nullptr);
+        return;
+    }
+    noiseBatch_(heightParams(), xs, z, count, out);
 }
 
-glm::vec3 TerrainGenerator::calculateNormal(float x, float z) const {
-    float delta = 0.1f;
-    float hL = getHeight(x - delta, z);
-    float hR = getHeight(x + delta, z);
-    float hD = getHeight(x, z - delta);
-    float hU = getHeight(x, z + delta);
+void TerrainGenerator::heightRow(float z, int startX, int count, float* out) const {
+    constexpr int CHUNK = 64;
+    float xs[CHUNK];
     
-    glm::vec3 normal(hL - hR, 2.0f * delta, hD - hU);
-    return glm::normalize(normal);
+    for (int offset = 0; offset < count; offset += CHUNK) {
+        const int chunk = std::min(CHUNK, count - offset);
+        for (int i = 0; i < chunk; i++) {
+            xs[i] = (startX + offset + i) * patchSize_;
+        }
+        heightBatch(xs, z, chunk, out + offset);
+    }
 }
 
 void TerrainGenerator::generateTerrain() {
-    patches_.clear();
+    auto startTime = std::chrono::high_resolution_clock::now();
+    const AllocationTracker::Counters allocationStart = AllocationTracker::current();
+    
+    // Released once the new patches are built, so the index topologies they
+    // share are reused rather than rebuilt
+    std::vector<TerrainPatch> previousPatches;
+    previousPatches.swap(patches_);
     
-    // Generate terrain patches
+    // Every height is evaluated exactly once here; patches only read the grid
+    buildHeightfield();
+    auto heightfieldTime = std::chrono::high_resolution_clock::now();
+    
+    // Generate terrain patches (row-major, same order as the serial path)
     const int patchVertexSize = gridSize_ / patchesPerRow_;
+    const int patchCount = patchesPerRow_ * patchesPerRow_;
+    const size_t verticesPerPatch = static_cast<size_t>(patchVertexSize + 1) * (patchVertexSize + 1);
+    patches_.resize(patchCount);
     
-    for (int row = 0; row < patchesPerRow_; row++) {
-        for (int col = 0; col < patchesPerRow_; col++) {
-            TerrainPatch patch;
-            createPatch(col * patchVertexSize, row * patchVertexSize, patchVertexSize, patch);
-            patches_.push_back(patch);
-        }
+    // One block for all patches; resize() keeps the previous allocation when
+    // it is large enough
+    vertexArena_.resize(verticesPerPatch * patchCount);
+    if (vertexFormat_ == VertexFormat::Packed) {
+        packedArena_.resize(vertexArena_.size());
     }
     
+    // Patches are independent and only read the heightfield, so each worker
+    // fills its own slot in patches_ and its own range of the arenas, and the
+    // result matches the serial path exactly
+    parallelFor(patchCount, [&](int index) {
+        int row = index / patchesPerRow_;
+        int col = index % patchesPerRow_;
+        createPatch(col * patchVertexSize, row * patchVertexSize, patchVertexSize, index * verticesPerPatch,
+                    patches_[index]);
+    });
+    
+    releaseBuffers(previousPatches);
+    previousPatches.clear();
+    mappedCache_.reset();
+    
+    auto endTime = std::chrono::high_resolution_clock::now();
+    const AllocationTracker::Counters allocations = AllocationTracker::since(allocationStart);
+    auto heightfieldUs = std::chrono::duration_cast<std::chrono::microseconds>(heightfieldTime - startTime);
+    auto patchesUs = std::chrono::duration_cast<std::chrono::microseconds>(endTime - heightfieldTime);
+    
     std::cout << "Generated " << patches_.size() << " terrain patches" << std::endl;
     std::cout << "Total vertices: " << getTotalVertices() << std::endl;
     std::cout << "Total triangles: " << getTotalTriangles() << std::endl;
+    std::cout << "Vertex memory: " << getVertexMemory() / 1024.0 << " KB (" << VertexFormats::name(vertexFormat_)
+              << ", " << VertexFormats::stride(vertexFormat_) << " bytes/vertex)" << std::endl;
+    printIndexMemory();
+    std::cout << "Generation time: " << (heightfieldUs.count() + patchesUs.count()) / 1000.0 << " ms (heightfield "
+              << heightfieldUs.count() / 1000.0 << " ms, patches " << patchesUs.count() / 1000.0 << " ms, "
+              << resolveWorkerCount(patchCount) << " threads, " << NoiseKernels::name(noiseBackend_)
+              << " noise)" << std::endl;
+    if (AllocationTracker::isEnabled()) {
+        std::cout << "Heap allocations: " << allocations.allocations << " (" << allocations.bytes / 1024.0 << " KB)"
+                  << std::endl;
+    }
+}
+
+void TerrainGenerator::buildHeightfield() {
+    heightfieldSize_ = gridSize_ * heightfieldSubdivisions_ + 1;
+    heightfield_.resize(static_cast<size_t>(heightfieldSize_) * heightfieldSize_);
+    
+    const float spacing = patchSize_ / heightfieldSubdivisions_;
+    std::vector<float> xs(heightfieldSize_);
+    for (int i = 0; i < heightfieldSize_; i++) {
+        xs[i] = i * patchSize_ / heightfieldSubdivisions_;
+    }
+    
+    // The gradient backend produces the slope alongside each height, so
+    // normals need no extra samples or finite differences
+    const bool storeDerivatives = noiseBackend_ == NoiseBackend::Gradient && analyticNormals_;
+    if (storeDerivatives) {
+        heightfieldDx_.resize(heightfield_.size());
+        heightfieldDz_.resize(heightfield_.size());
+    } else {
+        heightfieldDx_.clear();
+        heightfieldDz_.clear();
+    }
+    
+    const NoiseBatchParams params = heightParams();
+    parallelFor(heightfieldSize_, [&](int row) {
+        const size_t offset = static_cast<size_t>(row) * heightfieldSize_;
+        if (storeDerivatives) {
+            NoiseKernels::evaluateGradient(params, xs.data(), row * spacing, heightfieldSize_,
+                                           heightfield_.data() + offset,
+                                           heightfieldDx_.data() + offset, heightfieldDz_.data() + offset);
+        } else {
+            heightBatch(xs.data(), row * spacing, heightfieldSize_, heightfield_.data() + offset);
+        }
+    });
+}
+
+float TerrainGenerator::heightAt(int sampleX, int sampleZ) const {
+    sampleX = std::clamp(sampleX, 0, heightfieldSize_ - 1);
+    sampleZ = std::clamp(sampleZ, 0, heightfieldSize_ - 1);
+    return heightfield_[static_cast<size_t>(sampleZ) * heightfieldSize_ + sampleX];
+}
+
+glm::vec3 TerrainGenerator::heightfieldNormal(int sampleX, int sampleZ) const {
+    if (!heightfieldDx_.empty()) {
+        const size_t index = static_cast<size_t>(sampleZ) * heightfieldSize_ + sampleX;
+        return glm::normalize(glm::vec3(-heightfieldDx_[index], 1.0f, -heightfieldDz_[index]));
+    }
+    
+    // Central differences over the grid, one-sided at the borders
+    const float spacing = patchSize_ / heightfieldSubdivisions_;
+    const int x0 = std::max(sampleX - 1, 0);
+    const int x1 = std::min(sampleX + 1, heightfieldSize_ - 1);
+    const int z0 = std::max(sampleZ - 1, 0);
+    const int z1 = std::min(sampleZ + 1, heightfieldSize_ - 1);
+    
+    const float slopeX = (heightAt(x1, sampleZ) - heightAt(x0, sampleZ)) / ((x1 - x0) * spacing);
+    const float slopeZ = (heightAt(sampleX, z1) - heightAt(sampleX, z0)) / ((z1 - z0) * spacing);
+    return glm::normalize(glm::vec3(-slopeX, 1.0f, -slopeZ));
+}
+
+float TerrainGenerator::gridHeight(int gridX, int gridZ) const {
+    return heightAt(gridX * heightfieldSubdivisions_, gridZ * heightfieldSubdivisions_);
+}
+
+glm::vec3 TerrainGenerator::gridNormal(int gridX, int gridZ) const {
+    const int sampleX = std::clamp(gridX * heightfieldSubdivisions_, 0, heightfieldSize_ - 1);
+    const int sampleZ = std::clamp(gridZ * heightfieldSubdivisions_, 0, heightfieldSize_ - 1);
+    return heightfieldNormal(sampleX, sampleZ);
+}
+
+float TerrainGenerator::sampleHeight(float worldX, float worldZ) const {
+    if (heightfield_.empty()) {
+        return getHeight(worldX, worldZ);
+    }
+    
+    const float spacing = patchSize_ / heightfieldSubdivisions_;
+    const float fx = glm::clamp(worldX / spacing, 0.0f, static_cast<float>(heightfieldSize_ - 1));
+    const float fz = glm::clamp(worldZ / spacing, 0.0f, static_cast<float>(heightfieldSize_ - 1));
+    const int x0 = static_cast<int>(fx);
+    const int z0 = static_cast<int>(fz);
+    const float tx = fx - x0;
+    const float tz = fz - z0;
+    
+    const float top = glm::mix(heightAt(x0, z0), heightAt(x0 + 1, z0), tx);
+    const float bottom = glm::mix(heightAt(x0, z0 + 1), heightAt(x0 + 1, z0 + 1), tx);
+    return glm::mix(top, bottom, tz);
+}
+
+void TerrainGenerator::generateOrLoad(const std::string& cachePath) {
+    if (cachePath.empty()) {
+        generateTerrain();
+        return;
+    }
+    
+    if (seed_ < 0) {
+        std::cout << "Terrain cache needs a fixed seed (--seed); generating without cache" << std::endl;
+        generateTerrain();
+        return;
+    }
+    
+    if (loadCache(cachePath)) {
+        return;
+    }
+    
+    generateTerrain();
+    saveCache(cachePath);
+}
+
+static TerrainCacheKey makeCacheKey(int seed, int gridSize, int patchesPerRow, float heightScale,
+                                    float patchSize, NoiseBackend backend, int subdivisions, bool analyticNormals) {
+    TerrainCacheKey key;
+    key.seed = seed;
+    key.gridSize = gridSize;
+    key.patchesPerRow = patchesPerRow;
+    key.heightScale = heightScale;
+    key.patchSize = patchSize;
+    key.noiseBackend = static_cast<int32_t>(backend);
+    key.heightfieldSubdivisions = subdivisions;
+    key.analyticNormals = backend == NoiseBackend::Gradient && analyticNormals ? 1 : 0;
+    return key;
+}
+
+bool TerrainGenerator::loadCache(const std::string& path) {
+    auto startTime = std::chrono::high_resolution_clock::now();
+    const TerrainCacheKey key = makeCacheKey(seed_, gridSize_, patchesPerRow_, heightScale_, patchSize_,
+                                             noiseBackend_, heightfieldSubdivisions_, analyticNormals_);
+    
+    auto mapping = std::make_unique<MappedFile>();
+    std::vector<TerrainPatch> patches;
+    if (!TerrainCache::load(path, key, primitive_, *mapping, patches, heightfield_, heightfieldSize_)) {
+        return false;
+    }
+    
+    // Analytic derivatives are only needed while building patches
+    releaseBuffers(patches_);
+    patches_ = std::move(patches);
+    mappedCache_ = std::move(mapping);
+    heightfieldDx_.clear();
+    heightfieldDz_.clear();
+    
+    // The cache holds full-precision vertices; the packed copies are rebuilt
+    if (vertexFormat_ == VertexFormat::Packed) {
+        packedArena_.resize(getTotalVertices());
+        parallelFor(static_cast<int>(patches_.size()), [&](int index) {
+            TerrainPatch& patch = patches_[index];
+            patch.sharedPackedVertices = packedArena_.data() + patch.firstVertex;
+            packVertices(patch, packedArena_.data() + patch.firstVertex);
+        });
+    }
+    
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::high_resolution_clock::now() - startTime);
+    std::cout << "Mapped " << patches_.size() << " terrain patches from " << path
+              << " in " << elapsed.count() / 1000.0 << " ms" << std::endl;
+    std::cout << "Total vertices: " << getTotalVertices() << std::endl;
+    std::cout << "Total triangles: " << getTotalTriangles() << std::endl;
+    std::cout << "Vertex memory: " << getVertexMemory() / 1024.0 << " KB (" << VertexFormats::name(vertexFormat_)
+              << ", " << VertexFormats::stride(vertexFormat_) << " bytes/vertex)" << std::endl;
+    printIndexMemory();
+    return true;
 }
 
-void TerrainGenerator::createPatch(int startX, int startZ, int patchSize, TerrainPatch& patch) {
-    patch.vertices.clear();
-    patch.indices.clear();
-    
-    // Generate vertices
-    for (int z = startZ; z <= startZ + patchSize; z++) {
-        for (int x = startX; x <= startX + patchSize; x++) {
-            TerrainVertex vertex;
-            float worldX = x * patchSize_;
-            float worldZ = z * patchSize_;
-            
-            vertex.position = glm::vec3(worldX, getHeight(worldX, worldZ), worldZ);
-            vertex.normal = calculateNormal(worldX, worldZ);
-            vertex.texCoord = glm::vec2(static_cast<float>(x) / gridSize_, 
-                                       static_cast<float>(z) / gridSize_);
-            
-            // Color based on height
-            float heightFactor = (vertex.position.y + heightScale_) / (2.0f * heightScale_);
-            heightFactor = glm::clamp(heightFactor, 0.0f, 1.0f);
-            vertex.color = glm::mix(glm::vec3(0.2f, 0.5f, 0.1f),    // Dark green (valleys)
-                                   glm::vec3(0.9f, 0.9f, 0.7f),     // Light gray (peaks)
-                                   heightFactor);
-            
-            patch.vertices.push_back(vertex);
+bool TerrainGenerator::saveCache(const std::string& path) const {
+    if (seed_ < 0) {
+        return false;
+    }
+    const TerrainCacheKey key = makeCacheKey(seed_, gridSize_, patchesPerRow_, heightScale_, patchSize_,
+                                             noiseBackend_, heightfieldSubdivisions_, analyticNormals_);
+    return TerrainCache::save(path, key, patches_, heightfield_, heightfieldSize_);
+}
+
+int TerrainGenerator::resolveWorkerCount(int taskCount) const {
+    int workers = generationThreads_;
+    if (workers <= 0) {
+        workers = static_cast<int>(std::thread::hardware_concurrency());
+    }
+    return std::max(1, std::min(workers, taskCount));
+}
+
+void TerrainGenerator::parallelFor(int count, const std::function<void(int)>& task) const {
+    const int workerCount = resolveWorkerCount(count);
+    if (workerCount <= 1) {
+        for (int i = 0; i < count; i++) {
+            task(i);
         }
+        return;
+    }
+    
+    // Workers pull indices from a shared counter so uneven tasks balance out
+    std::atomic<int> nextIndex(0);
+    auto worker = [&]() {
+        for (int i = nextIndex++; i < count; i = nextIndex++) {
+            task(i);
+        }
+    };
+    
+    std::vector<std::thread> workers;
+    workers.reserve(workerCount - 1);
+    for (int t = 1; t < workerCount; t++) {
+        workers.emplace_back(worker);
     }
+    worker(); // The calling thread takes a share of the work too
     
-    // Generate indices (triangles)
+    for (auto& thread : workers) {
+        thread.join();
+    }
+}
+
+void TerrainGenerator::createPatch(int startX, int startZ, int patchSize, size_t firstVertex, TerrainPatch& patch) {
     const int verticesPerRow = patchSize + 1;
-    for (int z = 0; z < patchSize; z++) {
-        for (int x = 0; x < patchSize; x++) {
-            int topLeft = z * verticesPerRow + x;
-            int topRight = topLeft + 1;
-            int bottomLeft = (z + 1) * verticesPerRow + x;
-            int bottomRight = bottomLeft + 1;
-            
-            // Two triangles per quad
-            patch.indices.insert(patch.indices.end(), {
-                topLeft, bottomLeft, topRight,
-                topRight, bottomLeft, bottomRight
-            });
+    const int step = heightfieldSubdivisions_;
+    patch.topology = PatchTopology::get(patchSize, primitive_);
+    patch.firstVertex = firstVertex;
+    patch.sharedVertices = vertexArena_.data() + firstVertex;
+    patch.sharedVertexCount = static_cast<size_t>(verticesPerRow) * verticesPerRow;
+    
+    // Generate vertices from the heightfield straight into the slots the
+    // topology's (cache-optimized) indices expect; border samples are shared
+    // with the neighbouring patches instead of being re-evaluated
+    TerrainVertex* vertices = vertexArena_.data() + firstVertex;
+    for (int z = 0; z <= patchSize; z++) {
+        for (int x = 0; x <= patchSize; x++) {
+            const int gridX = startX + x;
+            const int gridZ = startZ + z;
+            vertices[patch.topology->vertexSlot(z * verticesPerRow + x)] =
+                makeVertex(gridX, gridZ, heightAt(gridX * step, gridZ * step), heightfieldNormal(gridX * step, gridZ * step));
+        }
+    }
+    
+    buildLodChain(patchSize, patch);
+    computeBounds(patch);
+    if (vertexFormat_ == VertexFormat::Packed) {
+        patch.sharedPackedVertices = packedArena_.data() + firstVertex;
+        packVertices(patch, packedArena_.data() + firstVertex);
+    }
+    patch.lodLevel = 0;
+}
+
+void TerrainGenerator::generateTile(int tileX, int tileZ, int tileSize, TerrainPatch& patch) const {
+    // Local heightfield with a one-sample border so normals at the tile edge
+    // match the neighbouring tiles without reading them
+    const int verticesPerRow = tileSize + 1;
+    const int borderedSize = verticesPerRow + 2;
+    const int startX = tileX * tileSize;
+    const int startZ = tileZ * tileSize;
+    
+    std::vector<float> heights(static_cast<size_t>(borderedSize) * borderedSize);
+    std::vector<float> xs(borderedSize);
+    for (int i = 0; i < borderedSize; i++) {
+        xs[i] = (startX - 1 + i) * patchSize_;
+    }
+    
+    const bool analytic = noiseBackend_ == NoiseBackend::Gradient && analyticNormals_;
+    std::vector<float> dx, dz;
+    if (analytic) {
+        dx.resize(heights.size());
+        dz.resize(heights.size());
+    }
+    
+    const NoiseBatchParams params = heightParams();
+    for (int row = 0; row < borderedSize; row++) {
+        const size_t offset = static_cast<size_t>(row) * borderedSize;
+        const float z = (startZ - 1 + row) * patchSize_;
+        if (analytic) {
+            NoiseKernels::evaluateGradient(params, xs.data(), z, borderedSize,
+                                           heights.data() + offset, dx.data() + offset, dz.data() + offset);
+        } else {
+            heightBatch(xs.data(), z, borderedSize, heights.data() + offset);
+        }
+    }
+    
+    auto sample = [&](int x, int z) { return heights[static_cast<size_t>(z) * borderedSize + x]; };
+    
+    // Tiles own their vertices, written in the topology's vertex order
+    patch.topology = PatchTopology::get(tileSize, primitive_);
+    patch.vertices.resize(static_cast<size_t>(verticesPerRow) * verticesPerRow);
+    for (int z = 1; z <= verticesPerRow; z++) {
+        for (int x = 1; x <= verticesPerRow; x++) {
+            glm::vec3 normal;
+            if (analytic) {
+                const size_t index = static_cast<size_t>(z) * borderedSize + x;
+                normal = glm::normalize(glm::vec3(-dx[index], 1.0f, -dz[index]));
+            } else {
+                const float slopeX = (sample(x + 1, z) - sample(x - 1, z)) / (2.0f * patchSize_);
+                const float slopeZ = (sample(x, z + 1) - sample(x, z - 1)) / (2.0f * patchSize_);
+                normal = glm::normalize(glm::vec3(-slopeX, 1.0f, -slopeZ));
+            }
+            const int slot = patch.topology->vertexSlot((z - 1) * verticesPerRow + x - 1);
+            patch.vertices[slot] = makeVertex(startX + x - 1, startZ + z - 1, sample(x, z), normal);
         }
     }
     
+    buildLodChain(tileSize, patch);
+    computeBounds(patch);
+    patch.packedVertices.clear();
+    if (vertexFormat_ == VertexFormat::Packed) {
+        patch.packedVertices.resize(patch.vertices.size());
+        packVertices(patch, patch.packedVertices.data());
+    }
+    patch.lodLevel = 0;
+}
+
+TerrainVertex TerrainGenerator::makeVertex(int gridX, int gridZ, float height, const glm::vec3& normal) const {
+    TerrainVertex vertex;
+    vertex.position = glm::vec3(gridX * patchSize_, height, gridZ * patchSize_);
+    vertex.normal = normal;
+    vertex.texCoord = glm::vec2(static_cast<float>(gridX) / gridSize_, 
+                               static_cast<float>(gridZ) / gridSize_);
+    
+    // Color based on height
+    float heightFactor = (vertex.position.y + heightScale_) / (2.0f * heightScale_);
+    heightFactor = glm::clamp(heightFactor, 0.0f, 1.0f);
+    vertex.color = glm::mix(glm::vec3(0.2f, 0.5f, 0.1f),    // Dark green (valleys)
+                           glm::vec3(0.9f, 0.9f, 0.7f),     // Light gray (peaks)
+                           heightFactor);
+    return vertex;
+}
+
+void TerrainGenerator::buildLodChain(int quadsPerSide, TerrainPatch& patch) const {
+    const int verticesPerRow = quadsPerSide + 1;
+    const TerrainVertex* vertices = patch.vertexData();
+    auto height = [&](int x, int z) { return vertices[patch.topology->vertexSlot(z * verticesPerRow + x)].position.y; };
+    
+    patch.lodErrors.reserve(patch.topology->getLodCount());
+    patch.lodErrors.assign(1, 0.0f);
+    
+    float error = 0.0f;
+    for (int level = 1; level < patch.topology->getLodCount(); level++) {
+        const int step = 1 << level;
+        
+        // Deviation of every full-resolution vertex from the coarse surface,
+        // interpolated over the same triangle split the topology uses
+        for (int z = 0; z <= quadsPerSide; z++) {
+            for (int x = 0; x <= quadsPerSide; x++) {
+                const int x0 = std::min(x / step * step, quadsPerSide - step);
+                const int z0 = std::min(z / step * step, quadsPerSide - step);
+                const float u = static_cast<float>(x - x0) / step;
+                const float v = static_cast<float>(z - z0) / step;
+                
+                const float h00 = height(x0, z0);
+                const float h10 = height(x0 + step, z0);
+                const float h01 = height(x0, z0 + step);
+                const float h11 = height(x0 + step, z0 + step);
+                const float coarse = (u + v <= 1.0f)
+                    ? h00 + u * (h10 - h00) + v * (h01 - h00)
+                    : h11 + (1.0f - u) * (h01 - h11) + (1.0f - v) * (h10 - h11);
+                error = std::max(error, std::abs(coarse - height(x, z)));
+            }
+        }
+        
+        // Taking the running max keeps the error monotonic along the chain
+        patch.lodErrors.push_back(error);
+    }
+}
+
+void TerrainGenerator::computeBounds(TerrainPatch& patch) {
     // Calculate patch center and bounding sphere
+    const TerrainVertex* vertices = patch.vertexData();
+    const size_t count = patch.vertexCount();
     patch.center = glm::vec3(0.0f);
-    for (const auto& vertex : patch.vertices) {
-        patch.center += vertex.position;
+    for (size_t i = 0; i < count; i++) {
+        patch.center += vertices[i].position;
     }
-    patch.center /= patch.vertices.size();
+    patch.center /= count;
     
     patch.boundingRadius = 0.0f;
-    for (const auto& vertex : patch.vertices) {
-        float distance = glm::length(vertex.position - patch.center);
+    for (size_t i = 0; i < count; i++) {
+        float distance = glm::length(vertices[i].position - patch.center);
         patch.boundingRadius = std::max(patch.boundingRadius, distance);
     }
-    
-    patch.lodLevel = 0;
+}
+
+void TerrainGenerator::packVertices(TerrainPatch& patch, PackedTerrainVertex* packed) const {
+    const TerrainVertex* vertices = patch.vertexData();
+    const size_t count = patch.vertexCount();
+    patch.packedRange = VertexFormats::computeRange(vertices, count, patchSize_);
+    for (size_t i = 0; i < count; i++) {
+        packed[i] = VertexFormats::pack(vertices[i], patch.packedRange, patchSize_);
+    }
 }
 
 size_t TerrainGenerator::getTotalVertices() const {
     size_t total = 0;
     for (const auto& patch : patches_) {
-        total += patch.vertices.size();
+        total += patch.vertexCount();
     }
     return total;
 }
@@ -167,7 +595,69 @@ size_t TerrainGenerator::getTotalVertices() const {
 size_t TerrainGenerator::getTotalTriangles() const {
     size_t total = 0;
     for (const auto& patch : patches_) {
-        total += patch.indices.size() / 3;
+        total += patch.fullDetailTriangleCount();
+    }
+    return total;
+}
+
+size_t TerrainGenerator::getVertexMemory() const {
+    size_t total = 0;
+    for (const auto& patch : patches_) {
+        total += patch.gpuVertexBytes();
+    }
+    return total;
+}
+
+const void* TerrainGenerator::getVertexArenaData() const {
+    if (patches_.empty()) {
+        return nullptr;
+    }
+    
+    // Generated patches and the cache's vertex blob are both laid out
+    // back to back, so the first patch locates the whole block
+    const TerrainPatch& first = patches_.front();
+    if (first.vertexFormat() == VertexFormat::Packed) {
+        return first.sharedPackedVertices - first.firstVertex;
+    }
+    return first.sharedVertices - first.firstVertex;
+}
+
+std::vector<const PatchTopology*> TerrainGenerator::uniqueTopologies() const {
+    std::vector<const PatchTopology*> topologies;
+    for (const auto& patch : patches_) {
+        const PatchTopology* topology = patch.topology.get();
+        if (topology && std::find(topologies.begin(), topologies.end(), topology) == topologies.end()) {
+            topologies.push_back(topology);
+        }
+    }
+    return topologies;
+}
+
+size_t TerrainGenerator::getIndexMemory() const {
+    size_t total = 0;
+    for (const PatchTopology* topology : uniqueTopologies()) {
+        total += topology->getIndexBytes();
+    }
+    return total;
+}
+
+size_t TerrainGenerator::getListIndexMemory() const {
+    size_t total = 0;
+    for (const PatchTopology* topology : uniqueTopologies()) {
+        total += topology->getListIndexBytes();
     }
     return total;
+}
+
+void TerrainGenerator::printIndexMemory() const {
+    const std::vector<const PatchTopology*> topologies = uniqueTopologies();
+    if (topologies.empty()) {
+        return;
+    }
+    
+    const size_t bytes = getIndexMemory();
+    const size_t listBytes = getListIndexMemory();
+    std::cout << "Index memory: " << bytes / 1024.0 << " KB (" << topologies[0]->getIndexSize() * 8 << "-bit "
+              << PatchTopology::name(primitive_) << ", shared by " << patches_.size() << " patches; "
+              << 100.0 * bytes / std::max<size_t>(listBytes, 1) << "% of 32-bit triangle lists)" << std::endl;
 }
\ No newline at end of file
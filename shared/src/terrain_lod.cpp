@@ -0,0 +1,101 @@
+#include "terrain_lod.h"
+#include <cmath>
+
+float TerrainLod::pixelScale(int viewportHeight, float fovY) {
+    return viewportHeight / (2.0f * std::tan(fovY * 0.5f));
+}
+
+float TerrainLod::screenSpaceError(float geometricError, float distance, float pixelScale) {
+    return geometricError * pixelScale / std::max(distance, 1e-3f);
+}
+
+int TerrainLod::selectLevel(const TerrainPatch& patch, const glm::vec3& cameraPos, float pixelScale, float tolerance) {
+    if (tolerance <= 0.0f || patch.lodCount() < 2) {
+        return 0;
+    }
+    
+    // Nearest point of the bounding sphere; inside it, always full detail
+    const float distance = glm::length(cameraPos - patch.center) - patch.boundingRadius;
+    if (distance <= 0.0f) {
+        return 0;
+    }
+    
+    // Errors grow along the chain, so stop at the first level that is too coarse
+    int level = 0;
+    for (int i = 1; i < patch.lodCount(); i++) {
+        if (screenSpaceError(patch.lodErrors[i], distance, pixelScale) > tolerance) {
+            break;
+        }
+        level = i;
+    }
+    return level;
+}
+
+void TerrainLod::selectGridLevels(const std::vector<const TerrainPatch*>& grid, int columns,
+                                  const glm::vec3& cameraPos, float pixelScale, float tolerance,
+                                  std::vector<int>& levels, std::vector<int>& stitchMasks) {
+    const int cells = static_cast<int>(grid.size());
+    levels.assign(cells, 0);
+    stitchMasks.assign(cells, 0);
+    if (tolerance <= 0.0f || columns <= 0) {
+        return;
+    }
+    
+    for (int i = 0; i < cells; i++) {
+        if (grid[i]) {
+            levels[i] = selectLevel(*grid[i], cameraPos, pixelScale, tolerance);
+        }
+    }
+    constrainGridLevels(grid, columns, levels, stitchMasks);
+}
+
+void TerrainLod::constrainGridLevels(const std::vector<const TerrainPatch*>& grid, int columns,
+                                     std::vector<int>& levels, std::vector<int>& stitchMasks) {
+    const int cells = static_cast<int>(grid.size());
+    stitchMasks.assign(cells, 0);
+    if (columns <= 0) {
+        return;
+    }
+    
+    // Neighbour of cell i across each edge, or -1
+    auto neighbour = [&](int i, int edge) {
+        const int column = i % columns;
+        int n = -1;
+        switch (edge) {
+            case PatchTopology::STITCH_NORTH: n = i - columns; break;
+            case PatchTopology::STITCH_SOUTH: n = i + columns; break;
+            case PatchTopology::STITCH_WEST:  n = column > 0 ? i - 1 : -1; break;
+            case PatchTopology::STITCH_EAST:  n = column < columns - 1 ? i + 1 : -1; break;
+        }
+        return (n >= 0 && n < cells && grid[n]) ? n : -1;
+    };
+    const int edges[] = { PatchTopology::STITCH_NORTH, PatchTopology::STITCH_EAST,
+                          PatchTopology::STITCH_SOUTH, PatchTopology::STITCH_WEST };
+    
+    // Stitching only bridges a single level, so refine (never coarsen) cells
+    // next to much finer neighbours until the grid is consistent
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int i = 0; i < cells; i++) {
+            if (!grid[i]) continue;
+            for (int edge : edges) {
+                const int n = neighbour(i, edge);
+                if (n >= 0 && levels[i] > levels[n] + 1) {
+                    levels[i] = levels[n] + 1;
+                    changed = true;
+                }
+            }
+        }
+    }
+    
+    for (int i = 0; i < cells; i++) {
+        if (!grid[i]) continue;
+        for (int edge : edges) {
+            const int n = neighbour(i, edge);
+            if (n >= 0 && levels[n] > levels[i]) {
+                stitchMasks[i] |= edge;
+            }
+        }
+    }
+}
@@ -0,0 +1,330 @@
+#include "terrain_streamer.h"
+#include "performance_monitor.h"
+#include "gl_state.h"
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+TerrainStreamer::TerrainStreamer(const TerrainGenerator& generator, const StreamingConfig& config)
+    : generator_(generator), config_(config), frame_(0),
+      cpuBytes_(0), gpuBytes_(0), tilesUploaded_(0), bytesUploaded_(0), cpuEvictions_(0), gpuEvictions_(0), cancelledRequests_(0),
+      cameraTile_(0.0f), cameraDirection_(0.0f, -1.0f), inFlight_(0), tilesGenerated_(0),
+      generationTimeTotal_(0.0), stopping_(false) {
+    config_.tileSize = std::max(1, config_.tileSize);
+    config_.viewRadius = std::max(0, config_.viewRadius);
+    tileWorldSize_ = config_.tileSize * generator_.getPatchSize();
+    
+    const int workerCount = std::max(1, config_.workerThreads);
+    for (int i = 0; i < workerCount; i++) {
+        workers_.emplace_back(&TerrainStreamer::workerLoop, this);
+    }
+    
+    std::cout << "Terrain streaming: " << config_.tileSize << "x" << config_.tileSize << " tiles, radius "
+              << config_.viewRadius << ", " << workerCount << " workers, budgets "
+              << PerformanceMonitor::formatBytes(config_.cpuBudget) << " CPU / "
+              << PerformanceMonitor::formatBytes(config_.gpuBudget) << " GPU" << std::endl;
+}
+
+TerrainStreamer::~TerrainStreamer() {
+    {
+        std::lock_guard<std::mutex> lock(queueMutex_);
+        stopping_ = true;
+    }
+    queueCondition_.notify_all();
+    for (auto& worker : workers_) {
+        worker.join();
+    }
+    
+    for (auto& entry : tiles_) {
+        releaseGPU(entry.second);
+    }
+}
+
+uint64_t TerrainStreamer::tileKey(int x, int z) {
+    return (static_cast<uint64_t>(static_cast<uint32_t>(x)) << 32) | static_cast<uint32_t>(z);
+}
+
+float TerrainStreamer::requestPriority(int tileX, int tileZ) const {
+    const glm::vec2 toTile = glm::vec2(tileX + 0.5f, tileZ + 0.5f) - cameraTile_;
+    const float distance = glm::length(toTile);
+    if (distance < 1.0f) {
+        return distance;
+    }
+    
+    // Tiles ahead of the camera count as up to twice as close as those behind it
+    const float facing = glm::dot(toTile / distance, cameraDirection_);
+    return distance * (1.5f - 0.5f * facing);
+}
+
+void TerrainStreamer::update(const glm::vec3& cameraPos, const glm::vec3& cameraFront) {
+    frame_++;
+    
+    const glm::vec2 cameraTile(cameraPos.x / tileWorldSize_, cameraPos.z / tileWorldSize_);
+    const int centerX = static_cast<int>(std::floor(cameraTile.x));
+    const int centerZ = static_cast<int>(std::floor(cameraTile.y));
+    const int radius = config_.viewRadius;
+    
+    auto inRange = [&](int x, int z) {
+        const int dx = x - centerX;
+        const int dz = z - centerZ;
+        return dx * dx + dz * dz <= radius * radius;
+    };
+    
+    {
+        std::lock_guard<std::mutex> lock(queueMutex_);
+        cameraTile_ = cameraTile;
+        glm::vec2 direction(cameraFront.x, cameraFront.z);
+        if (glm::length(direction) > 1e-4f) {
+            cameraDirection_ = glm::normalize(direction);
+        }
+        
+        // Drop requests the camera has moved away from before a worker picked them up
+        for (size_t i = 0; i < pending_.size();) {
+            if (!inRange(pending_[i].first, pending_[i].second)) {
+                requested_.erase(tileKey(pending_[i].first, pending_[i].second));
+                pending_[i] = pending_.back();
+                pending_.pop_back();
+                cancelledRequests_++;
+            } else {
+                i++;
+            }
+        }
+    }
+    
+    collectCompleted();
+    
+    // Walk rings outwards so the visible list comes out nearest first
+    visibleTiles_.clear();
+    std::vector<std::pair<int, int>> requests;
+    for (int ring = 0; ring <= radius; ring++) {
+        for (int dz = -ring; dz <= ring; dz++) {
+            for (int dx = -ring; dx <= ring; dx++) {
+                if (std::max(std::abs(dx), std::abs(dz)) != ring) continue;
+                
+                const int x = centerX + dx;
+                const int z = centerZ + dz;
+                if (!inRange(x, z)) continue;
+                
+                const uint64_t key = tileKey(x, z);
+                auto it = tiles_.find(key);
+                if (it != tiles_.end()) {
+                    Tile& tile = it->second;
+                    tile.lastUsedFrame = frame_;
+                    lru_.splice(lru_.begin(), lru_, tile.lruPosition);
+                    visibleTiles_.push_back(&tile);
+                } else if (requested_.insert(key).second) {
+                    requests.emplace_back(x, z);
+                }
+            }
+        }
+    }
+    
+    if (!requests.empty()) {
+        {
+            std::lock_guard<std::mutex> lock(queueMutex_);
+            pending_.insert(pending_.end(), requests.begin(), requests.end());
+        }
+        queueCondition_.notify_all();
+    }
+    
+    // Upload a bounded number of tiles per frame, nearest first
+    int uploads = 0;
+    for (Tile* tile : visibleTiles_) {
+        if (uploads >= config_.uploadsPerFrame) break;
+        if (tile->patch.isUploaded) continue;
+        
+        uploadTile(*tile);
+        uploads++;
+    }
+    
+    const int columns = getGridColumns();
+    visibleGrid_.assign(static_cast<size_t>(columns) * columns, nullptr);
+    for (const Tile* tile : visibleTiles_) {
+        if (tile->patch.isUploaded) {
+            visibleGrid_[(tile->z - centerZ + radius) * columns + (tile->x - centerX + radius)] = &tile->patch;
+        }
+    }
+    
+    enforceBudgets();
+}
+
+void TerrainStreamer::collectCompleted() {
+    std::vector<CompletedTile> completed;
+    {
+        std::lock_guard<std::mutex> lock(queueMutex_);
+        completed.swap(completed_);
+    }
+    
+    for (auto& result : completed) {
+        const uint64_t key = tileKey(result.x, result.z);
+        requested_.erase(key);
+        
+        Tile& tile = tiles_[key];
+        tile.x = result.x;
+        tile.z = result.z;
+        tile.patch = std::move(result.patch);
+        tile.cpuBytes = tile.patch.vertices.capacity() * sizeof(TerrainVertex) + // Indices are shared
+                        tile.patch.packedVertices.capacity() * sizeof(PackedTerrainVertex);
+        tile.gpuBytes = 0;
+        tile.lastUsedFrame = 0;
+        lru_.push_front(key);
+        tile.lruPosition = lru_.begin();
+        cpuBytes_ += tile.cpuBytes;
+    }
+}
+
+void TerrainStreamer::workerLoop() {
+    while (true) {
+        int tileX, tileZ;
+        {
+            std::unique_lock<std::mutex> lock(queueMutex_);
+            queueCondition_.wait(lock, [this] { return stopping_ || !pending_.empty(); });
+            if (stopping_) {
+                return;
+            }
+            
+            // Priorities follow the camera, so pick the best request at dequeue time
+            size_t best = 0;
+            float bestPriority = requestPriority(pending_[0].first, pending_[0].second);
+            for (size_t i = 1; i < pending_.size(); i++) {
+                const float priority = requestPriority(pending_[i].first, pending_[i].second);
+                if (priority < bestPriority) {
+                    best = i;
+                    bestPriority = priority;
+                }
+            }
+            
+            tileX = pending_[best].first;
+            tileZ = pending_[best].second;
+            pending_[best] = pending_.back();
+            pending_.pop_back();
+            inFlight_++;
+        }
+        
+        auto start = std::chrono::high_resolution_clock::now();
+        CompletedTile result;
+        result.x = tileX;
+        result.z = tileZ;
+        generator_.generateTile(tileX, tileZ, config_.tileSize, result.patch);
+        result.generationTime = std::chrono::duration<double, std::milli>(
+            std::chrono::high_resolution_clock::now() - start).count();
+        
+        {
+            std::lock_guard<std::mutex> lock(queueMutex_);
+            inFlight_--;
+            tilesGenerated_++;
+            generationTimeTotal_ += result.generationTime;
+            completed_.push_back(std::move(result));
+        }
+    }
+}
+
+void TerrainStreamer::uploadTile(Tile& tile) {
+    TerrainPatch& patch = tile.patch;
+    
+    glGenVertexArrays(1, &patch.VAO);
+    glGenBuffers(1, &patch.VBO);
+    
+    GLState::bindVertexArray(patch.VAO);
+    
+    GLState::bindBuffer(GL_ARRAY_BUFFER, patch.VBO);
+    glBufferData(GL_ARRAY_BUFFER, patch.gpuVertexBytes(), patch.gpuVertexData(), GL_STATIC_DRAW);
+    
+    GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, patch.topology->getElementBuffer());
+    VertexFormats::setupAttributes(patch.vertexFormat());
+    
+    GLState::bindVertexArray(0);
+    patch.isUploaded = true;
+    
+    tile.gpuBytes = patch.gpuVertexBytes();
+    gpuBytes_ += tile.gpuBytes;
+    bytesUploaded_ += tile.gpuBytes;
+    tilesUploaded_++;
+}
+
+void TerrainStreamer::releaseGPU(Tile& tile) {
+    TerrainPatch& patch = tile.patch;
+    if (!patch.isUploaded) {
+        return;
+    }
+    
+    GLState::deleteVertexArray(patch.VAO);
+    GLState::deleteBuffer(patch.VBO);
+    patch.VAO = patch.VBO = 0;
+    patch.isUploaded = false;
+    
+    gpuBytes_ -= tile.gpuBytes;
+    tile.gpuBytes = 0;
+}
+
+void TerrainStreamer::enforceBudgets() {
+    // Tiles drawn this frame are never evicted, so the budgets are soft limits
+    // when the view radius alone needs more than they allow
+    auto it = lru_.end();
+    while (gpuBytes_ > config_.gpuBudget && it != lru_.begin()) {
+        --it;
+        Tile& tile = tiles_.at(*it);
+        if (tile.lastUsedFrame == frame_) break;
+        if (tile.patch.isUploaded) {
+            releaseGPU(tile);
+            gpuEvictions_++;
+        }
+    }
+    
+    while (cpuBytes_ > config_.cpuBudget && !lru_.empty()) {
+        const uint64_t key = lru_.back();
+        Tile& tile = tiles_.at(key);
+        if (tile.lastUsedFrame == frame_) break;
+        
+        releaseGPU(tile);
+        cpuBytes_ -= tile.cpuBytes;
+        lru_.pop_back();
+        tiles_.erase(key);
+        cpuEvictions_++;
+    }
+}
+
+StreamingStats TerrainStreamer::getStats() const {
+    StreamingStats stats;
+    stats.residentTiles = tiles_.size();
+    for (const auto& entry : tiles_) {
+        if (entry.second.patch.isUploaded) {
+            stats.gpuResidentTiles++;
+        }
+    }
+    stats.cpuBytes = cpuBytes_;
+    stats.gpuBytes = gpuBytes_;
+    stats.tilesUploaded = tilesUploaded_;
+    stats.bytesUploaded = bytesUploaded_;
+    stats.cpuEvictions = cpuEvictions_;
+    stats.gpuEvictions = gpuEvictions_;
+    
+    std::lock_guard<std::mutex> lock(queueMutex_);
+    stats.cancelledRequests = cancelledRequests_;
+    stats.pendingTiles = pending_.size();
+    stats.inFlightTiles = inFlight_;
+    stats.tilesGenerated = tilesGenerated_;
+    if (tilesGenerated_ > 0) {
+        stats.averageGenerationTime = generationTimeTotal_ / tilesGenerated_;
+    }
+    return stats;
+}
+
+void TerrainStreamer::printReport() const {
+    const StreamingStats stats = getStats();
+    
+    std::cout << "\n=== Terrain Streaming ===" << std::endl;
+    std::cout << "Resident Tiles: " << stats.residentTiles << " (" << stats.gpuResidentTiles << " on GPU)" << std::endl;
+    std::cout << "CPU Memory: " << PerformanceMonitor::formatBytes(stats.cpuBytes) << " / "
+              << PerformanceMonitor::formatBytes(config_.cpuBudget) << std::endl;
+    std::cout << "GPU Memory: " << PerformanceMonitor::formatBytes(stats.gpuBytes) << " / "
+              << PerformanceMonitor::formatBytes(config_.gpuBudget) << std::endl;
+    std::cout << "Tiles Generated: " << stats.tilesGenerated << " (avg "
+              << PerformanceMonitor::formatTime(stats.averageGenerationTime) << ")" << std::endl;
+    std::cout << "Tiles Uploaded: " << stats.tilesUploaded << " (" << PerformanceMonitor::formatBytes(stats.bytesUploaded)
+              << ")" << std::endl;
+    std::cout << "Evictions: " << stats.cpuEvictions << " CPU, " << stats.gpuEvictions << " GPU" << std::endl;
+    std::cout << "Backlog: " << stats.pendingTiles << " pending, " << stats.inFlightTiles << " in flight, "
+              << stats.cancelledRequests << " cancelled" << std::endl;
+    std::cout << "========================\n" << std::endl;
+}
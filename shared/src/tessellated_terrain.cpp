@@ -0,0 +1,77 @@
+#include "tessellated_terrain.h"
+#include "gl_state.h"
+#include <algorithm>
+#include <iostream>
+#include "performance_monitor.h"
+
+bool TessellatedTerrain::isSupported() {
+    return GLEW_VERSION_4_0 || GLEW_ARB_tessellation_shader;
+}
+
+TessellatedTerrain::~TessellatedTerrain() {
+    release();
+}
+
+bool TessellatedTerrain::upload(const TerrainGenerator& generator) {
+    release();
+    
+    if (!heights_.upload(generator)) {
+        return false;
+    }
+    
+    // Corners of every cell, in the order the shaders expect: (x0, z0),
+    // (x1, z0), (x1, z1), (x0, z1). The last row and column of cells are
+    // narrower when CELL_QUADS does not divide the grid.
+    const int gridSize = generator.getGridSize();
+    std::vector<GLushort> corners;
+    for (int z0 = 0; z0 < gridSize; z0 += CELL_QUADS) {
+        const int z1 = std::min(z0 + CELL_QUADS, gridSize);
+        for (int x0 = 0; x0 < gridSize; x0 += CELL_QUADS) {
+            const int x1 = std::min(x0 + CELL_QUADS, gridSize);
+            const GLushort cell[8] = {
+                static_cast<GLushort>(x0), static_cast<GLushort>(z0), static_cast<GLushort>(x1), static_cast<GLushort>(z0),
+                static_cast<GLushort>(x1), static_cast<GLushort>(z1), static_cast<GLushort>(x0), static_cast<GLushort>(z1)
+            };
+            corners.insert(corners.end(), cell, cell + 8);
+        }
+    }
+    cellCount_ = static_cast<int>(corners.size() / 8);
+    
+    glGenVertexArrays(1, &vao_);
+    glGenBuffers(1, &cornerBuffer_);
+    GLState::bindVertexArray(vao_);
+    GLState::bindBuffer(GL_ARRAY_BUFFER, cornerBuffer_);
+    glBufferData(GL_ARRAY_BUFFER, corners.size() * sizeof(GLushort), corners.data(), GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 2, GL_UNSIGNED_SHORT, GL_FALSE, 2 * sizeof(GLushort), (void*)0);
+    glEnableVertexAttribArray(0);
+    GLState::bindVertexArray(0);
+    
+    vertexBytes_ = corners.size() * sizeof(GLushort);
+    std::cout << "Tessellated terrain: " << cellCount_ << " cells of " << CELL_QUADS << "x" << CELL_QUADS << " quads ("
+              << PerformanceMonitor::formatBytes(vertexBytes_) << " of corners)" << std::endl;
+    return true;
+}
+
+void TessellatedTerrain::release() {
+    if (vao_ != 0) {
+        GLState::deleteVertexArray(vao_);
+        GLState::deleteBuffer(cornerBuffer_);
+        vao_ = 0;
+        cornerBuffer_ = 0;
+    }
+    heights_.release();
+    cellCount_ = 0;
+    vertexBytes_ = 0;
+}
+
+int TessellatedTerrain::draw() {
+    if (cellCount_ == 0) {
+        return 0;
+    }
+    
+    GLState::bindVertexArray(vao_);
+    heights_.bindTextures();
+    glPatchParameteri(GL_PATCH_VERTICES, 4);
+    glDrawArrays(GL_PATCHES, 0, cellCount_ * 4);
+    return 1;
+}
@@ -0,0 +1,188 @@
+#include "upload_ring.h"
+#include <iostream>
+#include "gl_state.h"
+#include "performance_monitor.h"
+
+// Region starts, like the terrain cache blobs, sit on cache line boundaries
+static constexpr uint64_t REGION_ALIGNMENT = 64;
+
+bool UploadRing::isSupported() {
+    return GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage;
+}
+
+UploadRing::~UploadRing() {
+    destroy();
+}
+
+bool UploadRing::create(size_t capacity) {
+    destroy();
+    if (capacity == 0 || !isSupported()) {
+        return false;
+    }
+    
+    const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glGenBuffers(1, &buffer_);
+    GLState::bindBuffer(GL_COPY_READ_BUFFER, buffer_);
+    glBufferStorage(GL_COPY_READ_BUFFER, capacity, nullptr, flags);
+    mapping_ = static_cast<uint8_t*>(glMapBufferRange(GL_COPY_READ_BUFFER, 0, capacity, flags));
+    if (!mapping_) {
+        std::cerr << "Failed to map the upload ring" << std::endl;
+        GLState::deleteBuffer(buffer_);
+        buffer_ = 0;
+        return false;
+    }
+    
+    std::lock_guard<std::mutex> lock(mutex_);
+    capacity_ = capacity;
+    head_ = tail_ = 0;
+    destroying_ = false;
+    stats_ = UploadRingStats();
+    stats_.capacity = capacity;
+    return true;
+}
+
+void UploadRing::destroy() {
+    if (buffer_ == 0) {
+        return;
+    }
+    
+    // Producers blocked in allocate() give up
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        destroying_ = true;
+    }
+    released_.notify_all();
+    
+    std::unique_lock<std::mutex> lock(mutex_);
+    released_.wait(lock, [this] { return waiters_ == 0; });
+    for (const Fence& fence : fences_) {
+        glDeleteSync(fence.sync);
+    }
+    fences_.clear();
+    lock.unlock();
+    
+    GLState::bindBuffer(GL_COPY_READ_BUFFER, buffer_);
+    glUnmapBuffer(GL_COPY_READ_BUFFER);
+    GLState::deleteBuffer(buffer_);
+    buffer_ = 0;
+    mapping_ = nullptr;
+}
+
+bool UploadRing::allocate(size_t size, Region& region) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (buffer_ == 0 || destroying_ || size == 0 || size > capacity_) {
+        return false;
+    }
+    
+    // A region never wraps: skip the rest of the buffer if it does not fit
+    uint64_t start = (head_ + REGION_ALIGNMENT - 1) / REGION_ALIGNMENT * REGION_ALIGNMENT;
+    if (start % capacity_ + size > capacity_) {
+        start += capacity_ - start % capacity_;
+    }
+    const uint64_t end = start + size;
+    head_ = end;    // Claimed before any wait, so concurrent producers queue up behind it
+    
+    if (end - tail_ > capacity_) {
+        const Clock::time_point stallStart = Clock::now();
+        waiters_++;
+        released_.wait(lock, [&] { return end - tail_ <= capacity_ || destroying_; });
+        waiters_--;
+        stats_.stalls++;
+        stats_.stallTime += std::chrono::duration<double, std::milli>(Clock::now() - stallStart).count();
+        if (destroying_) {
+            released_.notify_all();
+            return false;
+        }
+    }
+    
+    if (stats_.allocations == 0) {
+        firstAllocation_ = Clock::now();
+    }
+    stats_.allocations++;
+    stats_.bytesStreamed += size;
+    
+    region.offset = static_cast<size_t>(start % capacity_);
+    region.data = mapping_ + region.offset;
+    region.size = size;
+    region.end = end;
+    return true;
+}
+
+void UploadRing::fence(uint64_t end) {
+    Fence fence;
+    fence.sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    fence.end = end;
+    
+    // Another context may be the one waiting for it
+    glFlush();
+    
+    std::lock_guard<std::mutex> lock(mutex_);
+    fences_.push_back(fence);
+}
+
+void UploadRing::retire(bool wait) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    bool released = false;
+    while (!fences_.empty()) {
+        const Fence fence = fences_.front();
+        
+        // Only the first fence is waited for; the rest are polled
+        GLuint64 timeout = 0;
+        if (wait && !released) {
+            timeout = 1000000000;   // 1 s, in ns
+        }
+        lock.unlock();
+        const GLenum status = glClientWaitSync(fence.sync, 0, timeout);
+        lock.lock();
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+            break;
+        }
+        
+        glDeleteSync(fence.sync);
+        fences_.pop_front();
+        tail_ = fence.end;
+        lastRelease_ = Clock::now();
+        released = true;
+    }
+    lock.unlock();
+    
+    if (released) {
+        released_.notify_all();
+    }
+}
+
+bool UploadRing::hasFences() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return !fences_.empty();
+}
+
+bool UploadRing::hasWaiters() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return waiters_ > 0;
+}
+
+UploadRingStats UploadRing::getStats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    UploadRingStats stats = stats_;
+    if (stats.allocations > 0 && lastRelease_ > firstAllocation_) {
+        stats.streamTime = std::chrono::duration<double, std::milli>(lastRelease_ - firstAllocation_).count();
+    }
+    return stats;
+}
+
+void UploadRing::printReport() const {
+    const UploadRingStats stats = getStats();
+    
+    std::cout << "\n=== Upload Ring ===" << std::endl;
+    std::cout << "Capacity: " << PerformanceMonitor::formatBytes(stats.capacity) << std::endl;
+    std::cout << "Streamed: " << PerformanceMonitor::formatBytes(stats.bytesStreamed) << " in "
+              << stats.allocations << " uploads";
+    if (stats.streamTime > 0.0) {
+        std::cout << ", " << PerformanceMonitor::formatTime(stats.streamTime) << " ("
+                  << PerformanceMonitor::formatBytes(static_cast<size_t>(stats.bytesStreamed / (stats.streamTime / 1000.0)))
+                  << "/s)";
+    }
+    std::cout << std::endl;
+    std::cout << "Stalls: " << stats.stalls << " (" << PerformanceMonitor::formatTime(stats.stallTime) << " waiting)" << std::endl;
+    std::cout << "==================\n" << std::endl;
+}
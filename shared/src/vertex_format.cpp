@@ -0,0 +1,139 @@
+#include "vertex_format.h"
+#include <algorithm>
+#include <cmath>
+
+const char* VertexFormats::name(VertexFormat format) {
+    switch (format) {
+        case VertexFormat::Float: return "float";
+        case VertexFormat::Packed: return "packed";
+    }
+    return "unknown";
+}
+
+size_t VertexFormats::stride(VertexFormat format) {
+    return format == VertexFormat::Packed ? sizeof(PackedTerrainVertex) : sizeof(TerrainVertex);
+}
+
+const char* VertexFormats::vertexShaderPath(VertexFormat format) {
+    return format == VertexFormat::Packed ? "shaders/basic_packed.vert" : "shaders/basic.vert";
+}
+
+void VertexFormats::setupAttributes(VertexFormat format, size_t baseOffset) {
+    if (format == VertexFormat::Packed) {
+        // Grid coordinate (integer values, converted to float)
+        glVertexAttribPointer(0, 2, GL_UNSIGNED_SHORT, GL_FALSE, sizeof(PackedTerrainVertex),
+                            (void*)(baseOffset + offsetof(PackedTerrainVertex, gridX)));
+        glEnableVertexAttribArray(0);
+        
+        // Height, normalized to [0, 1]
+        glVertexAttribPointer(1, 1, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedTerrainVertex),
+                            (void*)(baseOffset + offsetof(PackedTerrainVertex, height)));
+        glEnableVertexAttribArray(1);
+        
+        // Octahedral normal, normalized to [-1, 1]
+        glVertexAttribPointer(2, 2, GL_BYTE, GL_TRUE, sizeof(PackedTerrainVertex),
+                            (void*)(baseOffset + offsetof(PackedTerrainVertex, normal)));
+        glEnableVertexAttribArray(2);
+        return;
+    }
+    
+    // Position attribute
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(TerrainVertex),
+                        (void*)(baseOffset + offsetof(TerrainVertex, position)));
+    glEnableVertexAttribArray(0);
+    
+    // Normal attribute
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(TerrainVertex),
+                        (void*)(baseOffset + offsetof(TerrainVertex, normal)));
+    glEnableVertexAttribArray(1);
+    
+    // Texture coordinate attribute
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(TerrainVertex),
+                        (void*)(baseOffset + offsetof(TerrainVertex, texCoord)));
+    glEnableVertexAttribArray(2);
+    
+    // Color attribute
+    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(TerrainVertex),
+                        (void*)(baseOffset + offsetof(TerrainVertex, color)));
+    glEnableVertexAttribArray(3);
+}
+
+glm::vec4 VertexFormats::patchRange(const PackedVertexRange& range) {
+    return glm::vec4(range.gridOrigin.x, range.gridOrigin.y, range.heightMin, range.heightExtent);
+}
+
+void VertexFormats::setPatchRange(const PackedVertexRange& range) {
+    // Current attribute values are context state, so this holds for
+    // whichever VAO draws next as long as its array is disabled
+    const glm::vec4 value = patchRange(range);
+    glVertexAttrib4f(PATCH_RANGE_ATTRIBUTE, value.x, value.y, value.z, value.w);
+}
+
+glm::vec2 VertexFormats::encodeOctahedral(const glm::vec3& normal) {
+    // Project onto the octahedron |x| + |y| + |z| = 1, then fold the lower
+    // hemisphere over the diagonals of the upper one
+    const glm::vec3 n = normal / (std::fabs(normal.x) + std::fabs(normal.y) + std::fabs(normal.z));
+    glm::vec2 encoded(n.x, n.z);
+    if (n.y < 0.0f) {
+        encoded = glm::vec2((1.0f - std::fabs(n.z)) * (n.x >= 0.0f ? 1.0f : -1.0f),
+                            (1.0f - std::fabs(n.x)) * (n.z >= 0.0f ? 1.0f : -1.0f));
+    }
+    return encoded;
+}
+
+glm::vec3 VertexFormats::decodeOctahedral(const glm::vec2& encoded) {
+    // Mirrors octDecode() in basic_packed.vert
+    glm::vec3 n(encoded.x, 1.0f - std::fabs(encoded.x) - std::fabs(encoded.y), encoded.y);
+    const float fold = std::max(-n.y, 0.0f);
+    n.x += n.x >= 0.0f ? -fold : fold;
+    n.z += n.z >= 0.0f ? -fold : fold;
+    return glm::normalize(n);
+}
+
+PackedVertexRange VertexFormats::computeRange(const TerrainVertex* vertices, size_t count, float gridSpacing) {
+    PackedVertexRange range;
+    if (count == 0) {
+        return range;
+    }
+    
+    glm::vec2 minGrid(vertices[0].position.x, vertices[0].position.z);
+    float minHeight = vertices[0].position.y;
+    float maxHeight = minHeight;
+    for (size_t i = 1; i < count; i++) {
+        minGrid = glm::min(minGrid, glm::vec2(vertices[i].position.x, vertices[i].position.z));
+        minHeight = std::min(minHeight, vertices[i].position.y);
+        maxHeight = std::max(maxHeight, vertices[i].position.y);
+    }
+    
+    range.gridOrigin = glm::vec2(std::round(minGrid.x / gridSpacing), std::round(minGrid.y / gridSpacing));
+    range.heightMin = minHeight;
+    range.heightExtent = maxHeight - minHeight;
+    return range;
+}
+
+PackedTerrainVertex VertexFormats::pack(const TerrainVertex& vertex, const PackedVertexRange& range, float gridSpacing) {
+    auto quantize = [](float value, float scale) {
+        return std::round(glm::clamp(value, -1.0f, 1.0f) * scale);
+    };
+    
+    PackedTerrainVertex packed;
+    packed.gridX = static_cast<uint16_t>(std::round(vertex.position.x / gridSpacing - range.gridOrigin.x));
+    packed.gridZ = static_cast<uint16_t>(std::round(vertex.position.z / gridSpacing - range.gridOrigin.y));
+    
+    const float height = range.heightExtent > 0.0f ? (vertex.position.y - range.heightMin) / range.heightExtent : 0.0f;
+    packed.height = static_cast<uint16_t>(quantize(height, 65535.0f));
+    
+    const glm::vec2 normal = encodeOctahedral(vertex.normal);
+    packed.normal[0] = static_cast<int8_t>(quantize(normal.x, 127.0f));
+    packed.normal[1] = static_cast<int8_t>(quantize(normal.y, 127.0f));
+    return packed;
+}
+
+TerrainVertex VertexFormats::unpack(const PackedTerrainVertex& vertex, const PackedVertexRange& range, float gridSpacing) {
+    TerrainVertex unpacked{};
+    unpacked.position = glm::vec3((range.gridOrigin.x + vertex.gridX) * gridSpacing,
+                                  range.heightMin + vertex.height / 65535.0f * range.heightExtent,
+                                  (range.gridOrigin.y + vertex.gridZ) * gridSpacing);
+    unpacked.normal = decodeOctahedral(glm::vec2(vertex.normal[0] / 127.0f, vertex.normal[1] / 127.0f));
+    return unpacked;
+}
@@ -0,0 +1,57 @@
+// Checks that the recorded path picks the same LOD levels as
+// TerrainLod::selectGridLevels() when the patches are drawn scaled. Only
+// record() runs, which needs no GL context.
+
+#include <cmath>
+#include <iostream>
+#include <vector>
+#include "command_recorder.h"
+#include "terrain_lod.h"
+
+int main() {
+    TerrainGenerator generator(128, 1.0f, 20.0f);
+    generator.setSeed(1234);
+    generator.setPatchCount(16);
+    generator.generateTerrain();
+    
+    std::vector<const TerrainPatch*> grid;
+    for (const auto& patch : generator.getPatches()) {
+        grid.push_back(&patch);
+    }
+    const int columns = generator.getPatchesPerRow();
+    
+    RecordView view;
+    view.scale = 2.5f;
+    view.cameraPos = glm::vec3(40.0f, 30.0f, 40.0f);
+    view.pixelScale = TerrainLod::pixelScale(720, glm::radians(45.0f));
+    view.lodTolerance = 2.0f;
+    view.cull = false;
+    
+    CommandRecorder recorder(4);
+    recorder.record(grid, columns, view);
+    
+    // The non-recorded path: levels in the patches' unscaled space
+    std::vector<int> levels;
+    std::vector<int> stitchMasks;
+    TerrainLod::selectGridLevels(grid, columns, view.cameraPos / view.scale, view.pixelScale, view.lodTolerance,
+                                 levels, stitchMasks);
+    
+    const std::vector<int>& recorded = recorder.getLevels();
+    if (recorded.size() != levels.size()) {
+        std::cerr << "Recorded " << recorded.size() << " levels for " << levels.size() << " cells" << std::endl;
+        return 1;
+    }
+    int failures = 0;
+    for (size_t i = 0; i < levels.size(); i++) {
+        if (recorded[i] != levels[i]) {
+            std::cerr << "Cell " << i << ": recorded level " << recorded[i] << ", expected " << levels[i] << std::endl;
+            failures++;
+        }
+    }
+    if (failures > 0) {
+        return 1;
+    }
+    
+    std::cout << "Recorded LOD levels match at scale " << view.scale << " (" << levels.size() << " cells)" << std::endl;
+    return 0;
+}
@@ -6,6 +6,15 @@
 #include <memory>
 #include "performance_monitor.h"
 #include "terrain_generator.h"
+#include "terrain_streamer.h"
+#include "terrain_batch.h"
+#include "instanced_terrain.h"
+#include "heightmap_terrain.h"
+#include "tessellated_terrain.h"
+#include "compute_terrain_generator.h"
+#include "frame_uniforms.h"
+#include "offscreen_target.h"
+#include "gl_state.h"
 
 class SingleThreadApp {
 public:
@@ -15,6 +24,21 @@ public:
     bool initialize();
     int run();
     
+    // Heightmap displacement against baked vertices at 1024 and 4096 grids:
+    // GPU memory, upload, frame and region update times. Leaves the terrain
+    // at the last size.
+    int runHeightmapBenchmark(const TerrainConfig& config);
+    
+    // Full-detail patches against tessellation at several target edge lengths
+    // on the configured terrain: primitives generated and frame time. Needs
+    // OpenGL 4.0.
+    int runTessellationBenchmark();
+    
+    // Vertices/second of CPU generation (serial and parallel) and of the
+    // compute shader generator, and how far the latter's vertices are from
+    // the CPU's. Needs OpenGL 4.3; leaves the terrain regenerated from config.
+    int runGenerationBenchmark(const TerrainConfig& config);
+    
 private:
     // Initialization
     bool initializeGL();
@@ -23,7 +47,13 @@ private:
     
 public:
     // Configuration
-    void configureTerrain(int gridSize, int patchCount, float heightScale);
+    void configureTerrain(const TerrainConfig& config);
+    void configureStreaming(const StreamingConfig& config);
+    void setLodTolerance(float pixels) { lodTolerance_ = pixels; } // 0 = always full detail
+    void setTessellationEdgePixels(float pixels) { tessellationEdgePixels_ = pixels; }
+    void setComputeGeneration(bool enabled) { useComputeGeneration_ = enabled; }  // Batched modes only
+    void setRenderMode(RenderMode mode);
+    void setHeadless(const HeadlessConfig& config) { headless_ = config; }  // Before initialize(); also limits run()
     
 private:
     
@@ -34,7 +64,16 @@ private:
     
     // Rendering functions
     void uploadPatchToGPU(TerrainPatch& patch);
-    void renderPatch(const TerrainPatch& patch);
+    void renderPatch(const TerrainPatch& patch, int lodLevel = 0, int stitchMask = 0);
+    bool uploadTerrainBatch();  // Falls back to per-patch rendering on failure
+    void renderBatch(const std::vector<const TerrainPatch*>& grid);
+    bool uploadInstancedTerrain();  // Turns instancing off on failure
+    void renderInstanced(const std::vector<const TerrainPatch*>& grid);
+    bool uploadHeightmapTerrain();  // Falls back to per-patch rendering on failure
+    void renderHeightmap(const std::vector<const TerrainPatch*>& grid);
+    bool uploadTessellatedTerrain();  // Turns tessellation off on failure
+    void renderTessellated(float pixelScale);
+    void recordPatchStats(const TerrainPatch& patch, const PatchLod& range);
     void setupMatrices();
     
     // Cleanup
@@ -47,9 +86,22 @@ private:
     
     // Terrain
     std::unique_ptr<TerrainGenerator> terrainGenerator_;
+    std::unique_ptr<TerrainStreamer> terrainStreamer_;  // Set in streaming mode
+    TerrainBatch terrainBatch_;                         // Uploaded in the batched render modes
+    InstancedTerrain instancedTerrain_;                 // Uploaded while instancing is on
+    HeightmapTerrain heightmapTerrain_;                 // Uploaded in the heightmap render mode
+    TessellatedTerrain tessellatedTerrain_;             // Uploaded while tessellation is on
+    ComputeTerrainGenerator computeGenerator_;          // Fills the batch's vertex buffer when enabled
+    bool useComputeGeneration_ = false;
+    RenderMode renderMode_ = RenderMode::PerPatch;      // Static terrain only; streamed tiles draw per patch
     
     // Shaders
+    ShaderCompiler shaderCompiler_;
     Shader terrainShader_;
+    Shader instancedShader_;
+    Shader heightmapShader_;
+    Shader tessellatedShader_;          // Invalid without tessellation support
+    FrameUniformBuffer frameUniforms_;
     
     // Camera
     glm::vec3 cameraPos_;
@@ -70,6 +122,8 @@ private:
     // Performance
     std::unique_ptr<PerformanceMonitor> perfMonitor_;
     bool showPerformanceInfo_;
+    HeadlessConfig headless_;
+    OffscreenTarget offscreenTarget_;   // Drawn into instead of the window when headless
     
     // Timing
     float deltaTime_;
@@ -79,7 +133,12 @@ private:
     bool wireframeMode_;
     bool useLighting_;
     bool useInstancing_;
+    bool useTessellation_ = false;
+    float tessellationEdgePixels_ = 8.0f;   // Target projected length of a tessellated edge segment
     float globalScale_;
+    float lodTolerance_;    // Max screen-space error in pixels
+    std::vector<int> lodLevels_;    // Per-frame selection, reused across frames
+    std::vector<int> stitchMasks_;
     
     // GLFW callbacks (static)
     static void framebufferSizeCallback(GLFWwindow* window, int width, int height);
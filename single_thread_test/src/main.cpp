@@ -1,13 +1,27 @@
 #include <iostream>
+#include "program_cache.h"
+#include "terrain_benchmark.h"
 #include "single_thread_app.h"
 
 int main(int argc, char* argv[]) {
     // Default configuration
     int windowWidth = 1280;
     int windowHeight = 720;
-    int gridSize = 256;
-    int patchCount = 64;
-    float heightScale = 20.0f;
+    TerrainConfig terrainConfig;
+    StreamingConfig streamingConfig;
+    float lodTolerance = 0.0f;
+    float tessEdgePixels = 8.0f;
+    bool gpuGeneration = false;
+    std::string shaderCacheDir = "shader_cache";
+    HeadlessConfig headlessConfig;
+    RenderMode renderMode = RenderMode::PerPatch;
+    bool benchNoise = false;
+    bool benchNormals = false;
+    bool benchVertexFormat = false;
+    bool benchVertexCache = false;
+    bool benchHeightmap = false;
+    bool benchTessellation = false;
+    bool benchGeneration = false;
     
     // Parse command line arguments
     for (int i = 1; i < argc; i++) {
@@ -17,11 +31,73 @@ int main(int argc, char* argv[]) {
         } else if (arg == "--height") {
             windowHeight = std::atoi(argv[++i]);
         } else if (arg == "--grid-size") {
-            gridSize = std::atoi(argv[++i]);
+            terrainConfig.gridSize = std::atoi(argv[++i]);
         } else if (arg == "--patches") {
-            patchCount = std::atoi(argv[++i]);
+            terrainConfig.patchCount = std::atoi(argv[++i]);
         } else if (arg == "--height-scale") {
-            heightScale = std::atof(argv[++i]);
+            terrainConfig.heightScale = std::atof(argv[++i]);
+        } else if (arg == "--gen-threads") {
+            terrainConfig.generationThreads = std::atoi(argv[++i]);
+        } else if (arg == "--noise") {
+            std::string backend = argv[++i];
+            terrainConfig.noiseBackend = backend == "gradient" ? NoiseBackend::Gradient : NoiseBackend::Classic;
+        } else if (arg == "--seed") {
+            terrainConfig.seed = std::atoi(argv[++i]);
+        } else if (arg == "--terrain-cache") {
+            terrainConfig.cachePath = argv[++i];
+        } else if (arg == "--vertex-format") {
+            std::string format = argv[++i];
+            terrainConfig.vertexFormat = format == "packed" ? VertexFormat::Packed : VertexFormat::Float;
+        } else if (arg == "--primitive") {
+            std::string primitive = argv[++i];
+            terrainConfig.primitive = primitive == "strips" ? PatchPrimitive::TriangleStrips : PatchPrimitive::Triangles;
+        } else if (arg == "--render-mode") {
+            std::string mode = argv[++i];
+            renderMode = mode == "multidraw" ? RenderMode::MultiDraw
+                       : mode == "indirect" ? RenderMode::Indirect
+                       : mode == "instanced" ? RenderMode::Instanced
+                       : mode == "heightmap" ? RenderMode::Heightmap
+                       : mode == "tessellated" ? RenderMode::Tessellated : RenderMode::PerPatch;
+        } else if (arg == "--lod-tolerance") {
+            lodTolerance = std::atof(argv[++i]);
+        } else if (arg == "--tess-edge-pixels") {
+            tessEdgePixels = std::atof(argv[++i]);
+        } else if (arg == "--gpu-generation") {
+            gpuGeneration = true;
+        } else if (arg == "--shader-cache") {
+            shaderCacheDir = argv[++i];
+        } else if (arg == "--no-shader-cache") {
+            shaderCacheDir.clear();
+        } else if (arg == "--headless") {
+            headlessConfig.enabled = true;
+        } else if (arg == "--frames") {
+            headlessConfig.frames = std::atoi(argv[++i]);
+        } else if (arg == "--seconds") {
+            headlessConfig.seconds = std::atof(argv[++i]);
+        } else if (arg == "--streaming") {
+            streamingConfig.enabled = true;
+        } else if (arg == "--tile-size") {
+            streamingConfig.tileSize = std::atoi(argv[++i]);
+        } else if (arg == "--stream-radius") {
+            streamingConfig.viewRadius = std::atoi(argv[++i]);
+        } else if (arg == "--stream-cpu-mb") {
+            streamingConfig.cpuBudget = static_cast<size_t>(std::atoi(argv[++i])) * 1024 * 1024;
+        } else if (arg == "--stream-gpu-mb") {
+            streamingConfig.gpuBudget = static_cast<size_t>(std::atoi(argv[++i])) * 1024 * 1024;
+        } else if (arg == "--bench-noise") {
+            benchNoise = true;
+        } else if (arg == "--bench-normals") {
+            benchNormals = true;
+        } else if (arg == "--bench-vertex-format") {
+            benchVertexFormat = true;
+        } else if (arg == "--bench-vertex-cache") {
+            benchVertexCache = true;
+        } else if (arg == "--bench-heightmap") {
+            benchHeightmap = true;
+        } else if (arg == "--bench-tessellation") {
+            benchTessellation = true;
+        } else if (arg == "--bench-generation") {
+            benchGeneration = true;
         } else if (arg == "--help") {
             std::cout << "Usage: " << argv[0] << " [options]" << std::endl;
             std::cout << "Options:" << std::endl;
@@ -30,12 +106,63 @@ int main(int argc, char* argv[]) {
             std::cout << "  --grid-size <size>  Terrain grid size (default: 256)" << std::endl;
             std::cout << "  --patches <count>    Number of terrain patches (default: 64)" << std::endl;
             std::cout << "  --height-scale <s>  Terrain height scale (default: 20.0)" << std::endl;
+            std::cout << "  --gen-threads <n>   Terrain generation threads (default: 0 = all cores)" << std::endl;
+            std::cout << "  --noise <backend>   Noise backend: classic or gradient (default: classic)" << std::endl;
+            std::cout << "  --seed <n>          Terrain seed (default: random)" << std::endl;
+            std::cout << "  --terrain-cache <f> Load terrain from/save it to a cache file (needs --seed)" << std::endl;
+            std::cout << "  --vertex-format <f> Vertex layout: float (44 B) or packed (8 B) (default: float)" << std::endl;
+            std::cout << "  --primitive <p>     Patch primitive: triangles or strips (default: triangles)" << std::endl;
+            std::cout << "  --render-mode <m>   Terrain submission: patches, multidraw, indirect, instanced, heightmap or tessellated (default: patches)" << std::endl;
+            std::cout << "  --lod-tolerance <p> Max screen-space LOD error in pixels (default: 0 = off)" << std::endl;
+            std::cout << "  --tess-edge-pixels <p> Tessellated edge segment length in pixels (default: 8)" << std::endl;
+            std::cout << "  --gpu-generation    Generate batched terrain vertices with a compute shader (OpenGL 4.3)" << std::endl;
+            std::cout << "  --shader-cache <d>  Directory for linked program binaries (default: shader_cache)" << std::endl;
+            std::cout << "  --no-shader-cache   Always compile shaders from source" << std::endl;
+            std::cout << "  --headless          Render offscreen without a display server (GLFW 3.4+)" << std::endl;
+            std::cout << "  --frames <n>        Exit after n frames (headless default: " << HeadlessConfig::DEFAULT_FRAMES << ")" << std::endl;
+            std::cout << "  --seconds <s>       Exit after s seconds" << std::endl;
+            std::cout << "  --streaming         Stream tiles around the camera instead of a fixed grid" << std::endl;
+            std::cout << "  --tile-size <n>     Streaming tile size in quads (default: 32)" << std::endl;
+            std::cout << "  --stream-radius <n> Streaming view radius in tiles (default: 4)" << std::endl;
+            std::cout << "  --stream-cpu-mb <n> Streaming CPU memory budget (default: 256)" << std::endl;
+            std::cout << "  --stream-gpu-mb <n> Streaming GPU memory budget (default: 128)" << std::endl;
+            std::cout << "  --bench-noise       Benchmark the noise kernels and exit" << std::endl;
+            std::cout << "  --bench-normals     Benchmark analytic vs finite-difference normals and exit" << std::endl;
+            std::cout << "  --bench-vertex-format Benchmark float vs packed vertices and exit" << std::endl;
+            std::cout << "  --bench-vertex-cache Report vertex cache efficiency of the patch indices and exit" << std::endl;
+            std::cout << "  --bench-heightmap   Benchmark heightmap displacement vs baked vertices and exit" << std::endl;
+            std::cout << "  --bench-tessellation Benchmark tessellation vs full-detail patches and exit" << std::endl;
+            std::cout << "  --bench-generation  Benchmark CPU vs compute shader terrain generation and exit" << std::endl;
             return 0;
         }
     }
     
+    if (benchNoise || benchNormals || benchVertexFormat || benchVertexCache) {
+        TerrainGenerator generator;
+        generator.configure(terrainConfig);
+        if (benchNoise) {
+            TerrainBenchmark::runNoiseBenchmark(generator);
+        }
+        if (benchNormals) {
+            TerrainBenchmark::runNormalBenchmark(generator);
+        }
+        if (benchVertexFormat) {
+            TerrainBenchmark::runVertexFormatBenchmark(generator);
+        }
+        if (benchVertexCache) {
+            TerrainBenchmark::runVertexCacheBenchmark(generator);
+        }
+        return 0;
+    }
+    
+    ProgramCache::setDirectory(shaderCacheDir);
+    if (headlessConfig.enabled && headlessConfig.frames <= 0 && headlessConfig.seconds <= 0.0) {
+        headlessConfig.frames = HeadlessConfig::DEFAULT_FRAMES;
+    }
+    
     std::cout << "=== OpenGL Single-Thread Performance Test ===" << std::endl;
-    std::cout << "Configuration: " << gridSize << "x" << gridSize << " grid, " << patchCount << " patches" << std::endl;
+    std::cout << "Configuration: " << terrainConfig.gridSize << "x" << terrainConfig.gridSize << " grid, "
+              << terrainConfig.patchCount << " patches" << std::endl;
     std::cout << "Window: " << windowWidth << "x" << windowHeight << std::endl;
     std::cout << "Controls:" << std::endl;
     std::cout << "  WASD - Move camera" << std::endl;
@@ -44,11 +171,13 @@ int main(int argc, char* argv[]) {
     std::cout << "  W - Toggle wireframe mode" << std::endl;
     std::cout << "  L - Toggle lighting" << std::endl;
     std::cout << "  I - Toggle instancing (if available)" << std::endl;
+    std::cout << "  T - Toggle tessellation (OpenGL 4.0)" << std::endl;
     std::cout << "  +/- - Scale terrain" << std::endl;
     std::cout << "  ESC - Exit" << std::endl;
     std::cout << std::endl;
     
     SingleThreadApp app(windowWidth, windowHeight);
+    app.setHeadless(headlessConfig);
     
     if (!app.initialize()) {
         std::cerr << "Failed to initialize application!" << std::endl;
@@ -56,7 +185,21 @@ int main(int argc, char* argv[]) {
     }
     
     // Configure terrain
-    app.configureTerrain(gridSize, patchCount, heightScale);
+    app.configureTerrain(terrainConfig);
+    app.configureStreaming(streamingConfig);
+    app.setLodTolerance(lodTolerance);
+    app.setTessellationEdgePixels(tessEdgePixels);
+    app.setComputeGeneration(gpuGeneration);
+    app.setRenderMode(renderMode);
     
+    if (benchHeightmap) {
+        return app.runHeightmapBenchmark(terrainConfig);
+    }
+    if (benchTessellation) {
+        return app.runTessellationBenchmark();
+    }
+    if (benchGeneration) {
+        return app.runGenerationBenchmark(terrainConfig);
+    }
     return app.run();
 }
\ No newline at end of file
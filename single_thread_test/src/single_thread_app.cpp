@@ -1,9 +1,11 @@
 #include "single_thread_app.h"
+#include <iomanip>
 #include <iostream>
 #include <GLFW/glfw3.h>
 #include <GL/glew.h>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include "terrain_lod.h"
 
 // Static member initialization
 SingleThreadApp* SingleThreadApp::s_instance_ = nullptr;
@@ -14,7 +16,7 @@ SingleThreadApp::SingleThreadApp(int windowWidth, int windowHeight)
       cameraUp_(0.0f, 1.0f, 0.0f), cameraYaw_(-90.0f), cameraPitch_(0.0f),
       cameraSpeed_(5.0f), mouseSensitivity_(0.1f), firstMouse_(true),
       lastMouseX_(windowWidth_ / 2.0), lastMouseY_(windowHeight_ / 2.0),
-      globalScale_(1.0f), deltaTime_(0.0f), lastFrame_(0.0f),
+      globalScale_(1.0f), lodTolerance_(0.0f), deltaTime_(0.0f), lastFrame_(0.0f),
       wireframeMode_(false), useLighting_(true), useInstancing_(false),
       showPerformanceInfo_(true) {
     s_instance_ = this;
@@ -32,13 +34,16 @@ bool SingleThreadApp::initialize() {
         return false;
     }
     
-    if (!initializeTerrain()) {
-        std::cerr << "Failed to initialize terrain!" << std::endl;
+    // Shaders build in the background where the context allows, while the
+    // terrain generates; their first use waits for them
+    shaderCompiler_.initialize(window_);
+    if (!initializeShaders()) {
+        std::cerr << "Failed to initialize shaders!" << std::endl;
         return false;
     }
     
-    if (!initializeShaders()) {
-        std::cerr << "Failed to initialize shaders!" << std::endl;
+    if (!initializeTerrain()) {
+        std::cerr << "Failed to initialize terrain!" << std::endl;
         return false;
     }
     
@@ -49,16 +54,48 @@ bool SingleThreadApp::initialize() {
 }
 
 bool SingleThreadApp::initializeGL() {
+    // Headless runs need GLFW's null platform (3.4): a surfaceless EGL or
+    // OSMesa context, e.g. Mesa's llvmpipe, with no display server. An
+    // invisible native window would still need X11 or Wayland.
+    if (headless_.enabled) {
+#ifdef GLFW_PLATFORM_NULL
+        if (!glfwPlatformSupported(GLFW_PLATFORM_NULL)) {
+            std::cerr << "--headless: GLFW was built without its null platform" << std::endl;
+            return false;
+        }
+        glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+#else
+        std::cerr << "--headless needs GLFW 3.4 or newer (null platform)" << std::endl;
+        return false;
+#endif
+    }
+    
     if (!glfwInit()) {
         std::cerr << "Failed to initialize GLFW!" << std::endl;
         return false;
     }
     
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    // Newest core context the paths use: 4.3 for indirect draws, else 3.3
+    static const int contextVersions[][2] = {{4, 3}, {3, 3}};
+    // The null platform has no native context API
+    const std::vector<int> contextApis = headless_.enabled ? std::vector<int>{ GLFW_EGL_CONTEXT_API, GLFW_OSMESA_CONTEXT_API }
+                                                           : std::vector<int>{ GLFW_NATIVE_CONTEXT_API };
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-    
-    window_ = glfwCreateWindow(windowWidth_, windowHeight_, "Single-Thread OpenGL Test", NULL, NULL);
+    glfwWindowHint(GLFW_VISIBLE, headless_.enabled ? GLFW_FALSE : GLFW_TRUE);
+    for (const auto& version : contextVersions) {
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, version[0]);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, version[1]);
+        for (int api : contextApis) {
+            glfwWindowHint(GLFW_CONTEXT_CREATION_API, api);
+            window_ = glfwCreateWindow(windowWidth_, windowHeight_, "Single-Thread OpenGL Test", NULL, NULL);
+            if (window_) {
+                break;
+            }
+        }
+        if (window_) {
+            break;
+        }
+    }
     if (!window_) {
         std::cerr << "Failed to create GLFW window!" << std::endl;
         glfwTerminate();
@@ -66,15 +103,25 @@ bool SingleThreadApp::initializeGL() {
     }
     
     glfwMakeContextCurrent(window_);
-    glfwSetFramebufferSizeCallback(window_, framebufferSizeCallback);
-    glfwSetCursorPosCallback(window_, mouseCallback);
-    glfwSetScrollCallback(window_, scrollCallback);
-    
-    glfwSetInputMode(window_, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+    // Nothing to resize or steer headless; frames go to the offscreen target
+    if (!headless_.enabled) {
+        glfwSetFramebufferSizeCallback(window_, framebufferSizeCallback);
+        glfwSetCursorPosCallback(window_, mouseCallback);
+        glfwSetScrollCallback(window_, scrollCallback);
+        
+        glfwSetInputMode(window_, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+    }
     
     // Initialize GLEW immediately after OpenGL context is created
     glewExperimental = GL_TRUE;
     GLenum glewError = glewInit();
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+    // GLEW built for GLX loads the GL entry points, then finds no GLX
+    // display behind an EGL or OSMesa context
+    if (headless_.enabled && glewError == GLEW_ERROR_NO_GLX_DISPLAY) {
+        glewError = GLEW_OK;
+    }
+#endif
     if (glewError != GLEW_OK) {
         std::cerr << "Failed to initialize GLEW! Error: " << glewGetErrorString(glewError) << std::endl;
         return false;
@@ -89,6 +136,15 @@ bool SingleThreadApp::initializeGL() {
     std::cout << "GLEW initialized successfully!" << std::endl;
     std::cout << "OpenGL Version: " << glGetString(GL_VERSION) << std::endl;
     
+    if (headless_.enabled) {
+        if (!offscreenTarget_.create(windowWidth_, windowHeight_)) {
+            return false;
+        }
+        offscreenTarget_.bind();
+        std::cout << "Headless: rendering " << windowWidth_ << "x" << windowHeight_ << " offscreen ("
+                  << glGetString(GL_RENDERER) << ")" << std::endl;
+    }
+    
     return true;
 }
 
@@ -98,27 +154,105 @@ bool SingleThreadApp::initializeTerrain() {
     return true;
 }
 
-void SingleThreadApp::configureTerrain(int gridSize, int patchCount, float heightScale) {
+void SingleThreadApp::configureTerrain(const TerrainConfig& config) {
     if (terrainGenerator_) {
-        terrainGenerator_->setGridSize(gridSize);
-        terrainGenerator_->setPatchCount(patchCount);
-        terrainGenerator_->setHeightScale(heightScale);
-        terrainGenerator_->generateTerrain();
+        // The vertex shader has to match the vertex format
+        const bool formatChanged = config.vertexFormat != terrainGenerator_->getVertexFormat();
+        terrainBatch_.release();
+        instancedTerrain_.release();
+        heightmapTerrain_.release();
+        tessellatedTerrain_.release();
+        terrainGenerator_->configure(config);
+        if (formatChanged) {
+            initializeShaders();
+        }
+        terrainGenerator_->generateOrLoad(config.cachePath);
+    }
+}
+
+void SingleThreadApp::configureStreaming(const StreamingConfig& config) {
+    terrainStreamer_.reset();
+    if (terrainGenerator_ && config.enabled) {
+        // Tiles come from the streamer; the up-front terrain is not needed
+        terrainBatch_.release();
+        instancedTerrain_.release();
+        heightmapTerrain_.release();
+        tessellatedTerrain_.release();
+        terrainGenerator_->clear();
+        terrainStreamer_ = std::make_unique<TerrainStreamer>(*terrainGenerator_, config);
     }
 }
 
 bool SingleThreadApp::initializeShaders() {
-    terrainShader_.load("shaders/basic.vert", "shaders/terrain.frag");
-    if (!terrainShader_.isValid()) {
-        std::cerr << "Failed to load terrain shader!" << std::endl;
-        return false;
+    // Before the terrain exists the default (float) format applies
+    const VertexFormat format = terrainGenerator_ ? terrainGenerator_->getVertexFormat() : VertexFormat::Float;
+    if (!frameUniforms_.isCreated()) {
+        frameUniforms_.create();
+    }
+    
+    // Failures are reported when a program is first used; the terrain
+    // shader is the only one without a fallback
+    terrainShader_.loadAsync(shaderCompiler_, VertexFormats::vertexShaderPath(format), "shaders/terrain.frag",
+                             [](const Shader& shader) {
+        if (!shader.isValid()) {
+            std::cerr << "Failed to load terrain shader!" << std::endl;
+            return;
+        }
+        shader.bindUniformBlock(FrameUniformBuffer::BLOCK_NAME, FrameUniformBuffer::BINDING);
+    });
+    
+    instancedShader_.loadAsync(shaderCompiler_, InstancedTerrain::VERTEX_SHADER, "shaders/terrain.frag",
+                               [this](const Shader& shader) {
+        if (!shader.isValid()) {
+            std::cout << "Warning: Instanced shader failed to load, instancing disabled" << std::endl;
+            useInstancing_ = false;
+            return;
+        }
+        shader.bindUniformBlock(FrameUniformBuffer::BLOCK_NAME, FrameUniformBuffer::BINDING);
+        shader.use();
+        shader.setInt("heightmaps", InstancedTerrain::HEIGHTMAP_UNIT);
+    });
+    
+    // Failure only matters if these modes are used, which then fall back
+    heightmapShader_.loadAsync(shaderCompiler_, HeightmapTerrain::VERTEX_SHADER, "shaders/terrain.frag",
+                               [](const Shader& shader) {
+        if (shader.isValid()) {
+            shader.bindUniformBlock(FrameUniformBuffer::BLOCK_NAME, FrameUniformBuffer::BINDING);
+            shader.use();
+            shader.setInt("heightmap", HeightmapTerrain::HEIGHTMAP_UNIT);
+            shader.setInt("normalmap", HeightmapTerrain::NORMALMAP_UNIT);
+        }
+    });
+    if (TessellatedTerrain::isSupported()) {
+        tessellatedShader_.loadAsync(shaderCompiler_, TessellatedTerrain::VERTEX_SHADER,
+                                     TessellatedTerrain::TESS_CONTROL_SHADER, TessellatedTerrain::TESS_EVALUATION_SHADER,
+                                     "shaders/terrain.frag", [](const Shader& shader) {
+            if (shader.isValid()) {
+                shader.bindUniformBlock(FrameUniformBuffer::BLOCK_NAME, FrameUniformBuffer::BINDING);
+                shader.use();
+                shader.setInt("heightmap", TessellatedTerrain::HEIGHTMAP_UNIT);
+                shader.setInt("normalmap", TessellatedTerrain::NORMALMAP_UNIT);
+            }
+        });
     }
     return true;
 }
 
+void SingleThreadApp::setRenderMode(RenderMode mode) {
+    // Instancing (I) and tessellation (T) are toggles over the other modes;
+    // their modes start with them on, over per-patch rendering
+    useInstancing_ = mode == RenderMode::Instanced;
+    useTessellation_ = mode == RenderMode::Tessellated;
+    renderMode_ = useInstancing_ || useTessellation_ ? RenderMode::PerPatch : mode;
+}
+
 int SingleThreadApp::run() {
     setupMatrices();
     
+    // A fixed number of frames or seconds, if set (always when headless)
+    const double startTime = glfwGetTime();
+    int frameCount = 0;
+    bool firstFrame = true;
     while (!glfwWindowShouldClose(window_)) {
         float currentFrame = glfwGetTime();
         deltaTime_ = currentFrame - lastFrame_;
@@ -130,59 +264,426 @@ int SingleThreadApp::run() {
         render();
         handleInput();
         
+        // Headless frames are not presented; finishing them keeps the GPU's
+        // work (the CPU's, with llvmpipe) in the frame times
+        if (headless_.enabled) {
+            glFinish();
+        }
+        
         perfMonitor_->endFrame();
         
-        glfwSwapBuffers(window_);
+        if (!headless_.enabled) {
+            glfwSwapBuffers(window_);
+        }
+        if (firstFrame) {
+            // Startup as a user sees it, from GLFW initialization until the
+            // first frame is done; compare a cold and a warm shader cache
+            glFinish();
+            const ProgramCache::Stats programs = ProgramCache::getStats();
+            std::cout << "Time to first frame: " << PerformanceMonitor::formatTime(glfwGetTime() * 1000.0)
+                      << " (shader programs: " << programs.hits << " from binaries, " << programs.misses
+                      << " compiled)" << std::endl;
+            firstFrame = false;
+        }
         glfwPollEvents();
+        
+        frameCount++;
+        if ((headless_.frames > 0 && frameCount >= headless_.frames) ||
+            (headless_.seconds > 0.0 && glfwGetTime() - startTime >= headless_.seconds)) {
+            break;
+        }
+    }
+    
+    if (headless_.enabled) {
+        const double elapsed = glfwGetTime() - startTime;
+        std::cout << "Headless run: " << frameCount << " frames in " << std::fixed << std::setprecision(2) << elapsed
+                  << " s (" << std::setprecision(1) << (elapsed > 0.0 ? frameCount / elapsed : 0.0) << " FPS)"
+                  << std::endl;
     }
     
     if (showPerformanceInfo_) {
         perfMonitor_->printReport();
+        ProgramCache::printReport();
+        if (terrainStreamer_) {
+            terrainStreamer_->printReport();
+        }
+    }
+    
+    return 0;
+}
+
+int SingleThreadApp::runHeightmapBenchmark(const TerrainConfig& config) {
+    if (terrainStreamer_) {
+        std::cerr << "The heightmap benchmark needs a fixed terrain (no --streaming)" << std::endl;
+        return 1;
+    }
+    
+    const RenderMode configuredMode = renderMode_;
+    const bool configuredInstancing = useInstancing_;
+    const bool configuredTessellation = useTessellation_;
+    useInstancing_ = false;
+    useTessellation_ = false;
+    setupMatrices();
+    
+    // Frame times include the GPU: every frame is finished before the next
+    const int frames = 60;
+    auto timeFrames = [&]() {
+        render();
+        glFinish();
+        const double start = glfwGetTime();
+        for (int frame = 0; frame < frames; frame++) {
+            render();
+            glFinish();
+        }
+        return (glfwGetTime() - start) * 1000.0 / frames;
+    };
+    auto printRow = [](int gridSize, const char* path, size_t bytes, double uploadMs, double frameMs, double updateMs) {
+        std::cout << std::fixed << std::setprecision(2) << std::setw(6) << gridSize << std::setw(11) << path
+                  << std::setw(12) << PerformanceMonitor::formatBytes(bytes) << std::setw(11) << uploadMs
+                  << std::setw(10) << frameMs << std::setw(10) << updateMs << std::endl;
+    };
+    
+    const int regionSize = 64;
+    std::cout << "\n=== Heightmap Displacement Benchmark ===" << std::endl;
+    std::cout << "Memory is vertex and texture data (both paths share the indices); ms, frames averaged over "
+              << frames << "; update replaces a " << regionSize << "x" << regionSize << " region" << std::endl;
+    std::cout << std::setw(6) << "Grid" << std::setw(11) << "Path" << std::setw(12) << "Memory" << std::setw(11) << "Upload"
+              << std::setw(10) << "Frame" << std::setw(10) << "Update" << std::endl;
+    
+    TerrainConfig benchConfig = config;
+    benchConfig.cachePath.clear();
+    for (int gridSize : { 1024, 4096 }) {
+        benchConfig.gridSize = gridSize;
+        configureTerrain(benchConfig);
+        const int regionStart = gridSize / 2 - regionSize / 2;
+        
+        // Heightmap first, while no patch buffers are resident
+        renderMode_ = RenderMode::Heightmap;
+        glFinish();
+        double start = glfwGetTime();
+        if (!uploadHeightmapTerrain()) {
+            renderMode_ = configuredMode;
+            useInstancing_ = configuredInstancing;
+            useTessellation_ = configuredTessellation;
+            return 1;
+        }
+        glFinish();
+        const double heightmapUpload = (glfwGetTime() - start) * 1000.0;
+        const double heightmapFrame = timeFrames();
+        start = glfwGetTime();
+        heightmapTerrain_.updateRegion(*terrainGenerator_, regionStart, regionStart, regionSize, regionSize);
+        glFinish();
+        const double heightmapUpdate = (glfwGetTime() - start) * 1000.0;
+        const size_t heightmapBytes = heightmapTerrain_.getVertexBytes() + heightmapTerrain_.getTextureBytes();
+        heightmapTerrain_.release();
+        
+        // Baked vertices, a buffer per patch
+        renderMode_ = RenderMode::PerPatch;
+        const std::vector<TerrainPatch>& patches = terrainGenerator_->getPatches();
+        glFinish();
+        start = glfwGetTime();
+        for (const auto& patch : patches) {
+            uploadPatchToGPU(const_cast<TerrainPatch&>(patch));
+        }
+        glFinish();
+        const double bakedUpload = (glfwGetTime() - start) * 1000.0;
+        const double bakedFrame = timeFrames();
+        
+        // An edit here replaces the whole buffer of every patch it touches
+        // (upload only; rebuilding the vertices is not counted)
+        const int patchesPerRow = terrainGenerator_->getPatchesPerRow();
+        const int quadsPerPatch = gridSize / patchesPerRow;
+        const int firstPatch = regionStart / quadsPerPatch;
+        const int lastPatch = std::min((regionStart + regionSize - 1) / quadsPerPatch, patchesPerRow - 1);
+        start = glfwGetTime();
+        for (int row = firstPatch; row <= lastPatch; row++) {
+            for (int col = firstPatch; col <= lastPatch; col++) {
+                const TerrainPatch& patch = patches[row * patchesPerRow + col];
+                GLState::bindBuffer(GL_ARRAY_BUFFER, patch.VBO);
+                glBufferSubData(GL_ARRAY_BUFFER, 0, patch.gpuVertexBytes(), patch.gpuVertexData());
+            }
+        }
+        glFinish();
+        const double bakedUpdate = (glfwGetTime() - start) * 1000.0;
+        
+        printRow(gridSize, "baked", terrainGenerator_->getVertexMemory(), bakedUpload, bakedFrame, bakedUpdate);
+        printRow(gridSize, "heightmap", heightmapBytes, heightmapUpload, heightmapFrame, heightmapUpdate);
+        
+        // So that the next grid's heightmap pass also runs with no patch
+        // buffers resident or counted
+        terrainGenerator_->releaseGpuBuffers();
+        perfMonitor_->reset();
+    }
+    std::cout << "========================================\n" << std::endl;
+    
+    renderMode_ = configuredMode;
+    useInstancing_ = configuredInstancing;
+    useTessellation_ = configuredTessellation;
+    perfMonitor_->reset();
+    return 0;
+}
+
+int SingleThreadApp::runTessellationBenchmark() {
+    if (terrainStreamer_) {
+        std::cerr << "The tessellation benchmark needs a fixed terrain (no --streaming)" << std::endl;
+        return 1;
+    }
+    if (!tessellatedShader_.isValid()) {
+        std::cerr << "The tessellation benchmark needs OpenGL 4.0 tessellation shaders" << std::endl;
+        return 1;
+    }
+    
+    const RenderMode configuredMode = renderMode_;
+    const bool configuredInstancing = useInstancing_;
+    const bool configuredTessellation = useTessellation_;
+    const float configuredTolerance = lodTolerance_;
+    const float configuredEdgePixels = tessellationEdgePixels_;
+    renderMode_ = RenderMode::PerPatch;
+    useInstancing_ = false;
+    setupMatrices();
+    
+    // Primitives are counted by the GPU, after tessellation and before
+    // clipping; frame times include the GPU: every frame is finished
+    GLuint query = 0;
+    glGenQueries(1, &query);
+    const int frames = 60;
+    auto measure = [&](const char* path, float setting) {
+        render();
+        glBeginQuery(GL_PRIMITIVES_GENERATED, query);
+        render();
+        glEndQuery(GL_PRIMITIVES_GENERATED);
+        GLuint primitives = 0;
+        glGetQueryObjectuiv(query, GL_QUERY_RESULT, &primitives);
+        
+        glFinish();
+        const double start = glfwGetTime();
+        for (int frame = 0; frame < frames; frame++) {
+            render();
+            glFinish();
+        }
+        const double frameMs = (glfwGetTime() - start) * 1000.0 / frames;
+        std::cout << std::fixed << std::setprecision(2) << std::setw(13) << path << std::setw(8) << setting
+                  << std::setw(14) << primitives << std::setw(10) << frameMs << std::endl;
+    };
+    
+    std::cout << "\n=== Tessellation Benchmark ===" << std::endl;
+    std::cout << "Grid " << terrainGenerator_->getGridSize() << "; primitives per frame; ms, frames averaged over "
+              << frames << std::endl;
+    std::cout << std::setw(13) << "Path" << std::setw(8) << "Pixels" << std::setw(14) << "Primitives"
+              << std::setw(10) << "Frame" << std::endl;
+    
+    // Every patch at full detail, then the GPU's per-edge LOD at a range of
+    // segment lengths
+    useTessellation_ = false;
+    lodTolerance_ = 0.0f;
+    measure("full detail", 0.0f);
+    useTessellation_ = true;
+    for (float edgePixels : { 16.0f, 8.0f, 4.0f, 2.0f }) {
+        tessellationEdgePixels_ = edgePixels;
+        measure("tessellated", edgePixels);
     }
+    std::cout << "==============================\n" << std::endl;
+    glDeleteQueries(1, &query);
     
+    renderMode_ = configuredMode;
+    useInstancing_ = configuredInstancing;
+    useTessellation_ = configuredTessellation;
+    lodTolerance_ = configuredTolerance;
+    tessellationEdgePixels_ = configuredEdgePixels;
+    perfMonitor_->reset();
     return 0;
 }
 
+int SingleThreadApp::runGenerationBenchmark(const TerrainConfig& config) {
+    if (terrainStreamer_) {
+        std::cerr << "The generation benchmark needs a fixed terrain (no --streaming)" << std::endl;
+        return 1;
+    }
+    ComputeTerrainGenerator compute;
+    if (!compute.initialize()) {
+        std::cerr << "The generation benchmark needs OpenGL 4.3 compute shaders" << std::endl;
+        return 1;
+    }
+    
+    // The GPU writes float vertices, so that is what the CPU is timed on
+    TerrainConfig benchConfig = config;
+    benchConfig.cachePath.clear();
+    benchConfig.vertexFormat = VertexFormat::Float;
+    
+    const int runs = 3;
+    auto timeCpu = [&](int threads) {
+        benchConfig.generationThreads = threads;
+        configureTerrain(benchConfig);
+        double best = 1e30;
+        for (int run = 0; run < runs; run++) {
+            const double start = glfwGetTime();
+            terrainGenerator_->generateTerrain();
+            best = std::min(best, (glfwGetTime() - start) * 1000.0);
+        }
+        return best;
+    };
+    const double serialMs = timeCpu(1);
+    const double parallelMs = timeCpu(0);
+    const size_t vertexCount = terrainGenerator_->getTotalVertices();
+    const size_t vertexBytes = ComputeTerrainGenerator::getVertexBytes(*terrainGenerator_);
+    
+    // Straight into a vertex buffer, as TerrainBatch uses it; finished
+    // before and after, so the time is the GPU's
+    GLuint buffer = 0;
+    glGenBuffers(1, &buffer);
+    GLState::bindBuffer(GL_ARRAY_BUFFER, buffer);
+    glBufferData(GL_ARRAY_BUFFER, vertexBytes, nullptr, GL_STATIC_DRAW);
+    double computeMs = 1e30;
+    bool generated = compute.generate(*terrainGenerator_, buffer);
+    for (int run = 0; generated && run < runs; run++) {
+        glFinish();
+        const double start = glfwGetTime();
+        generated = compute.generate(*terrainGenerator_, buffer);
+        glFinish();
+        computeMs = std::min(computeMs, (glfwGetTime() - start) * 1000.0);
+    }
+    if (!generated) {
+        GLState::deleteBuffer(buffer);
+        return 1;
+    }
+    
+    // Compared against the last CPU run, which has the same layout
+    std::vector<TerrainVertex> gpuVertices(vertexCount);
+    GLState::bindBuffer(GL_ARRAY_BUFFER, buffer);
+    glGetBufferSubData(GL_ARRAY_BUFFER, 0, vertexBytes, gpuVertices.data());
+    GLState::deleteBuffer(buffer);
+    const TerrainVertex* cpuVertices = static_cast<const TerrainVertex*>(terrainGenerator_->getVertexArenaData());
+    const float tolerance = 1e-4f * terrainGenerator_->getHeightScale();
+    float positionError = 0.0f;
+    float normalError = 0.0f;
+    float colorError = 0.0f;
+    size_t outliers = 0;
+    for (size_t i = 0; i < vertexCount; i++) {
+        const TerrainVertex& cpu = cpuVertices[i];
+        const TerrainVertex& gpu = gpuVertices[i];
+        const float position = glm::length(cpu.position - gpu.position);
+        positionError = std::max(positionError, position);
+        normalError = std::max(normalError, glm::length(cpu.normal - gpu.normal));
+        colorError = std::max(colorError, glm::length(cpu.color - gpu.color));
+        if (position > tolerance || glm::length(cpu.texCoord - gpu.texCoord) > 1e-6f) {
+            outliers++;
+        }
+    }
+    
+    auto printRow = [vertexCount](const char* backend, double ms) {
+        std::cout << std::fixed << std::setprecision(2) << std::setw(14) << backend << std::setw(11) << ms
+                  << std::setw(14) << vertexCount / (ms / 1000.0) / 1e6 << std::endl;
+    };
+    std::cout << "\n=== Terrain Generation Benchmark ===" << std::endl;
+    std::cout << "Grid " << terrainGenerator_->getGridSize() << ", " << vertexCount << " vertices ("
+              << NoiseKernels::name(terrainGenerator_->getNoiseBackend()) << " noise); best of " << runs
+              << " runs. CPU times include LOD errors and bounds, which the GPU does not compute." << std::endl;
+    std::cout << std::setw(14) << "Backend" << std::setw(11) << "ms" << std::setw(14) << "M vertices/s" << std::endl;
+    printRow("CPU serial", serialMs);
+    printRow("CPU parallel", parallelMs);
+    printRow("compute", computeMs);
+    std::cout << std::setprecision(6) << "Compute vs CPU: max position error " << positionError
+              << ", normal " << normalError << ", color " << colorError << "; " << outliers << " of " << vertexCount
+              << " vertices beyond " << tolerance << (outliers == 0 ? " (match)" : " (MISMATCH)") << std::endl;
+    std::cout << "====================================\n" << std::endl;
+    
+    configureTerrain(config);
+    perfMonitor_->reset();
+    return outliers == 0 ? 0 : 1;
+}
+
 void SingleThreadApp::update() {
     // Update camera position based on input
     // (handled in handleInput)
 }
 
 void SingleThreadApp::render() {
-    if (wireframeMode_) {
-        glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+    // The tessellated, instanced and heightmap terrains have their own
+    // programs, so they are uploaded first
+    const bool tessellated = useTessellation_ && !terrainStreamer_ && uploadTessellatedTerrain();
+    const bool instanced = !tessellated && useInstancing_ && !terrainStreamer_ && uploadInstancedTerrain();
+    const bool heightmap = !tessellated && !instanced && renderMode_ == RenderMode::Heightmap && !terrainStreamer_ &&
+                           uploadHeightmapTerrain();
+    const bool ownPath = tessellated || instanced || heightmap;
+    
+    // Through GLState: after the first frame these only cost a comparison
+    GLState::polygonMode(wireframeMode_ ? GL_LINE : GL_FILL);
+    GLState::clearColor(glm::vec4(0.1f, 0.1f, 0.2f, 1.0f));
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    GLState::enable(GL_DEPTH_TEST);
+    GLState::enable(GL_PRIMITIVE_RESTART); // Every indexed draw sets its topology's restart index
+    
+    Shader& currentShader = tessellated ? tessellatedShader_ : instanced ? instancedShader_
+                          : heightmap ? heightmapShader_ : terrainShader_;
+    currentShader.use();
+    
+    // Matrices, lighting and camera: one buffer update per frame
+    FrameUniforms frame;
+    frame.view = view_;
+    frame.projection = projection_;
+    frame.model = glm::mat4(1.0f);
+    frame.normalMatrix = FrameUniformBuffer::normalMatrixOf(frame.model);
+    frame.lightPos = glm::vec3(50.0f, 50.0f, 50.0f);
+    frame.time = static_cast<float>(glfwGetTime());
+    frame.lightColor = glm::vec3(1.0f, 1.0f, 1.0f);
+    frame.useLighting = useLighting_ ? 1 : 0;
+    frame.viewPos = cameraPos_;
+    frame.globalScale = 1.0f;
+    frameUniforms_.update(frame);
+    
+    // The other paths' programs get their terrain uniforms where they draw
+    if (!ownPath && terrainGenerator_->getVertexFormat() == VertexFormat::Packed) {
+        terrainShader_.setFloat("gridSpacing", terrainGenerator_->getPatchSize());
+        terrainShader_.setFloat("gridSize", static_cast<float>(terrainGenerator_->getGridSize()));
+        terrainShader_.setFloat("heightScale", terrainGenerator_->getHeightScale());
+    }
+    
+    // Gather the patch grid; in streaming mode the streamer uploads tiles
+    // itself, a few per frame
+    std::vector<const TerrainPatch*> grid;
+    int columns;
+    if (terrainStreamer_) {
+        terrainStreamer_->update(cameraPos_, cameraFront_);
+        grid = terrainStreamer_->getVisibleGrid();
+        columns = terrainStreamer_->getGridColumns();
     } else {
-        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+        // The batch replaces the per-patch buffers
+        const bool batched = ownPath || (renderMode_ != RenderMode::PerPatch && uploadTerrainBatch());
+        for (const auto& patch : terrainGenerator_->getPatches()) {
+            if (!batched) {
+                uploadPatchToGPU(const_cast<TerrainPatch&>(patch));
+            }
+            grid.push_back(&patch);
+        }
+        columns = terrainGenerator_->getPatchesPerRow();
     }
     
-    glClearColor(0.1f, 0.1f, 0.2f, 1.0f);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    glEnable(GL_DEPTH_TEST);
-    
-    terrainShader_.use();
-    
-    // Set matrices
-    terrainShader_.setMat4("view", view_);
-    terrainShader_.setMat4("projection", projection_);
-    terrainShader_.setMat4("model", glm::mat4(1.0f));
-    
-    // Set lighting
-    terrainShader_.setVec3("lightPos", glm::vec3(50.0f, 50.0f, 50.0f));
-    terrainShader_.setVec3("lightColor", glm::vec3(1.0f, 1.0f, 1.0f));
-    terrainShader_.setVec3("viewPos", cameraPos_);
-    terrainShader_.setInt("useLighting", useLighting_ ? 1 : 0);
-    terrainShader_.setInt("useTexture", 0);
-    terrainShader_.setFloat("time", glfwGetTime());
-    
-    // Render terrain patches
-    const auto& patches = terrainGenerator_->getPatches();
-    for (const auto& patch : patches) {
-        uploadPatchToGPU(const_cast<TerrainPatch&>(patch));
-        renderPatch(patch);
-        perfMonitor_->incrementDrawCalls();
-        perfMonitor_->addTriangles(patch.indices.size() / 3);
-        perfMonitor_->addVertices(patch.vertices.size());
+    // Render terrain patches, stitching edges where a neighbour is coarser
+    const float pixelScale = TerrainLod::pixelScale(windowHeight_, glm::radians(45.0f));
+    if (!tessellated) {
+        // Tessellation picks its LOD per cell edge on the GPU
+        TerrainLod::selectGridLevels(grid, columns, cameraPos_, pixelScale, lodTolerance_, lodLevels_, stitchMasks_);
+    }
+    const double submitStart = glfwGetTime();
+    if (tessellated) {
+        renderTessellated(pixelScale);
+    } else if (instanced) {
+        renderInstanced(grid);
+    } else if (heightmap) {
+        renderHeightmap(grid);
+    } else if (!terrainStreamer_ && terrainBatch_.isUploaded()) {
+        renderBatch(grid);
+    } else {
+        for (size_t i = 0; i < grid.size(); i++) {
+            if (grid[i]) {
+                renderPatch(*grid[i], lodLevels_[i], stitchMasks_[i]);
+            }
+        }
     }
+    perfMonitor_->addSubmitTime((glfwGetTime() - submitStart) * 1000.0);
+    
+    const GLStateStats stateStats = GLState::takeStats();
+    perfMonitor_->addStateCalls(stateStats.issued, stateStats.filtered);
 }
 
 void SingleThreadApp::handleInput() {
@@ -217,6 +718,9 @@ void SingleThreadApp::handleInput() {
     if (glfwGetKey(window_, GLFW_KEY_I) == GLFW_PRESS) {
         useInstancing_ = !useInstancing_;
     }
+    if (glfwGetKey(window_, GLFW_KEY_T) == GLFW_PRESS) {
+        useTessellation_ = !useTessellation_;
+    }
     if (glfwGetKey(window_, GLFW_KEY_EQUAL) == GLFW_PRESS) {
         globalScale_ += 0.1f;
     }
@@ -231,52 +735,204 @@ void SingleThreadApp::uploadPatchToGPU(TerrainPatch& patch) {
     if (!patch.isUploaded) {
         glGenVertexArrays(1, &patch.VAO);
         glGenBuffers(1, &patch.VBO);
-        glGenBuffers(1, &patch.EBO);
-        
-        glBindVertexArray(patch.VAO);
         
-        glBindBuffer(GL_ARRAY_BUFFER, patch.VBO);
-        glBufferData(GL_ARRAY_BUFFER, patch.vertices.size() * sizeof(TerrainVertex), 
-                    patch.vertices.data(), GL_STATIC_DRAW);
+        GLState::bindVertexArray(patch.VAO);
         
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, patch.EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, patch.indices.size() * sizeof(unsigned int),
-                    patch.indices.data(), GL_STATIC_DRAW);
+        GLState::bindBuffer(GL_ARRAY_BUFFER, patch.VBO);
+        const double uploadStart = glfwGetTime();
+        glBufferData(GL_ARRAY_BUFFER, patch.gpuVertexBytes(), patch.gpuVertexData(), GL_STATIC_DRAW);
+        perfMonitor_->addUpload(patch.gpuVertexBytes(), (glfwGetTime() - uploadStart) * 1000.0);
         
-        // Position attribute
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(TerrainVertex), 
-                            (void*)offsetof(TerrainVertex, position));
-        glEnableVertexAttribArray(0);
+        // Index buffer shared by every patch of this resolution
+        bool newTopology = false;
+        GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, patch.topology->getElementBuffer(&newTopology));
         
-        // Normal attribute
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(TerrainVertex),
-                            (void*)offsetof(TerrainVertex, normal));
-        glEnableVertexAttribArray(1);
+        VertexFormats::setupAttributes(patch.vertexFormat());
         
-        // Texture coordinate attribute
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(TerrainVertex),
-                            (void*)offsetof(TerrainVertex, texCoord));
-        glEnableVertexAttribArray(2);
-        
-        // Color attribute
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(TerrainVertex),
-                            (void*)offsetof(TerrainVertex, color));
-        glEnableVertexAttribArray(3);
-        
-        glBindVertexArray(0);
+        GLState::bindVertexArray(0);
         patch.isUploaded = true;
         
-        perfMonitor_->addVBOMemory(patch.vertices.size() * sizeof(TerrainVertex) + 
-                                  patch.indices.size() * sizeof(unsigned int));
+        perfMonitor_->addVBOMemory(patch.gpuVertexBytes() + 
+                                  (newTopology ? patch.topology->getIndexBytes() : 0));
     }
 }
 
-void SingleThreadApp::renderPatch(const TerrainPatch& patch) {
+void SingleThreadApp::renderPatch(const TerrainPatch& patch, int lodLevel, int stitchMask) {
+    const PatchTopology& topology = *patch.topology;
+    const PatchLod& range = patch.lodRange(lodLevel, stitchMask);
+    
     if (patch.isUploaded) {
-        glBindVertexArray(patch.VAO);
-        glDrawElements(GL_TRIANGLES, patch.indices.size(), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
+        if (patch.vertexFormat() == VertexFormat::Packed) {
+            VertexFormats::setPatchRange(patch.packedRange);
+        }
+        
+        GLState::primitiveRestartIndex(topology.getRestartIndex());
+        
+        // Left bound: the next patch's bind replaces it
+        GLState::bindVertexArray(patch.VAO);
+        glDrawElements(topology.getPrimitiveMode(), range.indexCount, topology.getIndexType(),
+                      (void*)(range.firstIndex * topology.getIndexSize()));
+    }
+    
+    perfMonitor_->incrementDrawCalls();
+    recordPatchStats(patch, range);
+}
+
+bool SingleThreadApp::uploadTerrainBatch() {
+    if (terrainBatch_.isUploaded()) {
+        return true;
+    }
+    
+    if (!TerrainBatch::isSupported(renderMode_)) {
+        std::cout << "Indirect draws need OpenGL 4.3; using multidraw" << std::endl;
+        renderMode_ = RenderMode::MultiDraw;
+    }
+    
+    if (useComputeGeneration_ && !computeGenerator_.isInitialized() && !computeGenerator_.initialize()) {
+        std::cout << "Compute generation unavailable (needs OpenGL 4.3); uploading the vertices" << std::endl;
+        useComputeGeneration_ = false;
     }
+    
+    bool newTopology = false;
+    const double uploadStart = glfwGetTime();
+    if (!terrainBatch_.upload(*terrainGenerator_, renderMode_, &newTopology,
+                              useComputeGeneration_ ? &computeGenerator_ : nullptr)) {
+        std::cout << "Falling back to per-patch rendering" << std::endl;
+        renderMode_ = RenderMode::PerPatch;
+        return false;
+    }
+    
+    // Generated vertices cost GPU time, not an upload
+    const size_t uploadedBytes = terrainBatch_.isComputeGenerated() ? 0 : terrainBatch_.getVertexBytes();
+    perfMonitor_->addUpload(uploadedBytes, (glfwGetTime() - uploadStart) * 1000.0);
+    perfMonitor_->addVBOMemory(terrainBatch_.getVertexBytes() +
+                              (newTopology ? terrainBatch_.getTopology()->getIndexBytes() : 0));
+    return true;
+}
+
+void SingleThreadApp::renderBatch(const std::vector<const TerrainPatch*>& grid) {
+    for (size_t i = 0; i < grid.size(); i++) {
+        if (grid[i]) {
+            terrainBatch_.add(*grid[i], lodLevels_[i], stitchMasks_[i]);
+            recordPatchStats(*grid[i], grid[i]->lodRange(lodLevels_[i], stitchMasks_[i]));
+        }
+    }
+    
+    const PatchTopology& topology = *terrainBatch_.getTopology();
+    GLState::primitiveRestartIndex(topology.getRestartIndex());
+    perfMonitor_->incrementDrawCalls(terrainBatch_.flush());
+}
+
+bool SingleThreadApp::uploadInstancedTerrain() {
+    if (instancedTerrain_.isUploaded()) {
+        return true;
+    }
+    
+    bool newTopology = false;
+    const double uploadStart = glfwGetTime();
+    if (!instancedShader_.isValid() || !instancedTerrain_.upload(*terrainGenerator_, &newTopology)) {
+        std::cout << "Instancing unavailable; falling back to " << TerrainBatch::name(renderMode_) << " rendering" << std::endl;
+        useInstancing_ = false;
+        return false;
+    }
+    const size_t bytes = instancedTerrain_.getVertexBytes() + instancedTerrain_.getTextureBytes();
+    perfMonitor_->addUpload(bytes, (glfwGetTime() - uploadStart) * 1000.0);
+    perfMonitor_->addVBOMemory(instancedTerrain_.getVertexBytes() +
+                              (newTopology ? instancedTerrain_.getTopology()->getIndexBytes() : 0));
+    perfMonitor_->addTextureMemory(instancedTerrain_.getTextureBytes());
+    return true;
+}
+
+void SingleThreadApp::renderInstanced(const std::vector<const TerrainPatch*>& grid) {
+    instancedShader_.setFloat("gridSize", static_cast<float>(terrainGenerator_->getGridSize()));
+    instancedShader_.setFloat("heightScale", terrainGenerator_->getHeightScale());
+    
+    for (size_t i = 0; i < grid.size(); i++) {
+        if (grid[i]) {
+            instancedTerrain_.add(*grid[i], lodLevels_[i], stitchMasks_[i]);
+            recordPatchStats(*grid[i], grid[i]->lodRange(lodLevels_[i], stitchMasks_[i]));
+        }
+    }
+    
+    const PatchTopology& topology = *instancedTerrain_.getTopology();
+    GLState::primitiveRestartIndex(topology.getRestartIndex());
+    perfMonitor_->incrementDrawCalls(instancedTerrain_.flush());
+}
+
+bool SingleThreadApp::uploadHeightmapTerrain() {
+    if (heightmapTerrain_.isUploaded()) {
+        return true;
+    }
+    
+    bool newTopology = false;
+    const double uploadStart = glfwGetTime();
+    if (!heightmapShader_.isValid() || !heightmapTerrain_.upload(*terrainGenerator_, true, &newTopology)) {
+        std::cout << "Heightmap terrain unavailable; falling back to per-patch rendering" << std::endl;
+        renderMode_ = RenderMode::PerPatch;
+        return false;
+    }
+    const size_t bytes = heightmapTerrain_.getVertexBytes() + heightmapTerrain_.getTextureBytes();
+    perfMonitor_->addUpload(bytes, (glfwGetTime() - uploadStart) * 1000.0);
+    perfMonitor_->addVBOMemory(heightmapTerrain_.getVertexBytes() +
+                              (newTopology ? heightmapTerrain_.getTopology()->getIndexBytes() : 0));
+    perfMonitor_->addTextureMemory(heightmapTerrain_.getTextureBytes());
+    return true;
+}
+
+void SingleThreadApp::renderHeightmap(const std::vector<const TerrainPatch*>& grid) {
+    heightmapShader_.setFloat("gridSpacing", terrainGenerator_->getPatchSize());
+    heightmapShader_.setFloat("gridSize", static_cast<float>(terrainGenerator_->getGridSize()));
+    heightmapShader_.setFloat("heightScale", terrainGenerator_->getHeightScale());
+    heightmapShader_.setVec2("heightRange", heightmapTerrain_.getHeightRange());
+    
+    for (size_t i = 0; i < grid.size(); i++) {
+        if (grid[i]) {
+            heightmapTerrain_.add(*grid[i], lodLevels_[i], stitchMasks_[i]);
+            recordPatchStats(*grid[i], grid[i]->lodRange(lodLevels_[i], stitchMasks_[i]));
+        }
+    }
+    
+    const PatchTopology& topology = *heightmapTerrain_.getTopology();
+    GLState::primitiveRestartIndex(topology.getRestartIndex());
+    perfMonitor_->incrementDrawCalls(heightmapTerrain_.flush());
+}
+
+bool SingleThreadApp::uploadTessellatedTerrain() {
+    if (tessellatedTerrain_.isUploaded()) {
+        return true;
+    }
+    
+    const double uploadStart = glfwGetTime();
+    if (!tessellatedShader_.isValid() || !tessellatedTerrain_.upload(*terrainGenerator_)) {
+        std::cout << "Tessellation unavailable (needs OpenGL 4.0); falling back to " << TerrainBatch::name(renderMode_)
+                  << " rendering" << std::endl;
+        useTessellation_ = false;
+        return false;
+    }
+    const size_t bytes = tessellatedTerrain_.getVertexBytes() + tessellatedTerrain_.getTextureBytes();
+    perfMonitor_->addUpload(bytes, (glfwGetTime() - uploadStart) * 1000.0);
+    perfMonitor_->addVBOMemory(tessellatedTerrain_.getVertexBytes());
+    perfMonitor_->addTextureMemory(tessellatedTerrain_.getTextureBytes());
+    return true;
+}
+
+void SingleThreadApp::renderTessellated(float pixelScale) {
+    tessellatedShader_.setFloat("gridSpacing", terrainGenerator_->getPatchSize());
+    tessellatedShader_.setFloat("gridSize", static_cast<float>(terrainGenerator_->getGridSize()));
+    tessellatedShader_.setFloat("heightScale", terrainGenerator_->getHeightScale());
+    tessellatedShader_.setVec2("heightRange", tessellatedTerrain_.getHeightRange());
+    tessellatedShader_.setFloat("pixelScale", pixelScale);
+    tessellatedShader_.setFloat("edgePixels", tessellationEdgePixels_);
+    perfMonitor_->incrementDrawCalls(tessellatedTerrain_.draw());
+}
+
+void SingleThreadApp::recordPatchStats(const TerrainPatch& patch, const PatchLod& range) {
+    const PatchTopology& topology = *patch.topology;
+    perfMonitor_->addTriangles(range.triangleCount);
+    perfMonitor_->addVertexTransforms(range.vertexTransforms);
+    perfMonitor_->addIndexFetch(range.indexCount * topology.getIndexSize(), range.triangleCount * 3 * sizeof(unsigned int));
+    perfMonitor_->addFullDetailTriangles(patch.fullDetailTriangleCount());
+    perfMonitor_->addVertices(patch.vertexCount());
 }
 
 void SingleThreadApp::setupMatrices() {
@@ -287,6 +943,16 @@ void SingleThreadApp::setupMatrices() {
 }
 
 void SingleThreadApp::cleanup() {
+    terrainStreamer_.reset();
+    terrainBatch_.release();
+    instancedTerrain_.release();
+    heightmapTerrain_.release();
+    tessellatedTerrain_.release();
+    computeGenerator_.release();
+    frameUniforms_.release();
+    offscreenTarget_.release();
+    shaderCompiler_.shutdown();
+    
     if (window_) {
         glfwDestroyWindow(window_);
     }